@@ -0,0 +1,191 @@
+/*
+ * CBORBenchmark.cpp
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Benchmark for CBOR and JSON payloads.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+#include <MQTT.h>
+
+/** @brief Number of encoded and decoded payloads for each format.
+ */
+#define ITERATIONS                  1000
+
+MQTT Client;
+uint8_t Payload[128];
+
+/** @brief Sensor record for the payloads.
+ */
+typedef struct
+{
+    float Temperature;
+    uint32_t Humidity;
+    uint32_t Pressure;
+    bool Ok;
+} Record;
+
+const Record Sample = {21.5f, 48, 101325, true};
+
+uint16_t EncodeCBOR(uint8_t* Buffer, uint16_t Size, const Record& Data)
+{
+    MQTTCBORWriter Writer(Buffer, Size);
+
+    Writer.BeginMap(4);
+    Writer.AddText("t");
+    Writer.AddFloat(Data.Temperature);
+    Writer.AddText("h");
+    Writer.AddUnsigned(Data.Humidity);
+    Writer.AddText("p");
+    Writer.AddUnsigned(Data.Pressure);
+    Writer.AddText("ok");
+    Writer.AddBool(Data.Ok);
+
+    return Writer.Length();
+}
+
+uint16_t EncodeJSON(uint8_t* Buffer, uint16_t Size, const Record& Data)
+{
+    return snprintf((char*)Buffer, Size, "{\"t\":%.2f,\"h\":%lu,\"p\":%lu,\"ok\":%s}", Data.Temperature, (unsigned long)Data.Humidity, (unsigned long)Data.Pressure, Data.Ok ? "true" : "false");
+}
+
+bool DecodeCBOR(const uint8_t* Buffer, uint16_t Length, Record* Data)
+{
+    MQTT_CBOR_Item Key;
+    MQTT_CBOR_Item Value;
+    MQTTCBORReader Reader(Buffer, Length);
+
+    if(!Reader.Next(&Key) || (Key.Type != MQTT_CBOR_MAP))
+    {
+        return false;
+    }
+
+    uint64_t Pairs = Key.Value;
+    for(uint64_t i = 0x00; (i < Pairs) && Reader.Next(&Key) && Reader.Next(&Value); i++)
+    {
+        if((Key.Type == MQTT_CBOR_TEXT) && (Key.Length == 1) && (Key.Data[0] == 't'))
+        {
+            Data->Temperature = Value.Float;
+        }
+        else if((Key.Type == MQTT_CBOR_TEXT) && (Key.Length == 1) && (Key.Data[0] == 'h'))
+        {
+            Data->Humidity = Value.Value;
+        }
+        else if((Key.Type == MQTT_CBOR_TEXT) && (Key.Length == 1) && (Key.Data[0] == 'p'))
+        {
+            Data->Pressure = Value.Value;
+        }
+        else if((Key.Type == MQTT_CBOR_TEXT) && (Key.Length == 2) && !memcmp(Key.Data, "ok", 2))
+        {
+            Data->Ok = (Value.Value == MQTT_CBOR_TRUE);
+        }
+
+        // Ignore nested values
+        Reader.Skip(&Value);
+    }
+
+    return Reader.isFinished();
+}
+
+bool DecodeJSON(const uint8_t* Buffer, uint16_t Length, Record* Data)
+{
+    JSONValue Object = JSONValue::parseCopy((const char*)Buffer, Length);
+    JSONObjectIterator Iterator(Object);
+
+    while(Iterator.next())
+    {
+        if(Iterator.name() == "t")
+        {
+            Data->Temperature = Iterator.value().toDouble();
+        }
+        else if(Iterator.name() == "h")
+        {
+            Data->Humidity = Iterator.value().toInt();
+        }
+        else if(Iterator.name() == "p")
+        {
+            Data->Pressure = Iterator.value().toInt();
+        }
+        else if(Iterator.name() == "ok")
+        {
+            Data->Ok = Iterator.value().toBool();
+        }
+    }
+
+    return Object.isValid();
+}
+
+void Measure(const char* Name, uint16_t (*Encode)(uint8_t*, uint16_t, const Record&), bool (*Decode)(const uint8_t*, uint16_t, Record*))
+{
+    uint16_t Length = 0x00;
+    Record Result;
+
+    uint32_t Start = micros();
+    for(uint32_t i = 0x00; i < ITERATIONS; i++)
+    {
+        Length = Encode(Payload, sizeof(Payload), Sample);
+    }
+    uint32_t Encoding = micros() - Start;
+
+    Start = micros();
+    for(uint32_t i = 0x00; i < ITERATIONS; i++)
+    {
+        Decode(Payload, Length, &Result);
+    }
+    uint32_t Decoding = micros() - Start;
+
+    Serial.printlnf("        %s: %u bytes, encode %lu ns, decode %lu ns", Name, Length, (uint32_t)((uint64_t)Encoding * 1000ULL / ITERATIONS), (uint32_t)((uint64_t)Decoding * 1000ULL / ITERATIONS));
+}
+
+void setup()
+{
+    Serial.begin(9600);
+    Serial.println("--- MQTT CBOR benchmark ---");
+    Serial.printlnf("[INFO] %i iterations...", ITERATIONS);
+
+    Measure("JSON", EncodeJSON, DecodeJSON);
+    Measure("CBOR", EncodeCBOR, DecodeCBOR);
+
+    // Encode the record directly into a publish message
+    Serial.println("[INFO] Publish CBOR payload...");
+    Client.SetBroker(IPAddress(192, 168, 178, 52));
+    if(Client.Connect("Argon") == MQTT::NO_ERROR)
+    {
+        MQTT::Writer Writer;
+
+        if(Client.BeginPublish(&Writer, "sensor/cbor", MQTT::QOS_0) == MQTT::NO_ERROR)
+        {
+            uint16_t Length = EncodeCBOR(Writer.Buffer(), Writer.Available(), Sample);
+
+            if((Length > 0x00) && Writer.Advance(Length))
+            {
+                Client.EndPublish(&Writer, NULL, false);
+            }
+            else
+            {
+                Client.CancelPublish(&Writer);
+            }
+        }
+    }
+}
+
+void loop()
+{
+    Client.Poll();
+}
\ No newline at end of file
@@ -0,0 +1,67 @@
+/*
+ * Forward.cpp
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: MQTT example for forwarding received messages to the UART without copying them.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+#include <MQTT.h>
+
+MQTT Client;
+
+MQTTBuffer Pending;
+const char* PendingPayload;
+uint16_t PendingLength;
+
+void Callback(uint16_t TopicLength, char* Topic, uint16_t PayloadLength, char* Payload, uint16_t ID, MQTT::QoS QoS, bool DUP)
+{
+    // Only keep one message. The receive buffer stays valid until the handle is released
+    if(!Pending.isValid())
+    {
+        Pending = Client.RetainMessage();
+        PendingPayload = Payload;
+        PendingLength = PayloadLength;
+    }
+}
+
+void setup()
+{
+    Serial1.begin(115200);
+
+    Client.SetBroker(IPAddress(192, 168, 178, 52));
+    Client.SetCallback(Callback);
+
+    if(!Client.Connect("Argon"))
+    {
+        Client.Subscribe("uart", MQTT::QOS_0);
+    }
+}
+
+void loop()
+{
+    Client.Poll();
+
+    // Forward the payload directly from the receive buffer and return the buffer to the pool
+    if(Pending.isValid())
+    {
+        Serial1.write((const uint8_t*)PendingPayload, PendingLength);
+        Pending.Release();
+    }
+}
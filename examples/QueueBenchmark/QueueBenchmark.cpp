@@ -0,0 +1,149 @@
+/*
+ * QueueBenchmark.cpp
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Contention benchmark for the MQTT publish queue.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/*
+ * Host program: QueueBenchmark [Producers] [Packets]
+ */
+
+#include <MQTT.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/** @brief Largest number of producer threads.
+ */
+#define MAX_PRODUCERS               64
+
+/** @brief Default number of producer threads.
+ */
+#define PRODUCERS                   8
+
+/** @brief Default number of packets from each producer.
+ */
+#define PACKETS                     10000
+
+/** @brief Size of each packet.
+ */
+#define PACKET_SIZE                 64
+
+typedef struct
+{
+    uint16_t Length;
+    uint8_t Data[PACKET_SIZE];
+} Packet;
+
+MQTTMPSCQueue<Packet, 16> Queue;
+MQTTThread Producers[MAX_PRODUCERS];
+std::atomic<uint32_t> Retries;
+uint32_t Packets = PACKETS;
+
+void Producer(void* Parameter)
+{
+    uint8_t ID = (uint8_t)(uintptr_t)Parameter;
+
+    for(uint32_t i = 0x00; i < Packets; i++)
+    {
+        Packet* Entry;
+        while((Entry = Queue.Reserve()) == NULL)
+        {
+            Retries++;
+            MQTTThread::Yield();
+        }
+
+        // Serialize the packet in place
+        memset(Entry->Data, ID, PACKET_SIZE);
+        Entry->Length = PACKET_SIZE;
+        Queue.Commit(Entry);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t Received = 0x00;
+    uint32_t Corrupted = 0x00;
+    uint32_t Count = PRODUCERS;
+
+    if(argc > 1)
+    {
+        Count = strtoul(argv[1], NULL, 0);
+    }
+
+    if(argc > 2)
+    {
+        Packets = strtoul(argv[2], NULL, 0);
+    }
+
+    if((Count == 0x00) || (Count > MAX_PRODUCERS))
+    {
+        fprintf(stderr, "[ERROR] Use 1 to %u producers!\n", MAX_PRODUCERS);
+
+        return 1;
+    }
+
+    printf("--- MQTT queue benchmark ---\n");
+    printf("[INFO] %u producers, %u packets each...\n", Count, Packets);
+
+    uint32_t Start = micros();
+    for(uint8_t i = 0x00; i < Count; i++)
+    {
+        Producers[i].Start(Producer, (void*)(uintptr_t)i);
+    }
+
+    // Drain the queue like the I/O owner does
+    while(Received < (Count * Packets))
+    {
+        Packet* Entry = Queue.Peek();
+        if(Entry == NULL)
+        {
+            MQTTThread::Yield();
+            continue;
+        }
+
+        for(uint16_t i = 0x01; i < Entry->Length; i++)
+        {
+            if(Entry->Data[i] != Entry->Data[0])
+            {
+                Corrupted++;
+                break;
+            }
+        }
+
+        Queue.Release();
+        Received++;
+    }
+    uint32_t Duration = micros() - Start;
+
+    for(uint8_t i = 0x00; i < Count; i++)
+    {
+        Producers[i].Join();
+    }
+
+    printf("        Packets: %u\n", Received);
+    printf("        Corrupted: %u\n", Corrupted);
+    printf("        Retries (queue full): %u\n", Retries.load());
+    printf("        Duration: %u us\n", Duration);
+    printf("        Throughput: %u packets/s\n", (uint32_t)((uint64_t)Received * 1000000ULL / ((Duration > 0x00) ? Duration : 0x01)));
+
+    return (Corrupted == 0x00) ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,143 @@
+/*
+ * Replay.cpp
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Record the traffic of a connection and replay it through the parser.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/*
+ * Host program: Replay <Capture> [Iterations]
+ *
+ * The capture is recorded on a device with a library, which is built with MQTT_CAPTURE=1
+ * (i. e. EXTRA_CFLAGS="-DMQTT_CAPTURE=1 -DMQTT_RAM_BUDGET=16384"). The capture ring doesn't fit into the
+ * default RAM budget. Save the binary output of MQTT::DumpCapture as capture file.
+ */
+
+#include <MQTT.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/** @brief Default number of replays of the capture.
+ */
+#define ITERATIONS                  100
+
+MQTT Client;
+uint32_t Messages;
+
+void Callback(uint16_t TopicLength, char* Topic, uint16_t PayloadLength, char* Payload, uint16_t ID, MQTT::QoS QoS, bool DUP)
+{
+    Messages++;
+}
+
+uint8_t* Load(const char* Path, uint32_t* Length)
+{
+    uint8_t* Capture;
+    long Size;
+
+    FILE* File = fopen(Path, "rb");
+    if(File == NULL)
+    {
+        return NULL;
+    }
+
+    fseek(File, 0, SEEK_END);
+    Size = ftell(File);
+    fseek(File, 0, SEEK_SET);
+
+    Capture = (Size > 0) ? (uint8_t*)malloc(Size) : NULL;
+    if((Capture != NULL) && (fread(Capture, 0x01, Size, File) != (size_t)Size))
+    {
+        free(Capture);
+        Capture = NULL;
+    }
+    fclose(File);
+
+    *Length = (uint32_t)Size;
+
+    return Capture;
+}
+
+int main(int argc, char** argv)
+{
+    MQTT_Replay Result;
+    uint8_t* Capture;
+    uint32_t Length;
+    uint32_t Iterations = ITERATIONS;
+    uint64_t Packets = 0x00;
+    uint64_t Duration = 0x00;
+
+    if(argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <Capture> [Iterations]\n", argv[0]);
+
+        return 1;
+    }
+
+    if(argc > 2)
+    {
+        Iterations = strtoul(argv[2], NULL, 0);
+    }
+
+    if(Iterations == 0x00)
+    {
+        fprintf(stderr, "[ERROR] Use at least 1 iteration!\n");
+
+        return 1;
+    }
+
+    Capture = Load(argv[1], &Length);
+    if(Capture == NULL)
+    {
+        fprintf(stderr, "[ERROR] Can not read %s!\n", argv[1]);
+
+        return 1;
+    }
+
+    printf("--- MQTT replay ---\n");
+
+    Client.SetCallback(Callback);
+
+    Messages = 0x00;
+    for(uint32_t i = 0x00; i < Iterations; i++)
+    {
+        if(Client.Replay(Capture, Length, &Result) != MQTT::NO_ERROR)
+        {
+            fprintf(stderr, "[ERROR] Invalid capture!\n");
+            free(Capture);
+
+            return 1;
+        }
+
+        Packets += Result.Packets;
+        Duration += Result.Duration;
+    }
+
+    free(Capture);
+
+    printf("[INFO] %u bytes, %u packets and %u messages per replay, %u errors\n", (uint32_t)Result.Bytes, (uint32_t)Result.Packets, (uint32_t)Result.Messages, (uint32_t)Result.Errors);
+    printf("[INFO] %u messages dispatched in %u replays\n", Messages, Iterations);
+    if(Packets > 0x00)
+    {
+        printf("        %u ns per packet\n", (uint32_t)(Duration * 1000ULL / Packets));
+    }
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,124 @@
+/*
+ * TemplateBenchmark.cpp
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Benchmark for the MQTT publish templates.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+#include <MQTT.h>
+
+/** @brief Number of messages for each publish method.
+ */
+#define MESSAGES                    1000
+
+/** @brief Size of each payload.
+ */
+#define PAYLOAD_SIZE                16
+
+MQTT Client;
+MQTT::PublishTemplate Template;
+constexpr auto Topic = MQTT_Topic("sensor/imu/acceleration");
+uint8_t Payload[PAYLOAD_SIZE];
+
+/** @brief              Publish the messages and measure the time in the publish function.
+ *                      Only successful calls are measured. Calls, which fail fast (i. e. with #FLOW_CONTROL
+ *                      while the acknowledgements are pending), are counted as failures.
+ *  @param Generic      #true to use the generic publish function
+ *  @param Published    Pointer to the number of published messages
+ *  @return             Time in us
+ */
+uint32_t Measure(bool Generic, uint32_t* Published)
+{
+    uint32_t Duration = 0x00;
+
+    *Published = 0x00;
+    for(uint32_t i = 0x00; i < MESSAGES; i++)
+    {
+        MQTT::Error Error;
+
+        memcpy(Payload, &i, sizeof(i));
+
+        uint32_t Start = micros();
+        if(Generic)
+        {
+            Error = Client.Publish("sensor/imu/acceleration", Payload, PAYLOAD_SIZE, NULL, MQTT::QOS_1);
+        }
+        else
+        {
+            Error = Client.Publish(&Template, Payload, NULL);
+        }
+        uint32_t Stop = micros();
+
+        if(Error == MQTT::NO_ERROR)
+        {
+            Duration += Stop - Start;
+            (*Published)++;
+        }
+
+        // Transmit the queued message and process the acknowledgements outside of the measurement
+        Client.Poll();
+    }
+
+    return Duration;
+}
+
+/** @brief              Print the result of a measurement.
+ *  @param Name         Name of the publish method
+ *  @param Duration     Time in us
+ *  @param Published    Number of published messages
+ */
+void Report(const char* Name, uint32_t Duration, uint32_t Published)
+{
+    uint32_t PerMessage = (Published > 0x00) ? (uint32_t)((uint64_t)Duration * 1000ULL / Published) : 0x00;
+
+    Serial.printlnf("        %s publish: %lu us for %lu messages (%lu ns/message, %lu failed)", Name, Duration, Published, PerMessage, MESSAGES - Published);
+}
+
+void setup()
+{
+    Serial.begin(9600);
+    Serial.println("--- MQTT publish template benchmark ---");
+
+    Client.SetBroker(IPAddress(192, 168, 178, 52));
+    if(Client.Connect("Argon") || Client.PrepareTemplate(&Template, Topic, PAYLOAD_SIZE, MQTT::QOS_1, false))
+    {
+        Serial.println("[ERROR] Connection failed!");
+
+        return;
+    }
+
+    // Only the serialization into the publish queue is measured
+    Client.SetPublishQueue(true);
+
+    Serial.printlnf("[INFO] %i messages with %i bytes each...", MESSAGES, PAYLOAD_SIZE);
+
+    uint32_t Published;
+
+    uint32_t Generic = Measure(true, &Published);
+    Report("Generic", Generic, Published);
+
+    uint32_t Prepared = Measure(false, &Published);
+    Report("Template", Prepared, Published);
+}
+
+void loop()
+{
+    Client.Poll();
+}
\ No newline at end of file
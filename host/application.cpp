@@ -0,0 +1,316 @@
+/*
+ * application.cpp
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Platform shim for the host build of the MQTT client.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/application.cpp
+ *  @brief Minimal Device OS API for the host build (i. e. Linux).
+ *
+ *  @author Daniel Kampert
+ */
+
+#include <chrono>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+#include "application.h"
+
+/** @brief Start of the application.
+ */
+static const std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+
+uint32_t millis(void)
+{
+    return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - Start).count();
+}
+
+uint32_t micros(void)
+{
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - Start).count();
+}
+
+void delay(uint32_t Time)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(Time));
+}
+
+IPAddress::IPAddress(void) : IPAddress(0, 0, 0, 0)
+{
+}
+
+IPAddress::IPAddress(uint8_t Byte0, uint8_t Byte1, uint8_t Byte2, uint8_t Byte3)
+{
+    this->_mAddress[0] = Byte0;
+    this->_mAddress[1] = Byte1;
+    this->_mAddress[2] = Byte2;
+    this->_mAddress[3] = Byte3;
+}
+
+uint8_t IPAddress::operator[](uint8_t Index) const
+{
+    return this->_mAddress[Index & 0x03];
+}
+
+size_t Print::write(const uint8_t* Data, size_t Length)
+{
+    size_t Written = 0x00;
+
+    for(size_t i = 0x00; i < Length; i++)
+    {
+        Written += this->write(Data[i]);
+    }
+
+    return Written;
+}
+
+TCPClient::TCPClient(void) : _mSocket(-1)
+{
+}
+
+TCPClient::~TCPClient()
+{
+    this->stop();
+}
+
+int TCPClient::connect(IPAddress IP, uint16_t Port)
+{
+    struct sockaddr_in Address;
+    int NoDelay = 1;
+
+    this->stop();
+
+    this->_mSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if(this->_mSocket < 0)
+    {
+        return 0;
+    }
+
+    memset(&Address, 0x00, sizeof(Address));
+    Address.sin_family = AF_INET;
+    Address.sin_port = htons(Port);
+    Address.sin_addr.s_addr = htonl(((uint32_t)IP[0] << 24) | ((uint32_t)IP[1] << 16) | ((uint32_t)IP[2] << 8) | IP[3]);
+
+    // Connect blocking and use the socket without blocking afterwards, like the Device OS socket
+    if(::connect(this->_mSocket, (struct sockaddr*)&Address, sizeof(Address)) < 0)
+    {
+        this->stop();
+
+        return 0;
+    }
+
+    setsockopt(this->_mSocket, IPPROTO_TCP, TCP_NODELAY, &NoDelay, sizeof(NoDelay));
+    fcntl(this->_mSocket, F_SETFL, fcntl(this->_mSocket, F_GETFL, 0) | O_NONBLOCK);
+
+    return 1;
+}
+
+uint8_t TCPClient::connected(void)
+{
+    uint8_t Data;
+
+    if(this->_mSocket < 0)
+    {
+        return 0;
+    }
+
+    // A closed connection reads 0 bytes. Received data is still reported as connected
+    ssize_t Received = recv(this->_mSocket, &Data, sizeof(Data), MSG_PEEK | MSG_DONTWAIT);
+    if((Received == 0) || ((Received < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK)))
+    {
+        this->stop();
+
+        return 0;
+    }
+
+    return 1;
+}
+
+int TCPClient::available(void)
+{
+    int Bytes = 0;
+
+    if((this->_mSocket < 0) || (ioctl(this->_mSocket, FIONREAD, &Bytes) < 0))
+    {
+        return 0;
+    }
+
+    return Bytes;
+}
+
+int TCPClient::peek(void)
+{
+    uint8_t Data;
+
+    if((this->_mSocket < 0) || (recv(this->_mSocket, &Data, sizeof(Data), MSG_PEEK | MSG_DONTWAIT) != sizeof(Data)))
+    {
+        return -1;
+    }
+
+    return Data;
+}
+
+int TCPClient::read(void)
+{
+    uint8_t Data;
+
+    if((this->_mSocket < 0) || (recv(this->_mSocket, &Data, sizeof(Data), MSG_DONTWAIT) != sizeof(Data)))
+    {
+        return -1;
+    }
+
+    return Data;
+}
+
+int TCPClient::write(const uint8_t* Data, size_t Length)
+{
+    if(this->_mSocket < 0)
+    {
+        return -1;
+    }
+
+    ssize_t Written = send(this->_mSocket, Data, Length, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if(Written < 0)
+    {
+        return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 0 : -1;
+    }
+
+    return (int)Written;
+}
+
+void TCPClient::stop(void)
+{
+    if(this->_mSocket >= 0)
+    {
+        close(this->_mSocket);
+        this->_mSocket = -1;
+    }
+}
+
+Timer::Timer(unsigned Period, std::function<void(void)> Callback, bool OneShot) : _mCallback(Callback), _mPeriod(Period), _mOneShot(OneShot), _mActive(false), _mDisposed(false), _mGeneration(0x00)
+{
+    this->_mThread = std::thread(&Timer::_run, this);
+}
+
+Timer::~Timer()
+{
+    this->dispose();
+}
+
+bool Timer::start(void)
+{
+    std::lock_guard<std::mutex> Lock(this->_mMutex);
+
+    this->_mActive = true;
+    this->_mGeneration++;
+    this->_mCondition.notify_all();
+
+    return true;
+}
+
+bool Timer::stop(void)
+{
+    std::lock_guard<std::mutex> Lock(this->_mMutex);
+
+    this->_mActive = false;
+    this->_mGeneration++;
+    this->_mCondition.notify_all();
+
+    return true;
+}
+
+bool Timer::reset(void)
+{
+    return this->start();
+}
+
+bool Timer::changePeriod(unsigned Period)
+{
+    {
+        std::lock_guard<std::mutex> Lock(this->_mMutex);
+        this->_mPeriod = Period;
+    }
+
+    return this->start();
+}
+
+bool Timer::dispose(void)
+{
+    {
+        std::lock_guard<std::mutex> Lock(this->_mMutex);
+        this->_mActive = false;
+        this->_mDisposed = true;
+        this->_mCondition.notify_all();
+    }
+
+    if(this->_mThread.joinable())
+    {
+        this->_mThread.join();
+    }
+
+    return true;
+}
+
+bool Timer::isActive(void)
+{
+    std::lock_guard<std::mutex> Lock(this->_mMutex);
+
+    return this->_mActive;
+}
+
+void Timer::_run(void)
+{
+    std::unique_lock<std::mutex> Lock(this->_mMutex);
+
+    while(!this->_mDisposed)
+    {
+        if(!this->_mActive)
+        {
+            this->_mCondition.wait(Lock);
+
+            continue;
+        }
+
+        // A start, stop or period change restarts the wait
+        uint32_t Generation = this->_mGeneration;
+        if(this->_mCondition.wait_for(Lock, std::chrono::milliseconds(this->_mPeriod), [this, Generation] { return this->_mDisposed || (this->_mGeneration != Generation); }))
+        {
+            continue;
+        }
+
+        if(this->_mOneShot)
+        {
+            this->_mActive = false;
+        }
+
+        // The callback may use the timer, so it runs without the lock
+        Lock.unlock();
+        this->_mCallback();
+        Lock.lock();
+    }
+}
\ No newline at end of file
@@ -0,0 +1,277 @@
+/*
+ * application.h
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Platform shim for the host build of the MQTT client.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/application.h
+ *  @brief Minimal Device OS API for the host build (i. e. Linux). Only the functions and classes, which are used
+ *         by the MQTT client, are provided. The TCP client uses a non-blocking BSD socket and each timer uses
+ *         its own std::thread.
+ *
+ *  @author Daniel Kampert
+ */
+
+#ifndef APPLICATION_H_
+#define APPLICATION_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#if defined(PARTICLE)
+    #error "The platform shim is only used by the host build!"
+#endif
+
+/** @brief  Get the time since the start of the application.
+ *  @return Time in ms
+ */
+uint32_t millis(void);
+
+/** @brief  Get the time since the start of the application.
+ *  @return Time in us
+ */
+uint32_t micros(void);
+
+/** @brief      Suspend the calling thread.
+ *  @param Time Time in ms
+ */
+void delay(uint32_t Time);
+
+/** @brief IPv4 address.
+ */
+class IPAddress
+{
+    public:
+        /** @brief Constructor. Creates the address 0.0.0.0.
+         */
+        IPAddress(void);
+
+        /** @brief Constructor.
+         */
+        IPAddress(uint8_t Byte0, uint8_t Byte1, uint8_t Byte2, uint8_t Byte3);
+
+        /** @brief          Get a byte of the address.
+         *  @param Index    Index of the byte
+         *  @return         Byte
+         */
+        uint8_t operator[](uint8_t Index) const;
+
+    private:
+        uint8_t _mAddress[4];
+};
+
+/** @brief Dynamic string.
+ */
+class String
+{
+    public:
+        /** @brief Constructor. Creates an empty string.
+         */
+        String(void)
+        {
+        }
+
+        /** @brief      Constructor.
+         *  @param Data Null-terminated string
+         */
+        String(const char* Data) : _mData((Data != NULL) ? Data : "")
+        {
+        }
+
+        /** @brief  Get the null-terminated string.
+         *  @return Pointer to the string
+         */
+        const char* c_str(void) const
+        {
+            return this->_mData.c_str();
+        }
+
+        /** @brief  Get the length of the string.
+         *  @return Length in bytes
+         */
+        unsigned int length(void) const
+        {
+            return this->_mData.length();
+        }
+
+    private:
+        std::string _mData;
+};
+
+/** @brief Byte output.
+ */
+class Print
+{
+    public:
+        virtual ~Print()
+        {
+        }
+
+        /** @brief      Write a single byte.
+         *  @param Data Byte
+         *  @return     Number of written bytes
+         */
+        virtual size_t write(uint8_t Data) = 0;
+
+        /** @brief          Write data.
+         *  @param Data     Data
+         *  @param Length   Length of the data
+         *  @return         Number of written bytes
+         */
+        virtual size_t write(const uint8_t* Data, size_t Length);
+};
+
+/** @brief TCP client with the interface of the Device OS TCP client.
+ */
+class TCPClient
+{
+    public:
+        /** @brief Constructor.
+         */
+        TCPClient(void);
+
+        /** @brief Deconstructor. Closes the connection.
+         */
+        ~TCPClient();
+
+        /** @brief      Open a connection.
+         *  @param IP   IP address of the server
+         *  @param Port Port of the server
+         *  @return     1 when successful
+         */
+        int connect(IPAddress IP, uint16_t Port);
+
+        /** @brief  Check if the connection is open or if received data is left.
+         *  @return 1 when connected
+         */
+        uint8_t connected(void);
+
+        /** @brief  Get the number of received bytes.
+         *  @return Number of bytes
+         */
+        int available(void);
+
+        /** @brief  Get the next received byte without removing it.
+         *  @return Byte or -1 when no byte is available
+         */
+        int peek(void);
+
+        /** @brief  Read the next received byte.
+         *  @return Byte or -1 when no byte is available
+         */
+        int read(void);
+
+        /** @brief          Write data. The socket takes as many bytes as fit into its buffer.
+         *  @param Data     Data
+         *  @param Length   Length of the data
+         *  @return         Number of written bytes or -1 when the connection is broken
+         */
+        int write(const uint8_t* Data, size_t Length);
+
+        /** @brief Close the connection.
+         */
+        void stop(void);
+
+    private:
+        int _mSocket;
+};
+
+/** @brief Software timer with the interface of the Device OS timer. The callback runs on the timer thread.
+ */
+class Timer
+{
+    public:
+        /** @brief              Constructor.
+         *  @param Period       Period in ms
+         *  @param Handler      Member function, which is called when the timer expires
+         *  @param Instance     Object for the member function
+         *  @param OneShot      #true when the timer expires only once
+         */
+        template<typename T>
+        Timer(unsigned Period, void (T::*Handler)(void), T& Instance, bool OneShot = false) : Timer(Period, std::bind(Handler, &Instance), OneShot)
+        {
+        }
+
+        /** @brief              Constructor.
+         *  @param Period       Period in ms
+         *  @param Callback     Function, which is called when the timer expires
+         *  @param OneShot      #true when the timer expires only once
+         */
+        Timer(unsigned Period, std::function<void(void)> Callback, bool OneShot = false);
+
+        /** @brief Deconstructor. Stops the timer thread.
+         */
+        ~Timer();
+
+        /** @brief  Start or restart the timer.
+         *  @return #true when successful
+         */
+        bool start(void);
+
+        /** @brief  Stop the timer.
+         *  @return #true when successful
+         */
+        bool stop(void);
+
+        /** @brief  Restart the timer.
+         *  @return #true when successful
+         */
+        bool reset(void);
+
+        /** @brief          Change the period and start the timer.
+         *  @param Period   Period in ms
+         *  @return         #true when successful
+         */
+        bool changePeriod(unsigned Period);
+
+        /** @brief  Stop the timer and the timer thread.
+         *  @return #true when successful
+         */
+        bool dispose(void);
+
+        /** @brief  Check if the timer is running.
+         *  @return #true when running
+         */
+        bool isActive(void);
+
+    private:
+        void _run(void);
+
+        std::function<void(void)> _mCallback;
+        std::mutex _mMutex;
+        std::condition_variable _mCondition;
+        std::thread _mThread;
+        unsigned _mPeriod;
+        bool _mOneShot;
+        bool _mActive;
+        bool _mDisposed;
+        uint32_t _mGeneration;
+};
+
+#endif
\ No newline at end of file
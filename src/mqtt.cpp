@@ -30,13 +30,213 @@
 
 #include "MQTT.h"
 
-/** @brief Constant for MQTT version 3.1.1.
- */
-#define MQTT_VERSION_3_1_1                      0x04
+// Catch footprint regressions at build time. The I/O thread needs the outbound queue
+static_assert((MQTT_RAM_BUDGET == 0) || ((sizeof(MQTT) + sizeof(Timer) + ((MQTT_OUTBOUND_QUEUE_SIZE > 0) ? MQTT_THREAD_STACK_SIZE : 0)) <= MQTT_RAM_BUDGET), "The MQTT client exceeds MQTT_RAM_BUDGET!");
 
-/** @brief Constant for MQTT version 3.1.
- */
-#define MQTT_VERSION_3_1                        0x03
+void MQTT::metrics(MQTT_Metrics* Metrics) const
+{
+    if(Metrics == NULL)
+    {
+        return;
+    }
+
+    this->_mMetrics.Snapshot(Metrics);
+    Metrics->OutboundDepth = this->_mOutbound.Count();
+    Metrics->BulkDepth = this->_mBulk.Count();
+    Metrics->ControlDepth = this->_mControl.Count();
+    Metrics->InboundDepth = this->_mInbound.Count();
+}
+
+void MQTT::ResetMetrics(void)
+{
+    this->_mMetrics.Reset();
+    this->_mLatency.Reset();
+    this->_mProfile.Reset();
+}
+
+void MQTT::profile(MQTT_Profile_Call Call, MQTT_Latency* Profile) const
+{
+    if((Profile == NULL) || (Call >= MQTT_PROFILE_CALLS))
+    {
+        return;
+    }
+
+    this->_mProfile.Summary(Call, Profile);
+}
+
+void MQTT::footprint(MQTT_Footprint* Footprint) const
+{
+    if(Footprint == NULL)
+    {
+        return;
+    }
+
+    Footprint->Total = sizeof(MQTT);
+    Footprint->Buffers = sizeof(this->_mBuffer) + sizeof(this->_mUnsent);
+    Footprint->Pool = sizeof(this->_mPool);
+    Footprint->Inbound = sizeof(this->_mInbound) + sizeof(this->_mInboundAliases);
+    Footprint->Outbound = sizeof(this->_mOutbound) + sizeof(this->_mBulk) + sizeof(this->_mControl);
+    Footprint->Conflation = sizeof(this->_mConflation);
+    Footprint->Diagnostics = sizeof(this->_mMetrics) + sizeof(this->_mLatency) + sizeof(this->_mProfile) + sizeof(this->_mCapture);
+    Footprint->Heap = this->_mHeapBytes;
+    Footprint->Stack = this->_mProfile.Stack();
+    Footprint->Thread = this->_mThreadRunning ? MQTT_THREAD_STACK_SIZE : 0x00;
+}
+
+void MQTT::DumpCapture(Print& Output)
+{
+    this->_mCapture.Dump(Output, this->_mVersion);
+}
+
+void MQTT::ClearCapture(void)
+{
+    this->_mCapture.Clear();
+}
+
+MQTT::Error MQTT::Replay(const uint8_t* Capture, uint32_t Length, MQTT_Replay* Result)
+{
+    MQTT_Capture_Record Record;
+    MQTTCaptureReader Reader(Capture, Length);
+
+    if((Result == NULL) || !Reader.isValid())
+    {
+        return INVALID_PARAMETER;
+    }
+
+    // The acknowledgements of the replayed messages must not reach the broker
+    if(this->isConnected() || this->_mThreadRunning)
+    {
+        return CONNECTION_IN_USE;
+    }
+
+    // The replay uses the state of a new connection. The state of the client is restored afterwards
+    uint8_t Version = this->_mVersion;
+    uint8_t ReasonCode = this->_mReasonCode;
+    uint16_t InFlight = this->_mInFlight;
+    uint16_t InFlightIDs[MQTT_INFLIGHT_SIZE];
+    bool WaitForHostPing = this->_mWaitForHostPing;
+
+    for(uint8_t i = 0x00; i < MQTT_INFLIGHT_SIZE; i++)
+    {
+        InFlightIDs[i] = this->_mInFlightIDs[i];
+    }
+
+    memset(Result, 0x00, sizeof(MQTT_Replay));
+    this->_mVersion = Reader.Version();
+    this->_mInboundAliases.Reset();
+    this->_mLatency.Cancel();
+
+    uint32_t Start = micros();
+    while(Reader.Next(&Record))
+    {
+        uint16_t FixedHeaderSize = 0x01;
+
+        if(Record.Direction != MQTT_CAPTURE_INBOUND)
+        {
+            continue;
+        }
+
+        Result->Packets++;
+        Result->Bytes += Record.Length;
+
+        if((Record.Length < 0x02) || (Record.Length > MQTT_BUFFER_SIZE))
+        {
+            Result->Errors++;
+
+            continue;
+        }
+
+        // Use a buffer from the pool like the reception from the socket
+        MQTTBuffer Handle = this->_mPool.Allocate();
+        uint8_t* Buffer = Handle.isValid() ? Handle.Data() : this->_mBuffer;
+
+        memcpy(Buffer, Record.Data, Record.Length);
+        while((FixedHeaderSize < Record.Length) && (Buffer[FixedHeaderSize++] & 0x80));
+
+        if((Buffer[0] >> 0x04) == PUBLISH)
+        {
+            Result->Messages++;
+        }
+        // The connection acknowledgement was processed by #Connect when the capture was recorded
+        else if((Buffer[0] >> 0x04) == CONNACK)
+        {
+            continue;
+        }
+
+        // The acknowledgements fail without a connection
+        MQTT::Error Error = this->_processMessage(Handle, Buffer, FixedHeaderSize, Record.Length);
+        if((Error != NO_ERROR) && (Error != NOT_CONNECTED))
+        {
+            Result->Errors++;
+        }
+    }
+    Result->Duration = micros() - Start;
+
+    // Remove the aliases of the capture. The next connection starts with an empty table anyway
+    this->_mVersion = Version;
+    this->_mReasonCode = ReasonCode;
+    this->_mInFlight = InFlight;
+    for(uint8_t i = 0x00; i < MQTT_INFLIGHT_SIZE; i++)
+    {
+        this->_mInFlightIDs[i] = InFlightIDs[i];
+    }
+    this->_mWaitForHostPing = WaitForHostPing;
+    this->_mInboundAliases.Reset();
+    this->_mLatency.Cancel();
+
+    return NO_ERROR;
+}
+
+void MQTT::latency(MQTT_Latency_Type Type, MQTT_Latency* Latency)
+{
+    if((Latency == NULL) || (Type >= MQTT_LATENCY_TYPES))
+    {
+        return;
+    }
+
+    this->_mLatency.Summary(Type, Latency);
+}
+
+MQTT::Error MQTT::PublishDiagnostics(const char* Topic)
+{
+    MQTT_Latency Latency[MQTT_LATENCY_TYPES];
+
+    if(Topic == NULL)
+    {
+        return INVALID_PARAMETER;
+    }
+
+    for(uint8_t i = 0x00; i < MQTT_LATENCY_TYPES; i++)
+    {
+        this->_mLatency.Summary((MQTT_Latency_Type)i, &Latency[i]);
+    }
+
+    return this->Publishf(Topic, "{\"publish\":{\"n\":%lu,\"p50\":%lu,\"p99\":%lu,\"max\":%lu},"
+                                 "\"subscribe\":{\"n\":%lu,\"p50\":%lu,\"p99\":%lu,\"max\":%lu},"
+                                 "\"ping\":{\"n\":%lu,\"p50\":%lu,\"p99\":%lu,\"max\":%lu}}",
+                          (unsigned long)Latency[MQTT_LATENCY_PUBLISH].Count, (unsigned long)Latency[MQTT_LATENCY_PUBLISH].P50, (unsigned long)Latency[MQTT_LATENCY_PUBLISH].P99, (unsigned long)Latency[MQTT_LATENCY_PUBLISH].Max,
+                          (unsigned long)Latency[MQTT_LATENCY_SUBSCRIBE].Count, (unsigned long)Latency[MQTT_LATENCY_SUBSCRIBE].P50, (unsigned long)Latency[MQTT_LATENCY_SUBSCRIBE].P99, (unsigned long)Latency[MQTT_LATENCY_SUBSCRIBE].Max,
+                          (unsigned long)Latency[MQTT_LATENCY_PING].Count, (unsigned long)Latency[MQTT_LATENCY_PING].P50, (unsigned long)Latency[MQTT_LATENCY_PING].P99, (unsigned long)Latency[MQTT_LATENCY_PING].Max);
+}
+
+MQTT::Error MQTT::SetDiagnostics(const char* Topic, uint32_t Interval)
+{
+    if((Topic == NULL) && (Interval > 0x00))
+    {
+        return INVALID_PARAMETER;
+    }
+
+    this->_mDiagnosticsTopic = Topic;
+    this->_mLastDiagnostics = millis();
+    this->_mDiagnosticsInterval = Interval;
+
+    return NO_ERROR;
+}
+
+bool MQTT::isWritable(void) const
+{
+    return (this->_mUnsentLength == 0x00);
+}
 
 bool MQTT::isConnected(void)
 {
@@ -48,24 +248,39 @@ MQTT::ConnectionState MQTT::connectionState(void) const
     return this->_mConnectionState;
 }
 
+uint8_t MQTT::protocolVersion(void) const
+{
+    return this->_mVersion;
+}
+
+uint8_t MQTT::reasonCode(void) const
+{
+    return this->_mReasonCode;
+}
+
+const MQTT::Statistics& MQTT::statistics(void) const
+{
+    return this->_mStatistics;
+}
+
 MQTT::MQTT(void)
 {
-    this->_init(IPAddress(0, 0, 0, 0), 0, MQTT_DEFAULT_KEEPALIVE, NULL);
+    this->_init(IPAddress(0, 0, 0, 0), 0, MQTT_DEFAULT_KEEPALIVE, Publish_Delegate());
 }
 
 MQTT::MQTT(IPAddress IP)
 {
-    this->_init(IP, MQTT_DEFAULT_PORT, MQTT_DEFAULT_KEEPALIVE, NULL);
+    this->_init(IP, MQTT_DEFAULT_PORT, MQTT_DEFAULT_KEEPALIVE, Publish_Delegate());
 }
 
 MQTT::MQTT(IPAddress IP, uint16_t Port)
 {
-    this->_init(IP, Port, MQTT_DEFAULT_KEEPALIVE, NULL);
+    this->_init(IP, Port, MQTT_DEFAULT_KEEPALIVE, Publish_Delegate());
 }
 
 MQTT::MQTT(IPAddress IP, uint16_t Port, uint16_t KeepAlive)
 {
-    this->_init(IP, Port, KeepAlive, NULL);
+    this->_init(IP, Port, KeepAlive, Publish_Delegate());
 }
 
 MQTT::MQTT(IPAddress IP, uint16_t Port, uint16_t KeepAlive, Publish_Callback Callback)
@@ -75,16 +290,18 @@ MQTT::MQTT(IPAddress IP, uint16_t Port, uint16_t KeepAlive, Publish_Callback Cal
 
 MQTT::~MQTT()
 {
-    if(this->_mPingTimer != NULL)
-    {
-        this->_mPingTimer->dispose();
-        delete this->_mPingTimer;
-    }
+    this->StopThread();
 
     if(this->isConnected())
     {
         this->Disonnect();
     }
+
+    if(this->_mPingTimer != NULL)
+    {
+        this->_mPingTimer->dispose();
+        delete this->_mPingTimer;
+    }
 }
 
 MQTT::Error MQTT::Connect(const char* ClientID)
@@ -103,35 +320,78 @@ MQTT::Error MQTT::Connect(const char* ClientID, bool CleanSession, MQTT::Will* W
 }
 
 MQTT::Error MQTT::Connect(const char* ClientID, bool CleanSession, MQTT::Will* Will, MQTT::User* User)
+{
+    MQTT::CallScope Profile(this, MQTT_PROFILE_CONNECT);
+    MQTT::Error Error = this->_connect(ClientID, CleanSession, Will, User, this->_mProtocolVersion);
+
+    // Fall back to MQTT 3.1.1 when the broker doesn't support MQTT 5
+    if((Error == HOST_UNREACHABLE) && (this->_mProtocolVersion == MQTT_VERSION_5) && (this->_mConnectionState == UNACCEPTABLE_PROCOTOL))
+    {
+        this->_mClient.stop();
+
+        Error = this->_connect(ClientID, CleanSession, Will, User, MQTT_VERSION_3_1_1);
+    }
+
+    return Error;
+}
+
+MQTT::Error MQTT::_connect(const char* ClientID, bool CleanSession, MQTT::Will* Will, MQTT::User* User, uint8_t Version)
 {
     uint16_t Length = MQTT_FIXED_HEADER_SIZE;
 
-    if(ClientID == NULL)
+    // The will and the authentication are rejected when they are removed by the feature selection
+    if((ClientID == NULL) || ((Will != NULL) && !MQTTFeatures::Will) || ((User != NULL) && !MQTTFeatures::Authentication))
     {
         return INVALID_PARAMETER;
     }
 
     if(!this->isConnected())
     {
-        if(_mClient.connect(this->_mIP, this->_mPort))
+        bool Connected;
+
+        // The I/O thread must not use the connection during the handshake
+        this->_stopThread();
+
+        {
+            MQTT::PhaseScope Phase(this, MQTT_PHASE_SOCKET_CONNECT);
+            Connected = _mClient.connect(this->_mIP, this->_mPort);
+        }
+
+        if(Connected)
         {
             uint8_t Flags = 0x00;
 
             this->_mCurrentMessageID = 0x01;
+            this->_mVersion = Version;
+            this->_resetInFlight();
+            this->_mWaitForHostPing = false;
+            this->_mPingDue = false;
+            this->_mUnsentLength = 0x00;
+            this->_mUnsentOffset = 0x00;
+            this->_mServerReceiveMaximum = 0xFFFF;
+            this->_mServerMaximumPacketSize = 0xFFFFFFFF;
+            this->_mTopicAliases.Reset(0x00);
+            this->_mInboundAliases.Reset();
 
             // Set the protocol name and the protocol level
-            #if(MQTT_VERSION == MQTT_VERSION_3_1)
-                const uint8_t Header[] = {0x00, 0x06, 'M', 'Q', 'I', 's', 'd', 'p', MQTT_VERSION};
-            #elif(MQTT_VERSION == MQTT_VERSION_3_1_1)
-                const uint8_t Header[] = {0x00, 0x04, 'M', 'Q', 'T', 'T', MQTT_VERSION};
-            #endif
+            if(Version == MQTT_VERSION_3_1)
+            {
+                const uint8_t Header[] = {0x00, 0x06, 'M', 'Q', 'I', 's', 'd', 'p', MQTT_VERSION_3_1};
+
+                memcpy(this->_mBuffer + MQTT_FIXED_HEADER_SIZE, Header, sizeof(Header));
+                Length += sizeof(Header);
+            }
+            else
+            {
+                const uint8_t Header[] = {0x00, 0x04, 'M', 'Q', 'T', 'T', Version};
 
-            memcpy(this->_mBuffer + MQTT_FIXED_HEADER_SIZE, Header, sizeof(Header));
-            Length += sizeof(Header);
+                memcpy(this->_mBuffer + MQTT_FIXED_HEADER_SIZE, Header, sizeof(Header));
+                Length += sizeof(Header);
+            }
 
             Flags |= CleanSession << 0x01;
 
-            if(Will)
+            if(MQTTFeatures::Will && Will)
             {
                 if(!(Will->Message) || (!(Will->Topic)))
                 {
@@ -141,7 +401,7 @@ MQTT::Error MQTT::Connect(const char* ClientID, bool CleanSession, MQTT::Will* W
                 Flags |= (((uint8_t)Will->Retain) << 0x05) | (((uint8_t)Will->QoS) << 0x03) | (0x01 << 0x02);
             }
 
-            if(User)
+            if(MQTTFeatures::Authentication && User)
             {
                 if(!(User->Name))
                 {
@@ -163,48 +423,77 @@ MQTT::Error MQTT::Connect(const char* ClientID, bool CleanSession, MQTT::Will* W
             this->_mBuffer[Length++] = (this->_mKeepAlive >> 0x08);
             this->_mBuffer[Length++] = (this->_mKeepAlive & 0xFF);
 
+            // Set the properties for the flow control
+            if(Version == MQTT_VERSION_5)
+            {
+                MQTTPropertyWriter Properties(this->_mBuffer + Length, MQTT_BUFFER_SIZE - Length);
+
+                Properties.AddShort(MQTT_PROPERTY_RECEIVE_MAXIMUM, MQTT_QUEUE_SIZE);
+                Properties.AddInteger(MQTT_PROPERTY_MAXIMUM_PACKET_SIZE, MQTT_BUFFER_SIZE);
+                Properties.AddShort(MQTT_PROPERTY_TOPIC_ALIAS_MAXIMUM, MQTTFeatures::Inbound ? MQTT_TOPIC_ALIAS_SIZE : 0x00);
+                Length += Properties.Finish();
+            }
+
             // Set the client ID
-            this->_copyString(ClientID, &Length);
+            bool Fits = this->_copyString(this->_mBuffer, ClientID, &Length);
 
             // Set the will configuration
-            if(Will)
+            if(MQTTFeatures::Will && Will)
             {
-                this->_copyString(Will->Topic, &Length);
-                this->_copyString(Will->Message, &Length);
+                // No will properties are used yet
+                if(Version == MQTT_VERSION_5)
+                {
+                    if(Fits && (Length < MQTT_BUFFER_SIZE))
+                    {
+                        this->_mBuffer[Length++] = 0x00;
+                    }
+                    else
+                    {
+                        Fits = false;
+                    }
+                }
+
+                Fits = Fits && this->_copyString(this->_mBuffer, Will->Topic, &Length) && this->_copyString(this->_mBuffer, Will->Message, &Length);
             }
 
             // Set the user configuration
-            if(User)
+            if(MQTTFeatures::Authentication && User)
             {
-                this->_copyString(User->Name, &Length);
+                Fits = Fits && this->_copyString(this->_mBuffer, User->Name, &Length);
 
                 if(User->Password)
                 {
-                    this->_mBuffer[Length++] = (User->PasswordLength >> 0x08);
-                    this->_mBuffer[Length++] = (User->PasswordLength & 0xFF);
+                    Fits = Fits && this->_copyString(this->_mBuffer, (const char*)User->Password, User->PasswordLength, &Length);
+                }
+            }
 
-                    if((Length + User->PasswordLength) > MQTT_BUFFER_SIZE)
-                    {
-                        return BUFFER_OVERFLOW;
-                    }
+            // The connect message doesn't fit into the buffer
+            if(!Fits)
+            {
+                this->_mClient.stop();
 
-                    for(uint16_t i = 0x00; i < User->PasswordLength; i++)
-                    {
-                        this->_mBuffer[Length++] = User->Password[i];
-                    }
-                }
+                return BUFFER_OVERFLOW;
             }
 
             // Transmit the buffer
-            if(this->_writeMessage(CONNECT, 0x00, Length - MQTT_FIXED_HEADER_SIZE))
+            if(this->_writeMessage(this->_mBuffer, NULL, CONNECT, 0x00, Length - MQTT_FIXED_HEADER_SIZE))
             {
                 return TRANSMISSION_ERROR;
             }
 
             // Wait for the broker
+            MQTT::PhaseScope Phase(this, MQTT_PHASE_CONNACK_WAIT);
             uint32_t TimeLastAction = millis();
             while(!_mClient.available())
             {
+                // Continue a short write of the connect message
+                if(this->_flush() == TRANSMISSION_ERROR)
+                {
+                    this->_mClient.stop();
+
+                    return TRANSMISSION_ERROR;
+                }
+
                 if((millis() - TimeLastAction) > (this->_mKeepAlive * 1000UL))
                 {
                     this->_mClient.stop();
@@ -213,19 +502,44 @@ MQTT::Error MQTT::Connect(const char* ClientID, bool CleanSession, MQTT::Will* W
                 }
             }
 
-            // Get the answer
+            // Get the answer. The fixed header of a MQTT 5 acknowledgement with many properties is longer than two bytes
             uint16_t Temp;
-            if((this->_readMessage(&Length, &Temp)) || (this->_mBuffer[0] != (CONNACK << 0x04)))
+            if((this->_readMessage(this->_mBuffer, &Length, &Temp)) || (this->_mBuffer[0] != (CONNACK << 0x04)))
+            {
+                return TRANSMISSION_ERROR;
+            }
+
+            // The acknowledgement starts with the Session Present flag and the reason code
+            if(Temp < (Length + 0x02))
             {
+                this->_mClient.stop();
+
                 return TRANSMISSION_ERROR;
             }
 
             // Save the connection state
-            this->_mConnectionState = (MQTT::ConnectionState)this->_mBuffer[3];
+            this->_mReasonCode = this->_mBuffer[Length + 0x01];
+            if(Version == MQTT_VERSION_5)
+            {
+                this->_mConnectionState = this->_processConnectionAcknowledge(Length, Temp);
+            }
+            else
+            {
+                this->_mConnectionState = (MQTT::ConnectionState)this->_mReasonCode;
+            }
+            MQTTTrace::Emit(MQTT_TRACE_CONNECT, this->_mConnectionState, 0x00);
 
             // ToDo: Add more detailed error message
             if(this->_mConnectionState == ACCEPTED)
             {
+                this->_mMetrics.Connect();
+
+                // Restart the I/O thread after a reconnect. The thread handles the keep-alive by itself
+                if(this->_mThreadMode)
+                {
+                    return this->StartThread();
+                }
+
                 this->_mPingTimer->start();
 
                 return NO_ERROR;
@@ -242,13 +556,89 @@ MQTT::Error MQTT::Connect(const char* ClientID, bool CleanSession, MQTT::Will* W
     }
 }
 
+MQTT::ConnectionState MQTT::_processConnectionAcknowledge(uint16_t FixedHeaderSize, uint16_t Bytes)
+{
+    MQTT_Property Property;
+    uint16_t Offset = FixedHeaderSize + 0x02;
+    MQTTPropertyReader Reader(this->_mBuffer + Offset, (Bytes > Offset) ? (Bytes - Offset) : 0x00);
+
+    // Get the limits of the broker
+    while(Reader.Next(&Property))
+    {
+        switch(Property.ID)
+        {
+            case(MQTT_PROPERTY_RECEIVE_MAXIMUM):
+            {
+                this->_mServerReceiveMaximum = Property.Value;
+
+                break;
+            }
+            case(MQTT_PROPERTY_MAXIMUM_PACKET_SIZE):
+            {
+                this->_mServerMaximumPacketSize = Property.Value;
+
+                break;
+            }
+            case(MQTT_PROPERTY_TOPIC_ALIAS_MAXIMUM):
+            {
+                this->_mTopicAliases.Reset(Property.Value);
+
+                break;
+            }
+            case(MQTT_PROPERTY_SERVER_KEEP_ALIVE):
+            {
+                this->_mKeepAlive = Property.Value;
+                this->_mPingTimer->changePeriod(this->_mKeepAlive * 1000UL);
+                this->_mPingTimer->stop();
+
+                break;
+            }
+        }
+    }
+
+    // Map the reason code to the connection states of MQTT 3.1.1
+    switch(this->_mReasonCode)
+    {
+        case(REASON_SUCCESS):
+        {
+            return ACCEPTED;
+        }
+        case(UNACCEPTABLE_PROCOTOL):
+        case(REASON_UNSUPPORTED_PROTOCOL):
+        {
+            return UNACCEPTABLE_PROCOTOL;
+        }
+        case(REASON_CLIENT_ID_INVALID):
+        {
+            return ID_REJECT;
+        }
+        case(REASON_BAD_USER_PASSWORD):
+        {
+            return BAD_USER_PASSWORD;
+        }
+        case(REASON_NOT_AUTHORIZED):
+        {
+            return NOT_AUTHORIZED;
+        }
+    }
+
+    return SERVER_UNAVAILALE;
+}
+
 void MQTT::Disonnect(void)
 {
+    this->StopThread();
+
+    // The disconnect message is skipped when the socket doesn't take more data
     this->_mBuffer[0] = (DISCONNECT << 0x04);
     this->_mBuffer[1] = 0x00;
-    _mClient.write(this->_mBuffer, 0x02);
+    if(this->_flush() == NO_ERROR)
+    {
+        this->_write(this->_mBuffer, 0x02);
+    }
     this->_mClient.stop();
     this->_mPingTimer->stop();
+    MQTTTrace::Emit(MQTT_TRACE_DISCONNECT, 0x00, 0x00);
 }
 
 void MQTT::SetBroker(IPAddress IP)
@@ -267,114 +657,251 @@ void MQTT::SetKeepAlive(uint16_t KeepAlive)
     this->_mKeepAlive = KeepAlive;
 }
 
+void MQTT::SetProtocolVersion(uint8_t Version)
+{
+    this->_mProtocolVersion = Version;
+}
+
 void MQTT::SetCallback(Publish_Callback Callback)
 {
     this->_mCallback = Callback;
 }
 
-MQTT::Error MQTT::Poll(void)
+void MQTT::SetCallback(const Publish_Delegate& Callback)
 {
-    if(!this->isConnected())
-    {
-        return NOT_CONNECTED;
-    }
+    this->_mCallback = Callback;
+}
 
-    // Process the answer from the host
-    if(this->_mClient.available())
-    {
-        uint16_t FixedHeaderSize;
-        uint16_t ReceivedBytes;
+void MQTT::SetDrainCallback(const Drain_Delegate& Callback)
+{
+    this->_mDrainCallback = Callback;
+}
 
-        if(this->_readMessage(&FixedHeaderSize, &ReceivedBytes))
-        {
-            return TRANSMISSION_ERROR;
-        }
+void MQTT::SetStallCallback(uint32_t Threshold, const Stall_Delegate& Callback)
+{
+    this->_mStallThreshold = Threshold;
+    this->_mStallCallback = Callback;
+}
 
-        if(FixedHeaderSize)
-        {
-            ControlPacket Type = (MQTT::ControlPacket)(_mBuffer[0] >> 0x04);
-            MQTT::QoS QoS = (MQTT::QoS)((_mBuffer[0] >> 0x01) & 0x03);
-            bool DUP = (bool)((_mBuffer[0] >> 0x03) & 0x01);
+void MQTT::SetPublishQueue(bool Enable)
+{
+    this->_mQueued = Enable && (MQTT_OUTBOUND_QUEUE_SIZE > 0x00);
+}
 
-            switch(Type)
-            {
-                case(PUBLISH):
-                {
-                    MQTT::Error Error = NO_ERROR;
-                    uint16_t MessageID = 0x00;
-                    uint16_t MessageIDLength = 0x00;
-                    uint16_t TopicLength = (this->_mBuffer[FixedHeaderSize] << 0x08) | this->_mBuffer[FixedHeaderSize + 0x01];
-                    uint16_t PayloadLength = ReceivedBytes - FixedHeaderSize - TopicLength - sizeof(TopicLength);
+void MQTT::SetReceiveQueue(bool Enable)
+{
+    this->_mReceiveQueued = Enable;
+}
 
-                    // QoS 1 needs a PUBACK as response
-                    if(QoS == MQTT::QOS_1)
-                    {
+void MQTT::SetCompression(bool Enable)
+{
+    this->_mCompression = Enable;
+}
 
-                        PayloadLength -= 0x02;
-                        MessageID = (this->_mBuffer[FixedHeaderSize + TopicLength + 0x02] << 0x08) | this->_mBuffer[FixedHeaderSize + TopicLength + 0x03];
-                        MessageIDLength = sizeof(MessageID);
+MQTT::Error MQTT::Conflate(const char* Topic)
+{
+    size_t TopicLength;
 
-                        Error = this->_publishAcknowledge(MessageID);
-                    }
-                    // QoS 2 needs a PUBREC as response
-                    else if(QoS == MQTT::QOS_2)
-                    {
+    if((Topic == NULL) || ((TopicLength = strlen(Topic)) > MQTT_CONFLATION_TOPIC_LENGTH))
+    {
+        return INVALID_PARAMETER;
+    }
 
-                        PayloadLength -= 0x02;
-                        MessageID = (this->_mBuffer[FixedHeaderSize + TopicLength + 0x02] << 0x08) | this->_mBuffer[FixedHeaderSize + TopicLength + 0x03];
-                        MessageIDLength = sizeof(MessageID);
+    if(!this->_mConflation.Add(Topic, TopicLength))
+    {
+        return BUFFER_OVERFLOW;
+    }
 
-                        Error = this->_publishReceived(MessageID);
-                    }
+    return NO_ERROR;
+}
 
-                    this->_mCallback(TopicLength, (char*)(&this->_mBuffer[FixedHeaderSize + sizeof(TopicLength)]), PayloadLength, (char*)(&this->_mBuffer[FixedHeaderSize + sizeof(TopicLength) + TopicLength + MessageIDLength]), MessageID, QoS, DUP);
+MQTT::Error MQTT::Filter(const char* Topic, uint32_t Heartbeat)
+{
+    size_t TopicLength;
 
-                    return Error;
-                }
-                case(PUBREC):
-                {
-                    return this->_publishRelease((this->_mBuffer[2] << 0x08) + this->_mBuffer[3]);
-                }
-                case(PUBREL):
-                {
-                    return this->_publishComplete((this->_mBuffer[2] << 0x08) + this->_mBuffer[3]);
-                }
-                case(PUBCOMP):
-                {
-                    break;
-                }
-                case(SUBACK):
-                {
-                    // Add additonal code if needed
-                    break;
-                }
-                case(UNSUBACK):
-                {
-                    // Add additonal code if needed
-                    break;
-                }
-                case(PINGREQ):
-                {
-                    // Add additonal code if needed
-                    break;
-                }
-                case(PINGRESP):
-                {
-                    this->_mWaitForHostPing = false;
+    if((Topic == NULL) || ((TopicLength = strlen(Topic)) > MQTT_FILTER_TOPIC_LENGTH))
+    {
+        return INVALID_PARAMETER;
+    }
 
-                    break;
-                }
-            }
-        }
+    if(!this->_mFilter.Add(Topic, TopicLength, false, 0.0f, Heartbeat))
+    {
+        return BUFFER_OVERFLOW;
+    }
+
+    return NO_ERROR;
+}
+
+MQTT::Error MQTT::Filter(const char* Topic, float Deadband, uint32_t Heartbeat)
+{
+    size_t TopicLength;
+
+    if((Topic == NULL) || ((TopicLength = strlen(Topic)) > MQTT_FILTER_TOPIC_LENGTH) || (Deadband < 0.0f))
+    {
+        return INVALID_PARAMETER;
+    }
+
+    if(!this->_mFilter.Add(Topic, TopicLength, true, Deadband, Heartbeat))
+    {
+        return BUFFER_OVERFLOW;
+    }
+
+    return NO_ERROR;
+}
+
+MQTT::Error MQTT::SetRateLimit(MQTT::Priority Priority, uint32_t BytesPerSecond, uint32_t MessagesPerSecond)
+{
+    if(Priority > PRIORITY_BULK)
+    {
+        return INVALID_PARAMETER;
+    }
+
+    this->_mRateLimit[Priority].Configure(BytesPerSecond, MessagesPerSecond, MQTT_BUFFER_SIZE, millis());
+
+    return NO_ERROR;
+}
+
+MQTT::Error MQTT::SetPriority(const char* Topic, MQTT::Priority Priority)
+{
+    size_t TopicLength;
+
+    if((Topic == NULL) || (*Topic == 0x00) || ((TopicLength = strlen(Topic)) > MQTT_PRIORITY_TOPIC_LENGTH) || ((Priority != PRIORITY_HIGH) && (Priority != PRIORITY_BULK)))
+    {
+        return INVALID_PARAMETER;
+    }
+
+    if(!this->_mPriorities.Set(Topic, TopicLength, Priority))
+    {
+        return BUFFER_OVERFLOW;
+    }
+
+    return NO_ERROR;
+}
+
+MQTT::Message* MQTT::Receive(void)
+{
+    return this->_mInbound.Peek();
+}
+
+void MQTT::ReleaseMessage(void)
+{
+    MQTT::Message* Message = this->_mInbound.Peek();
+
+    if(Message != NULL)
+    {
+        MQTTTrace::Emit(MQTT_TRACE_DEQUEUE, MQTT_TRACE_QUEUE_INBOUND, Message->PayloadLength);
+        Message->Buffer.Release();
+        this->_mInbound.Release();
+    }
+}
+
+MQTTBuffer MQTT::RetainMessage(void)
+{
+    return this->_mDispatchBuffer;
+}
+
+MQTT::Error MQTT::Poll(void)
+{
+    MQTT::CallScope Profile(this, MQTT_PROFILE_POLL);
+
+    // The I/O thread owns the connection. Only dispatch the received messages
+    if(this->_mThreadRunning)
+    {
+        this->_dispatchInbound();
+
+        return this->_mThreadError.exchange(NO_ERROR);
+    }
+
+    // Send the ping, which was requested by the ping timer
+    if(this->_mPingDue.exchange(false))
+    {
+        this->_sendPing();
+    }
+
+    if(!this->isConnected())
+    {
+        return NOT_CONNECTED;
+    }
+
+    this->_publishDiagnostics();
+
+    // Transmit the queued messages and control packets
+    if(this->_transmitQueue())
+    {
+        return TRANSMISSION_ERROR;
+    }
+
+    // Process the answer from the host
+    if(this->_mClient.available())
+    {
+        return this->_receive();
+    }
+
+    return NO_ERROR;
+}
+
+MQTT::Error MQTT::StartThread(void)
+{
+    if(MQTT_OUTBOUND_QUEUE_SIZE == 0x00)
+    {
+        return CLIENT_ERROR;
+    }
+
+    if(!this->isConnected())
+    {
+        return NOT_CONNECTED;
+    }
+
+    if(this->_mThreadRunning)
+    {
+        return NO_ERROR;
+    }
+
+    // The thread handles the keep-alive by itself
+    this->_mPingTimer->stop();
+    this->_mLastPing = millis();
+
+    this->_mThreadError = NO_ERROR;
+    this->_mThreadMode = true;
+    this->_mThreadRunning = true;
+    if(!this->_mThread.Start(&MQTT::_threadEntry, this))
+    {
+        this->_mThreadMode = false;
+        this->_mThreadRunning = false;
+        this->_mPingTimer->start();
+
+        return CLIENT_ERROR;
     }
 
     return NO_ERROR;
 }
 
- MQTT::Error MQTT::Publish(const char* Topic, String Payload)
- {
+void MQTT::StopThread(void)
+{
+    this->_mThreadMode = false;
+
+    if(!this->_mThreadRunning)
+    {
+        return;
+    }
+
+    this->_stopThread();
+
+    if(this->isConnected())
+    {
+        this->_mPingTimer->start();
+    }
+}
+
+bool MQTT::isThreadRunning(void) const
+{
+    return this->_mThreadRunning;
+}
+
+MQTT::Error MQTT::Publish(const char* Topic, const String& Payload)
+{
     return this->Publish(Topic, (const uint8_t*)Payload.c_str(), Payload.length(), NULL, QOS_0, false, false);
- }
+}
 
 MQTT::Error MQTT::Publish(const char* Topic, const char* Payload, uint16_t Length)
 {
@@ -391,356 +918,2247 @@ MQTT::Error MQTT::Publish(const char* Topic, const uint8_t* Payload, uint16_t Le
     return this->Publish(Topic, Payload, Length, ID, QoS, false, false);
 }
 
-MQTT::Error MQTT::Publish(const char* Topic, const uint8_t* Payload, uint16_t Length, uint16_t* ID, MQTT::QoS QoS, bool Retain)
+MQTT::Error MQTT::Publish(const char* Topic, const uint8_t* Payload, uint16_t Length, uint16_t* ID, MQTT::QoS QoS, bool Retain)
+{
+    return this->Publish(Topic, Payload, Length, ID, QoS, Retain, false);
+}
+
+MQTT::Error MQTT::Publish(const char* Topic, const uint8_t* Payload, uint16_t Length, uint16_t* ID, MQTT::QoS QoS, bool Retain, bool DUP)
+{
+    size_t TopicLength;
+
+    if((Topic == NULL) || ((TopicLength = strlen(Topic)) > MQTT_BUFFER_SIZE))
+    {
+        return INVALID_PARAMETER;
+    }
+
+    return this->Publish(Topic, TopicLength, MQTTSpan(Payload, Length), ID, QoS, Retain, DUP);
+}
+
+MQTT::Error MQTT::Publish(const char* Topic, uint16_t TopicLength, const MQTTSpan& Payload)
+{
+    return this->Publish(Topic, TopicLength, Payload, NULL, QOS_0, false, false);
+}
+
+MQTT::Error MQTT::Publish(const char* Topic, uint16_t TopicLength, const MQTTSpan& Payload, uint16_t* ID, MQTT::QoS QoS)
+{
+    return this->Publish(Topic, TopicLength, Payload, ID, QoS, false, false);
+}
+
+MQTT::Error MQTT::Publish(const char* Topic, uint16_t TopicLength, const MQTTSpan& Payload, uint16_t* ID, MQTT::QoS QoS, bool Retain, bool DUP)
+{
+    MQTT::Timing Timing = {0x00, 0x00};
+
+    return this->_publish(Topic, TopicLength, Payload, ID, QoS, Retain, DUP, Timing);
+}
+
+MQTT::Error MQTT::Publish(const char* Topic, const uint8_t* Payload, uint16_t Length, uint16_t* ID, MQTT::QoS QoS, const MQTT::Timing& Timing)
+{
+    size_t TopicLength;
+
+    if((Topic == NULL) || ((TopicLength = strlen(Topic)) > MQTT_BUFFER_SIZE))
+    {
+        return INVALID_PARAMETER;
+    }
+
+    return this->_publish(Topic, TopicLength, MQTTSpan(Payload, Length), ID, QoS, false, false, Timing);
+}
+
+MQTT::Error MQTT::_publish(const char* Topic, uint16_t TopicLength, const MQTTSpan& Payload, uint16_t* ID, MQTT::QoS QoS, bool Retain, bool DUP, const MQTT::Timing& Timing)
+{
+    MQTT::CallScope Profile(this, MQTT_PROFILE_PUBLISH);
+    MQTT::Error Error;
+    uint8_t* Buffer;
+    MQTT::Packet* Packet;
+    uint16_t ByteOffset = MQTT_FIXED_HEADER_SIZE;
+
+    // Topic, message ID, properties and payload must fit into the buffer
+    if((Topic == NULL) || (TopicLength == 0x00) || (Payload.Data() == NULL) || ((uint32_t)(MQTT_FIXED_HEADER_SIZE + 0x02 + TopicLength + 0x03 + Payload.Length()) > MQTT_BUFFER_SIZE))
+    {
+        return INVALID_PARAMETER;
+    }
+
+    Error = this->_beginPublish(QoS, Topic, TopicLength, &Buffer, &Packet);
+    if(Error != NO_ERROR)
+    {
+        return Error;
+    }
+
+    // Only queued messages are scheduled
+    if(Packet != NULL)
+    {
+        uint32_t Now = millis();
+
+        if(Timing.Deadline > 0x00)
+        {
+            Packet->Deadline = Now + Timing.Deadline;
+            Packet->HasDeadline = true;
+        }
+
+        if(Timing.Expiry > 0x00)
+        {
+            Packet->Expiry = Now + Timing.Expiry;
+            Packet->HasExpiry = true;
+        }
+    }
+
+    // Copy the topic into the buffer
+    this->_copyString(Buffer, Topic, TopicLength, &ByteOffset);
+
+    return this->_finishPublish(Buffer, Packet, ByteOffset, Payload.Data(), Payload.Length(), ID, QoS, Retain, DUP);
+}
+
+MQTT::Error MQTT::Publish(const MQTTTopic& Topic, const uint8_t* Payload, uint16_t Length)
+{
+    return this->Publish(Topic, Payload, Length, NULL, QOS_0, false, false);
+}
+
+MQTT::Error MQTT::Publish(const MQTTTopic& Topic, const uint8_t* Payload, uint16_t Length, uint16_t* ID, MQTT::QoS QoS)
+{
+    return this->Publish(Topic, Payload, Length, ID, QoS, false, false);
+}
+
+MQTT::Error MQTT::Publish(const MQTTTopic& Topic, const uint8_t* Payload, uint16_t Length, uint16_t* ID, MQTT::QoS QoS, bool Retain)
+{
+    return this->Publish(Topic, Payload, Length, ID, QoS, Retain, false);
+}
+
+MQTT::Error MQTT::Publish(const MQTTTopic& Topic, const uint8_t* Payload, uint16_t Length, uint16_t* ID, MQTT::QoS QoS, bool Retain, bool DUP)
+{
+    MQTT::CallScope Profile(this, MQTT_PROFILE_PUBLISH);
+    MQTT::Error Error;
+    uint8_t* Buffer;
+    MQTT::Packet* Packet;
+
+    // Topic, message ID, properties and payload must fit into the buffer
+    if(!Topic.isValid() || (Payload == NULL) || ((uint32_t)(MQTT_FIXED_HEADER_SIZE + Topic.Size() + 0x03 + Length) > MQTT_BUFFER_SIZE))
+    {
+        return INVALID_PARAMETER;
+    }
+
+    Error = this->_beginPublish(QoS, (const char*)Topic.Data() + 0x02, Topic.Size() - 0x02, &Buffer, &Packet);
+    if(Error != NO_ERROR)
+    {
+        return Error;
+    }
+
+    // Copy the encoded topic into the buffer
+    memcpy(Buffer + MQTT_FIXED_HEADER_SIZE, Topic.Data(), Topic.Size());
+
+    return this->_finishPublish(Buffer, Packet, MQTT_FIXED_HEADER_SIZE + Topic.Size(), Payload, Length, ID, QoS, Retain, DUP);
+}
+
+MQTT::Error MQTT::Publishf(const char* Topic, const char* Format, ...)
+{
+    MQTT::Error Error;
+    va_list Arguments;
+
+    va_start(Arguments, Format);
+    Error = this->_publishFormatted(Topic, NULL, QOS_0, Format, Arguments);
+    va_end(Arguments);
+
+    return Error;
+}
+
+MQTT::Error MQTT::Publishf(const char* Topic, uint16_t* ID, MQTT::QoS QoS, const char* Format, ...)
+{
+    MQTT::Error Error;
+    va_list Arguments;
+
+    va_start(Arguments, Format);
+    Error = this->_publishFormatted(Topic, ID, QoS, Format, Arguments);
+    va_end(Arguments);
+
+    return Error;
+}
+
+MQTT::Error MQTT::BeginPublish(MQTT::Writer* Writer, const char* Topic, MQTT::QoS QoS)
+{
+    MQTT::Error Error;
+    uint16_t ByteOffset = MQTT_FIXED_HEADER_SIZE;
+    size_t TopicLength;
+
+    if((Writer == NULL) || (Topic == NULL) || ((uint32_t)(MQTT_FIXED_HEADER_SIZE + 0x02 + (TopicLength = strlen(Topic)) + 0x03) > MQTT_BUFFER_SIZE))
+    {
+        return INVALID_PARAMETER;
+    }
+
+    Error = this->_beginPublish(QoS, Topic, TopicLength, &Writer->_mBuffer, &Writer->_mPacket);
+    if(Error != NO_ERROR)
+    {
+        Writer->_mBuffer = NULL;
+
+        return Error;
+    }
+
+    // Copy the topic into the buffer and leave space for the message ID and the properties
+    this->_copyString(Writer->_mBuffer, Topic, TopicLength, &ByteOffset);
+    Writer->_mQoS = QoS;
+    Writer->_mTopicEnd = ByteOffset;
+    Writer->_mStart = this->_payloadOffset(ByteOffset, QoS);
+    Writer->_mPosition = Writer->_mStart;
+    Writer->_mOverflow = false;
+
+    return NO_ERROR;
+}
+
+MQTT::Error MQTT::EndPublish(MQTT::Writer* Writer, uint16_t* ID, bool Retain)
+{
+    MQTT::CallScope Profile(this, MQTT_PROFILE_PUBLISH);
+    MQTT::Error Error;
+
+    if((Writer == NULL) || (Writer->_mBuffer == NULL))
+    {
+        return INVALID_PARAMETER;
+    }
+
+    if(Writer->_mOverflow)
+    {
+        this->CancelPublish(Writer);
+
+        return BUFFER_OVERFLOW;
+    }
+
+    Error = this->_finishPublish(Writer->_mBuffer, Writer->_mPacket, Writer->_mTopicEnd, NULL, Writer->Length(), ID, Writer->_mQoS, Retain, false);
+    Writer->_mBuffer = NULL;
+
+    return Error;
+}
+
+void MQTT::CancelPublish(MQTT::Writer* Writer)
+{
+    if((Writer != NULL) && (Writer->_mBuffer != NULL))
+    {
+        this->_discardPacket(Writer->_mPacket);
+        Writer->_mBuffer = NULL;
+    }
+}
+
+MQTT::Error MQTT::PrepareTemplate(MQTT::PublishTemplate* Template, const MQTTTopic& Topic, uint16_t PayloadLength, MQTT::QoS QoS, bool Retain)
+{
+    uint16_t ByteOffset = MQTT_FIXED_HEADER_SIZE;
+
+    if((Template == NULL) || !MQTTFeatures::Supports(QoS) || !Topic.isValid() || ((uint32_t)(MQTT_FIXED_HEADER_SIZE + Topic.Size() + 0x03 + PayloadLength) > MQTT_BUFFER_SIZE))
+    {
+        return INVALID_PARAMETER;
+    }
+
+    memset(Template->Data, 0x00, MQTT_BUFFER_SIZE);
+
+    // Copy the encoded topic into the buffer
+    memcpy(Template->Data + ByteOffset, Topic.Data(), Topic.Size());
+    ByteOffset += Topic.Size();
+
+    // Reserve the packet identifier
+    Template->IDOffset = ByteOffset;
+    if(MQTTFeatures::HasID(QoS))
+    {
+        ByteOffset += 0x02;
+    }
+
+    // MQTT 5 uses properties. No properties are used yet
+    if(this->_mVersion == MQTT_VERSION_5)
+    {
+        Template->Data[ByteOffset++] = 0x00;
+    }
+
+    Template->PayloadOffset = ByteOffset;
+    Template->PayloadLength = PayloadLength;
+    Template->QoS = QoS;
+    Template->Version = this->_mVersion;
+
+    // Encode the fixed header
+    Template->Offset = this->_encodeHeader(Template->Data, (PUBLISH << 0x04) | (Retain << 0x00) | (uint8_t)((QoS & 0x03) << 0x01), ByteOffset + PayloadLength - MQTT_FIXED_HEADER_SIZE);
+    Template->Length = ByteOffset + PayloadLength - Template->Offset;
+
+    return NO_ERROR;
+}
+
+MQTT::Error MQTT::Publish(MQTT::PublishTemplate* Template, const uint8_t* Payload, uint16_t* ID)
+{
+    MQTT::CallScope Profile(this, MQTT_PROFILE_PUBLISH);
+    uint8_t* Buffer;
+    MQTT::Packet* Packet;
+    MQTT_Filter_Sample Sample;
+
+    if((Template == NULL) || (Payload == NULL) || (Template->Length == 0x00) || (Template->Version != this->_mVersion))
+    {
+        return this->_error(INVALID_PARAMETER);
+    }
+
+    // Template payloads aren't compressed and have no space for the escape marker of the compression
+    if(this->_mCompression && MQTT_NeedsEscape(Payload, Template->PayloadLength))
+    {
+        return this->_error(INVALID_PARAMETER);
+    }
+
+    if(!this->isConnected())
+    {
+        return this->_error(NOT_CONNECTED);
+    }
+
+    // MQTT 5 brokers limit the packet size. The number of unacknowledged messages is limited by #_acquireInFlight
+    if(Template->Length > this->_mServerMaximumPacketSize)
+    {
+        return this->_error(BUFFER_OVERFLOW);
+    }
+
+    Buffer = this->_getPublishBuffer(&Packet, (const char*)Template->Data + MQTT_FIXED_HEADER_SIZE + 0x02, (Template->Data[MQTT_FIXED_HEADER_SIZE] << 0x08) | Template->Data[MQTT_FIXED_HEADER_SIZE + 0x01]);
+    if(Buffer == NULL)
+    {
+        return this->_error(BUFFER_OVERFLOW);
+    }
+
+    // Skip messages without a relevant change. Skipped messages have no message ID
+    if(!this->_filterPublish(Template->Data + MQTT_FIXED_HEADER_SIZE, Payload, Template->PayloadLength, &Sample))
+    {
+        this->_discardPacket(Packet);
+
+        if(ID != NULL)
+        {
+            *ID = 0x00;
+        }
+
+        return NO_ERROR;
+    }
+
+    // Messages, which are transmitted directly, wait for the unsent bytes of the last message and are rejected when the class has not enough tokens
+    if(Packet == NULL)
+    {
+        MQTT::Error Error = this->_flush();
+        if(Error != NO_ERROR)
+        {
+            return this->_error(Error);
+        }
+
+        if(!this->_mRateLimit[this->_mBufferPriority].Acquire(Template->Length, millis()))
+        {
+            return this->_error(FLOW_CONTROL);
+        }
+    }
+
+    // Patch the packet identifier and the payload
+    if(MQTTFeatures::HasID(Template->QoS))
+    {
+        uint16_t MessageID = this->_getID();
+
+        // MQTT 5 brokers limit the number of unacknowledged QoS 1 and QoS 2 messages
+        if(!this->_acquireInFlight(MessageID))
+        {
+            this->_discardPacket(Packet);
+
+            return this->_error(FLOW_CONTROL);
+        }
+
+        Template->Data[Template->IDOffset] = (MessageID >> 0x08);
+        Template->Data[Template->IDOffset + 0x01] = (MessageID & 0xFF);
+
+        if(ID != NULL)
+        {
+            *ID = MessageID;
+        }
+    }
+
+    memcpy(Template->Data + Template->PayloadOffset, Payload, Template->PayloadLength);
+
+    // Pass a copy of the message to the outbound queue
+    if(Packet != NULL)
+    {
+        memcpy(Packet->Data + Template->Offset, Template->Data + Template->Offset, Template->Length);
+        Packet->Offset = Template->Offset;
+        Packet->Length = Template->Length;
+        Packet->Slot = 0x00;
+        Packet->Filter = Sample;
+
+        MQTT::Error Error = this->_conflate(&Packet);
+        if(Error != NO_ERROR)
+        {
+            return this->_error(Error);
+        }
+
+        if(Packet != NULL)
+        {
+            this->_commitPacket(Packet);
+        }
+
+        return NO_ERROR;
+    }
+
+    // The message is transmitted from the template without topic alias. A message, which wasn't sent, isn't in flight
+    MQTT::Error Error = this->_write(Template->Data + Template->Offset, Template->Length);
+    if(Error == NO_ERROR)
+    {
+        this->_mFilter.Commit(&Sample, millis());
+    }
+    else if(MQTTFeatures::HasID(Template->QoS))
+    {
+        this->_releaseInFlight((Template->Data[Template->IDOffset] << 0x08) | Template->Data[Template->IDOffset + 0x01]);
+    }
+
+    return this->_error(Error);
+}
+
+MQTT::Error MQTT::Subscribe(const char* Topic)
+{
+    return this->Subscribe(Topic, QOS_0);
+}
+
+MQTT::Error MQTT::Subscribe(const char* Topic, MQTT::QoS QoS)
+{
+    size_t TopicLength;
+
+    if((Topic == NULL) || ((TopicLength = strlen(Topic)) > MQTT_BUFFER_SIZE))
+    {
+        return INVALID_PARAMETER;
+    }
+
+    return this->Subscribe(Topic, TopicLength, QoS);
+}
+
+MQTT::Error MQTT::Subscribe(const char* Topic, uint16_t TopicLength, MQTT::QoS QoS)
+{
+    MQTT::CallScope Profile(this, MQTT_PROFILE_SUBSCRIBE);
+    uint16_t Length = MQTT_FIXED_HEADER_SIZE;
+
+    // Message ID, properties, topic and options must fit into the buffer. Subscriptions need the inbound processing
+    if(!MQTTFeatures::Inbound || (Topic == NULL) || (TopicLength == 0x00) || ((uint32_t)(MQTT_FIXED_HEADER_SIZE + 0x03 + 0x02 + TopicLength + 0x01) > MQTT_BUFFER_SIZE))
+    {
+        return INVALID_PARAMETER;
+    }
+
+    if(this->isConnected())
+    {
+        MQTT::Packet* Packet;
+        uint8_t* Buffer = this->_getBuffer(&Packet, PRIORITY_HIGH);
+        if(Buffer == NULL)
+        {
+            return BUFFER_OVERFLOW;
+        }
+
+        // Set the message ID
+        uint16_t MessageID = this->_getID();
+        Buffer[Length++] = (MessageID >> 0x08);
+        Buffer[Length++] = (MessageID & 0xFF);
+
+        // MQTT 5 uses properties. No properties are used yet
+        if(this->_mVersion == MQTT_VERSION_5)
+        {
+            Buffer[Length++] = 0x00;
+        }
+
+        // Copy the topic into the buffer
+        this->_copyString(Buffer, Topic, TopicLength, &Length);
+
+        // Write the QoS into the buffer. The broker downgrades the messages to the highest enabled QoS
+        Buffer[Length++] = ((uint8_t)QoS > MQTTFeatures::MaximumQoS()) ? MQTTFeatures::MaximumQoS() : (uint8_t)QoS;
+
+        // Transmit the buffer
+        return this->_writeMessage(Buffer, Packet, SUBSCRIBE, (0x01 << 0x01), Length - MQTT_FIXED_HEADER_SIZE);
+    }
+
+    return NOT_CONNECTED;
+}
+
+MQTT::Error MQTT::Unsubscribe(const char* Topic)
+{
+    size_t TopicLength;
+
+    if((Topic == NULL) || ((TopicLength = strlen(Topic)) > MQTT_BUFFER_SIZE))
+    {
+        return INVALID_PARAMETER;
+    }
+
+    return this->Unsubscribe(Topic, TopicLength);
+}
+
+MQTT::Error MQTT::Unsubscribe(const char* Topic, uint16_t TopicLength)
+{
+    uint16_t Length = MQTT_FIXED_HEADER_SIZE;
+
+    // Message ID, properties and topic must fit into the buffer
+    if((Topic == NULL) || (TopicLength == 0x00) || ((uint32_t)(MQTT_FIXED_HEADER_SIZE + 0x03 + 0x02 + TopicLength) > MQTT_BUFFER_SIZE))
+    {
+        return INVALID_PARAMETER;
+    }
+
+    if(this->isConnected())
+    {
+        MQTT::Packet* Packet;
+        uint8_t* Buffer = this->_getBuffer(&Packet, PRIORITY_HIGH);
+        if(Buffer == NULL)
+        {
+            return BUFFER_OVERFLOW;
+        }
+
+        // Set the message ID
+        uint16_t MessageID = this->_getID();
+        Buffer[Length++] = (MessageID >> 0x08);
+        Buffer[Length++] = (MessageID & 0xFF);
+
+        // MQTT 5 uses properties. No properties are used yet
+        if(this->_mVersion == MQTT_VERSION_5)
+        {
+            Buffer[Length++] = 0x00;
+        }
+
+        // Copy the topic into the buffer
+        this->_copyString(Buffer, Topic, TopicLength, &Length);
+
+        // Transmit the buffer
+        return this->_writeMessage(Buffer, Packet, UNSUBSCRIBE, (0x01 << 0x01), Length - MQTT_FIXED_HEADER_SIZE);
+    }
+
+    return NOT_CONNECTED;
+}
+
+bool MQTT::_readByte(uint8_t* Data, bool Thread)
+{
+    uint32_t Start = millis();
+
+    while(!this->_mClient.available())
+    {
+        if(!this->_mClient.connected() || (Thread && !this->_mThreadRunning) || ((millis() - Start) > MQTT_READ_TIMEOUT))
+        {
+            return false;
+        }
+    }
+
+    *Data = this->_mClient.read();
+
+    return true;
+}
+
+MQTT::Error MQTT::_readMessage(uint8_t* Buffer, uint16_t* FixedHeaderSize, uint16_t* Bytes)
+{
+    MQTT::PhaseScope Phase(this, MQTT_PHASE_READ);
+    uint8_t EncodedByte = 0x00;
+    uint16_t ReceivedBytes = 0x00;
+    uint32_t RemainingLength = 0x00;
+    uint32_t Packet = 0x01;
+    bool Thread = this->_mThreadRunning;
+
+    // Get the fixed header. The remaining length uses at most four bytes
+    if(!this->_readByte(&Buffer[ReceivedBytes++], Thread))
+    {
+        this->_mClient.stop();
+
+        return TRANSMISSION_ERROR;
+    }
+
+    do
+    {
+        if((ReceivedBytes == MQTT_FIXED_HEADER_SIZE) || !this->_readByte(&EncodedByte, Thread))
+        {
+            this->_mClient.stop();
+
+            return TRANSMISSION_ERROR;
+        }
+
+        Buffer[ReceivedBytes++] = EncodedByte;
+        RemainingLength += (EncodedByte & 0x7F) * Packet;
+        Packet <<= 0x07;
+    } while(EncodedByte & (0x01 << 0x07));
+    *FixedHeaderSize = ReceivedBytes;
+
+    // The body of an oversized message stays in the socket and can't be skipped reliably, so the connection is closed
+    if((ReceivedBytes + RemainingLength) > MQTT_BUFFER_SIZE)
+    {
+        this->_mClient.stop();
+
+        return BUFFER_OVERFLOW;
+    }
+
+    // Get the remaining message. A partial message can't be resynchronized, so the connection is closed
+    for(uint16_t i = 0x00; i < RemainingLength; i++)
+    {
+        if(!this->_readByte(&Buffer[ReceivedBytes++], Thread))
+        {
+            this->_mClient.stop();
+
+            return TRANSMISSION_ERROR;
+        }
+    }
+
+    *Bytes = ReceivedBytes;
+    this->_mMetrics.Receive(Buffer[0], ReceivedBytes);
+    this->_mCapture.Record(MQTT_CAPTURE_INBOUND, Buffer, ReceivedBytes);
+    MQTTTrace::Emit(MQTT_TRACE_DECODE, Buffer[0], ReceivedBytes);
+
+    return NO_ERROR;
+}
+
+MQTT::Error MQTT::_receive(void)
+{
+    uint16_t FixedHeaderSize;
+    uint16_t ReceivedBytes;
+
+    // Receive into a buffer from the pool, so the application can keep the message without copying it.
+    // The transmit buffer is used when all buffers are in use
+    MQTTBuffer Handle = this->_mPool.Allocate();
+    uint8_t* Buffer = Handle.isValid() ? Handle.Data() : this->_mBuffer;
+
+    if(this->_readMessage(Buffer, &FixedHeaderSize, &ReceivedBytes))
+    {
+        return this->_error(TRANSMISSION_ERROR);
+    }
+
+    return this->_error(this->_processMessage(Handle, Buffer, FixedHeaderSize, ReceivedBytes));
+}
+
+MQTT::Error MQTT::_protocolError(MQTT::ReasonCode Reason)
+{
+    if(this->isConnected() && (this->_mVersion == MQTT_VERSION_5))
+    {
+        uint8_t Temp[3] = {(DISCONNECT << 0x04), 0x01, (uint8_t)Reason};
+
+        if(this->_flush() == NO_ERROR)
+        {
+            this->_write(Temp, sizeof(Temp));
+        }
+    }
+
+    this->_mClient.stop();
+    MQTTTrace::Emit(MQTT_TRACE_DISCONNECT, Reason, 0x00);
+
+    return TRANSMISSION_ERROR;
+}
+
+MQTT::Error MQTT::_processMessage(const MQTTBuffer& Handle, uint8_t* Buffer, uint16_t FixedHeaderSize, uint16_t Bytes)
+{
+    if(FixedHeaderSize)
+    {
+        ControlPacket Type = (MQTT::ControlPacket)(Buffer[0] >> 0x04);
+        MQTT::QoS QoS = (MQTT::QoS)((Buffer[0] >> 0x01) & 0x03);
+        bool DUP = (bool)((Buffer[0] >> 0x03) & 0x01);
+        uint16_t MessageID = 0x00;
+
+        // Acknowledgements start with the packet identifier
+        if((Type == PUBACK) || (Type == PUBREC) || (Type == PUBREL) || (Type == PUBCOMP) || (Type == SUBACK) || (Type == UNSUBACK))
+        {
+            if(Bytes < (FixedHeaderSize + 0x02))
+            {
+                return this->_protocolError(REASON_MALFORMED_PACKET);
+            }
+
+            MessageID = (Buffer[FixedHeaderSize] << 0x08) | Buffer[FixedHeaderSize + 0x01];
+        }
+
+        switch(Type)
+        {
+            case(PUBLISH):
+            {
+                MQTT::Error Error = NO_ERROR;
+                MQTT::Message* Message = NULL;
+                uint16_t MessageID = 0x00;
+                uint16_t MessageIDLength = MQTTFeatures::HasID(QoS) ? sizeof(MessageID) : 0x00;
+                uint16_t TopicLength;
+                uint16_t PayloadLength;
+                bool Aliased = false;
+                bool Drop = false;
+
+                // Received messages are dropped without inbound processing and messages with a removed QoS violate the subscription
+                if(!MQTTFeatures::Inbound)
+                {
+                    return NO_ERROR;
+                }
+                else if(!MQTTFeatures::Supports(QoS))
+                {
+                    return TRANSMISSION_ERROR;
+                }
+
+                // The receive queue needs a free message slot and a pool buffer. Otherwise the message is acknowledged and dropped
+                // after the topic alias is processed, so the socket is never blocked by a slow application
+                if(this->_mThreadRunning || this->_mReceiveQueued)
+                {
+                    Message = this->_mInbound.Reserve();
+                    Drop = (Message == NULL) || !Handle.isValid();
+                }
+
+                // The topic and the message ID must be part of the message
+                if((uint32_t)(FixedHeaderSize + sizeof(TopicLength)) > Bytes)
+                {
+                    return TRANSMISSION_ERROR;
+                }
+
+                TopicLength = (Buffer[FixedHeaderSize] << 0x08) | Buffer[FixedHeaderSize + 0x01];
+                if(((uint32_t)FixedHeaderSize + sizeof(TopicLength) + TopicLength + MessageIDLength) > Bytes)
+                {
+                    return TRANSMISSION_ERROR;
+                }
+
+                uint16_t Offset = FixedHeaderSize + sizeof(TopicLength) + TopicLength + MessageIDLength;
+
+                // QoS 1 and QoS 2 use a message ID
+                if(MessageIDLength > 0x00)
+                {
+                    MessageID = (Buffer[Offset - 0x02] << 0x08) | Buffer[Offset - 0x01];
+                }
+
+                char* Topic = (char*)(&Buffer[FixedHeaderSize + sizeof(TopicLength)]);
+
+                // MQTT 5 messages contain properties in front of the payload
+                if(this->_mVersion == MQTT_VERSION_5)
+                {
+                    MQTT_Property Property;
+                    MQTTPropertyReader Reader(Buffer + Offset, Bytes - Offset);
+
+                    while(Reader.Next(&Property))
+                    {
+                        // The broker defines an alias with a topic and uses it with an empty topic.
+                        // An alias, which can't be stored or isn't known, is a protocol error
+                        if(Property.ID == MQTT_PROPERTY_TOPIC_ALIAS)
+                        {
+                            if(TopicLength > 0x00)
+                            {
+                                if(!this->_mInboundAliases.Set(Property.Value, Topic, TopicLength))
+                                {
+                                    return this->_protocolError(REASON_TOPIC_ALIAS_INVALID);
+                                }
+                            }
+                            else if((Topic = this->_mInboundAliases.Get(Property.Value, &TopicLength)) == NULL)
+                            {
+                                return this->_protocolError(REASON_TOPIC_ALIAS_INVALID);
+                            }
+                            else
+                            {
+                                Aliased = true;
+                            }
+                        }
+                    }
+
+                    if(!Reader.isValid())
+                    {
+                        return TRANSMISSION_ERROR;
+                    }
+
+                    Offset += Reader.Size();
+                }
+
+                // The message is acknowledged before it is delivered or dropped, so a dropped message never keeps its packet identifier open.
+                // QoS 1 needs a PUBACK as response
+                if(MQTTFeatures::QoS1 && (QoS == MQTT::QOS_1))
+                {
+                    Error = this->_publishAcknowledge(MessageID);
+                }
+                // QoS 2 needs a PUBREC as response
+                else if(MQTTFeatures::QoS2 && (QoS == MQTT::QOS_2))
+                {
+                    Error = this->_publishReceived(MessageID);
+                }
+
+                PayloadLength = Bytes - Offset;
+                char* Payload = (char*)(&Buffer[Offset]);
+
+                // Compressed payloads are decompressed together with the topic into a new buffer when the compression is enabled.
+                // The message is dropped when no buffer is free or the payload can't be decompressed, so compressed data never
+                // reaches the application
+                MQTTBuffer Copy;
+                if(this->_mCompression && MQTT_IsCompressed((const uint8_t*)Payload, PayloadLength))
+                {
+                    MQTTBuffer Decompressed = this->_mPool.Allocate();
+                    uint16_t Length;
+
+                    if(!Decompressed.isValid() || (TopicLength >= MQTT_BUFFER_SIZE))
+                    {
+                        Drop = true;
+                    }
+                    else
+                    {
+                        memcpy(Decompressed.Data(), Topic, TopicLength);
+                        if(MQTT_Decompress((const uint8_t*)Payload, PayloadLength, Decompressed.Data() + TopicLength, MQTT_BUFFER_SIZE - TopicLength, &Length))
+                        {
+                            Copy = Decompressed;
+                            Topic = (char*)Copy.Data();
+                            Payload = Topic + TopicLength;
+                            PayloadLength = Length;
+                        }
+                        else
+                        {
+                            Drop = true;
+                        }
+                    }
+                }
+
+                // Escaped payloads are passed without the escape marker
+                else if(this->_mCompression && MQTT_IsEscaped((const uint8_t*)Payload, PayloadLength))
+                {
+                    Payload += MQTT_COMPRESSION_ESCAPE_SIZE;
+                    PayloadLength -= MQTT_COMPRESSION_ESCAPE_SIZE;
+                }
+
+                // The topic of an alias is copied behind the message, because the alias table changes with the next message
+                if(!Drop && Aliased && !Copy.isValid())
+                {
+                    if((Bytes + TopicLength) <= MQTT_BUFFER_SIZE)
+                    {
+                        memcpy(Buffer + Bytes, Topic, TopicLength);
+                        Topic = (char*)(Buffer + Bytes);
+                    }
+                    else
+                    {
+                        Copy = this->_mPool.Allocate();
+                        if(!Copy.isValid() || ((TopicLength + PayloadLength) > MQTT_BUFFER_SIZE))
+                        {
+                            Drop = true;
+                        }
+                        else
+                        {
+                            memcpy(Copy.Data(), Topic, TopicLength);
+                            memcpy(Copy.Data() + TopicLength, Payload, PayloadLength);
+                            Topic = (char*)Copy.Data();
+                            Payload = Topic + TopicLength;
+                        }
+                    }
+                }
+
+                // Messages, which can't be stored, are dropped and counted
+                if(Drop)
+                {
+                    MQTTThread::Add(&this->_mStatistics.DroppedMessages, 0x01);
+
+                    return Error;
+                }
+
+                // Move the message into the inbound queue
+                if(Message != NULL)
+                {
+                    Message->TopicLength = TopicLength;
+                    Message->PayloadLength = PayloadLength;
+                    Message->ID = MessageID;
+                    Message->QoS = QoS;
+                    Message->DUP = DUP;
+                    Message->Topic = Topic;
+                    Message->Payload = Payload;
+                    Message->Buffer = Copy.isValid() ? Copy : Handle;
+                    this->_mInbound.Commit();
+                    MQTTTrace::Emit(MQTT_TRACE_ENQUEUE, MQTT_TRACE_QUEUE_INBOUND, PayloadLength);
+                }
+                else if(this->_mCallback.isValid())
+                {
+                    MQTT::PhaseScope Phase(this, MQTT_PHASE_DISPATCH);
+
+                    this->_mDispatchBuffer = Copy.isValid() ? Copy : Handle;
+                    this->_mCallback(TopicLength, Topic, PayloadLength, Payload, MessageID, QoS, DUP);
+                    this->_mDispatchBuffer.Release();
+                }
+
+                return Error;
+            }
+            case(PUBACK):
+            {
+                // Acknowledgements for a removed QoS are ignored
+                if(!MQTTFeatures::QoS1)
+                {
+                    break;
+                }
+
+                // Duplicate acknowledgements and acknowledgements for unknown messages don't change the flow control
+                this->_mReasonCode = (Bytes > (FixedHeaderSize + 0x02)) ? Buffer[FixedHeaderSize + 0x02] : (uint8_t)REASON_SUCCESS;
+                if(this->_releaseInFlight(MessageID))
+                {
+                    this->_mLatency.Stop(MQTT_LATENCY_PUBLISH, MessageID, millis());
+                }
+
+                break;
+            }
+            case(PUBREC):
+            {
+                // Acknowledgements for a removed QoS are ignored
+                if(!MQTTFeatures::QoS2)
+                {
+                    break;
+                }
+
+                this->_mReasonCode = (Bytes > (FixedHeaderSize + 0x02)) ? Buffer[FixedHeaderSize + 0x02] : (uint8_t)REASON_SUCCESS;
+
+                // The broker has rejected the message. The flow ends here
+                if(this->_mReasonCode >= REASON_UNSPECIFIED_ERROR)
+                {
+                    this->_releaseInFlight(MessageID);
+
+                    break;
+                }
+
+                return this->_publishRelease(MessageID);
+            }
+            case(PUBREL):
+            {
+                // Acknowledgements for a removed QoS are ignored
+                if(!MQTTFeatures::QoS2)
+                {
+                    break;
+                }
+
+                this->_mReasonCode = (Bytes > (FixedHeaderSize + 0x02)) ? Buffer[FixedHeaderSize + 0x02] : (uint8_t)REASON_SUCCESS;
+
+                return this->_publishComplete(MessageID);
+            }
+            case(PUBCOMP):
+            {
+                // Acknowledgements for a removed QoS are ignored
+                if(!MQTTFeatures::QoS2)
+                {
+                    break;
+                }
+
+                // Duplicate acknowledgements and acknowledgements for unknown messages don't change the flow control
+                this->_mReasonCode = (Bytes > (FixedHeaderSize + 0x02)) ? Buffer[FixedHeaderSize + 0x02] : (uint8_t)REASON_SUCCESS;
+                if(this->_releaseInFlight(MessageID))
+                {
+                    this->_mLatency.Stop(MQTT_LATENCY_PUBLISH, MessageID, millis());
+                }
+
+                break;
+            }
+            case(SUBACK):
+            {
+                uint16_t Offset = FixedHeaderSize + 0x02;
+
+                this->_mLatency.Stop(MQTT_LATENCY_SUBSCRIBE, MessageID, millis());
+
+                // Skip the properties of MQTT 5
+                if(this->_mVersion == MQTT_VERSION_5)
+                {
+                    Offset += MQTTPropertyReader(Buffer + Offset, Bytes - Offset).Size();
+                }
+
+                // Save the return code for the first topic
+                if(Offset < Bytes)
+                {
+                    this->_mReasonCode = Buffer[Offset];
+                }
+
+                break;
+            }
+            case(DISCONNECT):
+            {
+                // MQTT 5 brokers can close the connection with a reason code
+                this->_mReasonCode = (Bytes > 0x02) ? Buffer[2] : (uint8_t)REASON_SUCCESS;
+                this->_mClient.stop();
+                MQTTTrace::Emit(MQTT_TRACE_DISCONNECT, this->_mReasonCode, 0x00);
+
+                return NOT_CONNECTED;
+            }
+            case(UNSUBACK):
+            {
+                // Add additonal code if needed
+                break;
+            }
+            case(PINGREQ):
+            {
+                // Add additonal code if needed
+                break;
+            }
+            case(PINGRESP):
+            {
+                this->_mWaitForHostPing = false;
+                this->_mLatency.Stop(MQTT_LATENCY_PING, 0x00, millis());
+
+                break;
+            }
+            default:
+            {
+                // CONNACK is only valid as answer for #Connect and the other packets are never sent by a broker
+                return this->_protocolError(REASON_PROTOCOL_ERROR);
+            }
+        }
+    }
+
+    return NO_ERROR;
+}
+
+uint8_t* MQTT::_getBuffer(MQTT::Packet** Packet, MQTT::Priority Priority)
+{
+    *Packet = NULL;
+
+    if(this->_mThreadRunning || this->_mQueued)
+    {
+        if((Priority == PRIORITY_BULK) && (MQTT_BULK_QUEUE_SIZE > 0x00))
+        {
+            *Packet = this->_mBulk.Reserve();
+        }
+        else
+        {
+            *Packet = this->_mOutbound.Reserve();
+        }
+
+        if(*Packet == NULL)
+        {
+            return NULL;
+        }
+
+        this->_preparePacket(*Packet, Priority);
+
+        return (*Packet)->Data;
+    }
+
+    this->_mBufferPriority = Priority;
+
+    return this->_mBuffer;
+}
+
+uint8_t* MQTT::_getPublishBuffer(MQTT::Packet** Packet, const char* Topic, uint16_t Length)
+{
+    MQTT::Priority Priority = this->_priority(Topic, Length);
+
+    // A message for a conflated topic is written into the staging message of the topic, so a pending message is replaced without a queue entry.
+    // The queue is used while another thread writes a message for the same topic
+    if(this->_mThreadRunning || this->_mQueued)
+    {
+        int16_t Index = this->_mConflation.Find(Topic, Length);
+
+        if((Index >= 0x00) && ((*Packet = this->_mConflation.Stage(Index)) != NULL))
+        {
+            this->_preparePacket(*Packet, Priority);
+
+            return (*Packet)->Data;
+        }
+    }
+
+    return this->_getBuffer(Packet, Priority);
+}
+
+void MQTT::_preparePacket(MQTT::Packet* Packet, MQTT::Priority Priority)
+{
+    Packet->Priority = Priority;
+    Packet->Deadline = millis() + MQTT_DEFAULT_DEADLINE;
+    Packet->HasDeadline = false;
+    Packet->HasExpiry = false;
+    Packet->Filter.Index = -1;
+}
+
+void MQTT::_commitPacket(MQTT::Packet* Packet)
+{
+    // Bulk messages are traced as outbound messages when they share the outbound queue
+    if((Packet->Priority == PRIORITY_BULK) && (MQTT_BULK_QUEUE_SIZE > 0x00))
+    {
+        MQTTTrace::Emit(MQTT_TRACE_ENQUEUE, MQTT_TRACE_QUEUE_BULK, Packet->Length);
+        this->_mBulk.Commit(Packet);
+    }
+    else
+    {
+        MQTTTrace::Emit(MQTT_TRACE_ENQUEUE, MQTT_TRACE_QUEUE_HIGH, Packet->Length);
+        this->_mOutbound.Commit(Packet);
+    }
+}
+
+MQTT::Priority MQTT::_priority(const char* Topic, uint16_t Length) const
+{
+    return (MQTT::Priority)this->_mPriorities.Get(Topic, Length, PRIORITY_HIGH);
+}
+
+MQTT::Error MQTT::_transmitQueue(void)
+{
+    uint32_t Now = millis();
+
+    // Continue a short write first
+    MQTT::Error Error = this->_flush();
+    if(Error == WOULD_BLOCK)
+    {
+        return NO_ERROR;
+    }
+
+    // Start again with the highest class after each message, so control packets and high priority messages never wait behind bulk messages.
+    // A short write stops the transmission until the socket takes data again
+    while(this->isWritable() && (this->_transmitControl(Now, &Error) || this->_transmitPacket(this->_mOutbound, Now, &Error) || this->_transmitPacket(this->_mBulk, Now, &Error)))
+    {
+    }
+
+    if(this->_mDrained && this->isWritable())
+    {
+        this->_mDrained = false;
+
+        if(this->_mDrainCallback.isValid())
+        {
+            MQTT::PhaseScope Phase(this, MQTT_PHASE_DISPATCH);
+
+            this->_mDrainCallback();
+        }
+    }
+
+    return this->_error(Error);
+}
+
+bool MQTT::_transmitControl(uint32_t Now, MQTT::Error* Error)
+{
+    MQTT::Frame* Frame = this->_mControl.Peek();
+
+    if((Frame == NULL) || !this->_mRateLimit[PRIORITY_CONTROL].Acquire(Frame->Length, Now))
+    {
+        return false;
+    }
+
+    if(this->_write(Frame->Data, Frame->Length) != NO_ERROR)
+    {
+        *Error = TRANSMISSION_ERROR;
+    }
+
+    MQTTTrace::Emit(MQTT_TRACE_DEQUEUE, MQTT_TRACE_QUEUE_CONTROL, Frame->Length);
+    this->_mControl.Release();
+
+    return true;
+}
+
+template<typename Q>
+bool MQTT::_transmitPacket(Q& Queue, uint32_t Now, MQTT::Error* Error)
+{
+    MQTT::Packet* Packet = Queue.Peek();
+
+    if(Packet == NULL)
+    {
+        return false;
+    }
+
+    // Bulk messages share the outbound queue when the bulk queue is removed
+    MQTT::Priority Priority = (MQTT::Priority)Packet->Priority;
+
+    // Get the latest message of a conflated topic. The message stays in the conflation table until the class has enough tokens
+    if(Packet->Slot > 0x00)
+    {
+        bool Pending;
+        MQTT::Packet* Latest = this->_mConflation.Acquire(Packet->Slot - 0x01, &Pending);
+
+        if(!this->_isExpired(Latest, Now) && !this->_mRateLimit[Priority].Acquire(Latest->Length, Now))
+        {
+            this->_mConflation.Release(Packet->Slot - 0x01, Pending);
+
+            return false;
+        }
+
+        memcpy(Packet->Data + Latest->Offset, Latest->Data + Latest->Offset, Latest->Length);
+        Packet->Offset = Latest->Offset;
+        Packet->Length = Latest->Length;
+        Packet->HasDeadline = Latest->HasDeadline;
+        Packet->HasExpiry = Latest->HasExpiry;
+        Packet->Deadline = Latest->Deadline;
+        Packet->Expiry = Latest->Expiry;
+        Packet->Filter = Latest->Filter;
+        this->_mConflation.Release(Packet->Slot - 0x01, false);
+    }
+    else if((Packet->Length > 0x00) && !this->_isExpired(Packet, Now) && !this->_mRateLimit[Priority].Acquire(Packet->Length, Now))
+    {
+        return false;
+    }
+
+    // Drop expired messages. A dropped QoS 1 or QoS 2 message doesn't wait for an acknowledgement
+    if((Packet->Length > 0x00) && this->_isExpired(Packet, Now))
+    {
+        if((Packet->Data[Packet->Offset] >> 0x04) == PUBLISH)
+        {
+            if((Packet->Data[Packet->Offset] >> 0x01) & 0x03)
+            {
+                this->_releaseInFlight(this->_publishID(Packet->Data));
+            }
+
+            MQTTThread::Add(&this->_mStatistics.ExpiredMessages, 0x01);
+        }
+
+        Packet->Length = 0x00;
+    }
+    else if((Packet->Length > 0x00) && Packet->HasDeadline && ((int32_t)(Now - Packet->Deadline) > 0x00))
+    {
+        MQTTThread::Add(&this->_mStatistics.DeadlineMisses[Priority], 0x01);
+    }
+
+    // Replace the topic with an alias. This is done during the transmission to keep the alias definitions in order
+    if((Packet->Length > 0x00) && (this->_mVersion == MQTT_VERSION_5) && ((Packet->Data[Packet->Offset] >> 0x04) == PUBLISH))
+    {
+        uint8_t Header = Packet->Data[Packet->Offset];
+        uint16_t Length = this->_applyTopicAlias(Packet->Data, Header & 0x0F, Packet->Length - (MQTT_FIXED_HEADER_SIZE - Packet->Offset));
+
+        Packet->Offset = this->_encodeHeader(Packet->Data, Header, Length);
+        Packet->Length = Length + MQTT_FIXED_HEADER_SIZE - Packet->Offset;
+    }
+
+    // Discarded packets have no length. The filter uses the payload of the transmitted message for the next messages
+    if(Packet->Length > 0x00)
+    {
+        if(this->_write(Packet->Data + Packet->Offset, Packet->Length) != NO_ERROR)
+        {
+            *Error = TRANSMISSION_ERROR;
+        }
+        else
+        {
+            this->_mFilter.Commit(&Packet->Filter, Now);
+        }
+    }
+
+    MQTTTrace::Emit(MQTT_TRACE_DEQUEUE, ((const void*)&Queue == (const void*)&this->_mBulk) ? MQTT_TRACE_QUEUE_BULK : MQTT_TRACE_QUEUE_HIGH, Packet->Length);
+    Queue.Release();
+
+    return true;
+}
+
+bool MQTT::_isExpired(const MQTT::Packet* Packet, uint32_t Now) const
+{
+    return Packet->HasExpiry && ((int32_t)(Now - Packet->Expiry) >= 0x00);
+}
+
+MQTT::Error MQTT::_writeControl(const uint8_t* Data, uint8_t Length)
+{
+    // Control packets wait in the control queue when the class is limited or the socket doesn't take more data
+    if(this->_mRateLimit[PRIORITY_CONTROL].isLimited() || (this->_mControl.Peek() != NULL) || (this->_flush() != NO_ERROR))
+    {
+        MQTT::Frame* Frame = this->_mControl.Reserve();
+        if(Frame == NULL)
+        {
+            return BUFFER_OVERFLOW;
+        }
+
+        memcpy(Frame->Data, Data, Length);
+        Frame->Length = Length;
+        this->_mControl.Commit(Frame);
+        MQTTTrace::Emit(MQTT_TRACE_ENQUEUE, MQTT_TRACE_QUEUE_CONTROL, Length);
+
+        return NO_ERROR;
+    }
+
+    return this->_write(Data, Length);
+}
+
+MQTT::Error MQTT::_error(MQTT::Error Error)
+{
+    this->_mMetrics.Error(Error);
+
+    return Error;
+}
+
+MQTT::Error MQTT::_write(const uint8_t* Data, uint16_t Length)
+{
+    MQTT::PhaseScope Phase(this, MQTT_PHASE_WRITE);
+    int Written = (int)this->_mClient.write(Data, Length);
+
+    if(Written < 0x00)
+    {
+        return TRANSMISSION_ERROR;
+    }
+
+    this->_mMetrics.Transmit(Data[0], Length);
+    this->_mCapture.Record(MQTT_CAPTURE_OUTBOUND, Data, Length);
+    MQTTTrace::Emit(MQTT_TRACE_ENCODE, Data[0], Length);
+    this->_startLatency(Data, Length);
+
+    // Keep the bytes, which the socket didn't take
+    if(Written < Length)
+    {
+        memcpy(this->_mUnsent, Data + Written, Length - Written);
+        this->_mUnsentOffset = 0x00;
+        this->_mUnsentLength = Length - Written;
+    }
+
+    return NO_ERROR;
+}
+
+void MQTT::_startLatency(const uint8_t* Data, uint16_t Length)
+{
+    uint8_t Type = Data[0] >> 0x04;
+    uint16_t Offset = 0x01;
+
+    if(Type == PINGREQ)
+    {
+        this->_mLatency.Start(MQTT_LATENCY_PING, 0x00, millis());
+
+        return;
+    }
+
+    // QoS 0 messages aren't acknowledged
+    if((Type != SUBSCRIBE) && ((Type != PUBLISH) || !((Data[0] >> 0x01) & 0x03)))
+    {
+        return;
+    }
+
+    // Skip the remaining length and the topic to get the packet identifier
+    while((Offset < Length) && (Data[Offset++] & 0x80));
+    if((Type == PUBLISH) && ((Offset + 0x01) < Length))
+    {
+        Offset += 0x02 + ((Data[Offset] << 0x08) | Data[Offset + 0x01]);
+    }
+
+    if((Offset + 0x01) < Length)
+    {
+        this->_mLatency.Start((Type == PUBLISH) ? MQTT_LATENCY_PUBLISH : MQTT_LATENCY_SUBSCRIBE, (Data[Offset] << 0x08) | Data[Offset + 0x01], millis());
+    }
+}
+
+void MQTT::_endCall(MQTT_Profile_Call Call)
+{
+    uint32_t Duration;
+    MQTT_Profile_Phase Phase;
+
+    if(this->_mProfile.End(Call, micros(), &Duration, &Phase) && (this->_mStallThreshold > 0x00) && (Duration >= this->_mStallThreshold) && this->_mStallCallback.isValid())
+    {
+        this->_mStallCallback(Call, Phase, Duration);
+    }
+}
+
+void MQTT::_endPhase(MQTT_Profile_Phase Phase, uint32_t Start)
+{
+    // Phases of the I/O thread are ignored by the profile, because they don't belong to the call of the application
+    this->_mProfile.Phase(Phase, micros() - Start);
+    this->_mProfile.Probe(&Start);
+}
+
+void MQTT::_publishDiagnostics(void)
+{
+    if((this->_mDiagnosticsInterval == 0x00) || ((millis() - this->_mLastDiagnostics) < this->_mDiagnosticsInterval))
+    {
+        return;
+    }
+
+    this->_mLastDiagnostics = millis();
+    this->PublishDiagnostics(this->_mDiagnosticsTopic);
+}
+
+MQTT::Error MQTT::_flush(void)
+{
+    if(this->_mUnsentLength == 0x00)
+    {
+        return NO_ERROR;
+    }
+
+    MQTT::PhaseScope Phase(this, MQTT_PHASE_WRITE);
+    int Written = (int)this->_mClient.write(this->_mUnsent + this->_mUnsentOffset, this->_mUnsentLength - this->_mUnsentOffset);
+    if(Written < 0x00)
+    {
+        return TRANSMISSION_ERROR;
+    }
+
+    this->_mUnsentOffset += Written;
+    if(this->_mUnsentOffset < this->_mUnsentLength)
+    {
+        return WOULD_BLOCK;
+    }
+
+    this->_mUnsentLength = 0x00;
+    this->_mUnsentOffset = 0x00;
+    this->_mDrained = true;
+
+    return NO_ERROR;
+}
+
+MQTT::Error MQTT::_writeMessage(uint8_t* Buffer, MQTT::Packet* Packet, MQTT::ControlPacket ControlPacket, uint8_t Flags, uint16_t Length)
+{
+    uint8_t Offset;
+    uint16_t TransmissionLength = 0x00;
+
+    // Messages, which are transmitted directly, wait for the unsent bytes of the last message. Only QoS 1 and QoS 2 messages are in flight
+    if(Packet == NULL)
+    {
+        MQTT::Error Error = this->_flush();
+        if(Error != NO_ERROR)
+        {
+            if((ControlPacket == PUBLISH) && ((Flags >> 0x01) & 0x03))
+            {
+                this->_releaseInFlight(this->_publishID(Buffer));
+            }
+
+            return this->_error(Error);
+        }
+    }
+
+    // Messages, which are transmitted directly, are rejected when the class has not enough tokens. The size without topic alias is used.
+    // Only QoS 1 and QoS 2 messages are in flight
+    if((Packet == NULL) && (ControlPacket != CONNECT) && !this->_mRateLimit[this->_mBufferPriority].Acquire(Length + 0x01 + MQTT_VarIntSize(Length), millis()))
+    {
+        if((ControlPacket == PUBLISH) && ((Flags >> 0x01) & 0x03))
+        {
+            this->_releaseInFlight(this->_publishID(Buffer));
+        }
+
+        return this->_error(FLOW_CONTROL);
+    }
+
+    // Replace the topic with an alias. Queued messages are processed by the transmitting thread
+    if((Packet == NULL) && (ControlPacket == PUBLISH) && (this->_mVersion == MQTT_VERSION_5))
+    {
+        Length = this->_applyTopicAlias(Buffer, Flags, Length);
+    }
+
+    Offset = this->_encodeHeader(Buffer, (ControlPacket << 0x04) | (Flags & 0x0F), Length);
+    TransmissionLength = Length + MQTT_FIXED_HEADER_SIZE - Offset;
+
+    // The MQTT 5 broker doesn't accept larger packets
+    if(TransmissionLength > this->_mServerMaximumPacketSize)
+    {
+        this->_discardPacket(Packet);
+
+        if((ControlPacket == PUBLISH) && ((Flags >> 0x01) & 0x03))
+        {
+            this->_releaseInFlight(this->_publishID(Buffer));
+        }
+
+        return this->_error(BUFFER_OVERFLOW);
+    }
+
+    // Pass the message to the outbound queue
+    if(Packet != NULL)
+    {
+        Packet->Offset = Offset;
+        Packet->Length = TransmissionLength;
+        Packet->Slot = 0x00;
+
+        if(ControlPacket == PUBLISH)
+        {
+            MQTT::Error Error = this->_conflate(&Packet);
+            if(Error != NO_ERROR)
+            {
+                return this->_error(Error);
+            }
+        }
+
+        if(Packet != NULL)
+        {
+            this->_commitPacket(Packet);
+        }
+
+        return NO_ERROR;
+    }
+
+    // A message, which wasn't sent, isn't in flight
+    MQTT::Error Error = this->_write(Buffer + Offset, TransmissionLength);
+    if((Error != NO_ERROR) && (ControlPacket == PUBLISH) && ((Flags >> 0x01) & 0x03))
+    {
+        this->_releaseInFlight(this->_publishID(Buffer));
+    }
+
+    return this->_error(Error);
+}
+
+MQTT::Error MQTT::_conflate(MQTT::Packet** Entry)
+{
+    bool Pending;
+    MQTT::Packet* Packet = *Entry;
+    const uint8_t* Body = Packet->Data + MQTT_FIXED_HEADER_SIZE;
+    int16_t Staged = this->_mConflation.IndexOf(Packet);
+    int16_t Index = (Staged >= 0x00) ? Staged : this->_mConflation.Find((const char*)Body + 0x02, (Body[0] << 0x08) | Body[1]);
+
+    if(Index < 0x00)
+    {
+        return NO_ERROR;
+    }
+
+    MQTT::Packet* Latest = this->_mConflation.Acquire(Index, &Pending);
+
+    // A staged message needs a queue entry only when no message is pending
+    if(Staged >= 0x00)
+    {
+        *Entry = NULL;
+
+        if(!Pending)
+        {
+            if(this->_getBuffer(Entry, (MQTT::Priority)Packet->Priority) == NULL)
+            {
+                this->_mConflation.Release(Index, false);
+                this->_mConflation.Unstage(Index);
+
+                if((Packet->Data[Packet->Offset] >> 0x01) & 0x03)
+                {
+                    this->_releaseInFlight(this->_publishID(Packet->Data));
+                }
+
+                return BUFFER_OVERFLOW;
+            }
+
+            (*Entry)->Deadline = Packet->Deadline;
+        }
+    }
+
+    // The replaced message is never transmitted and doesn't wait for an acknowledgement
+    if(Pending)
+    {
+        if((Latest->Data[Latest->Offset] >> 0x01) & 0x03)
+        {
+            this->_releaseInFlight(this->_publishID(Latest->Data));
+        }
+
+        MQTTThread::Add(&this->_mStatistics.ConflatedMessages, 0x01);
+    }
+
+    memcpy(Latest->Data + Packet->Offset, Packet->Data + Packet->Offset, Packet->Length);
+    Latest->Offset = Packet->Offset;
+    Latest->Length = Packet->Length;
+    Latest->HasDeadline = Packet->HasDeadline;
+    Latest->HasExpiry = Packet->HasExpiry;
+    Latest->Deadline = Packet->Deadline;
+    Latest->Expiry = Packet->Expiry;
+    Latest->Filter = Packet->Filter;
+    this->_mConflation.Release(Index, true);
+
+    if(Staged >= 0x00)
+    {
+        this->_mConflation.Unstage(Index);
+    }
+
+    // Only the first pending message keeps the queue entry
+    if(*Entry != NULL)
+    {
+        (*Entry)->Length = 0x00;
+        (*Entry)->Slot = Pending ? 0x00 : (Index + 0x01);
+    }
+
+    return NO_ERROR;
+}
+
+uint8_t MQTT::_encodeHeader(uint8_t* Buffer, uint8_t Header, uint16_t Length)
+{
+    uint16_t Remaining = Length;
+    uint8_t EncodedBytes[4];
+    uint8_t SizeBytes = 0x00;
+
+    // Encode the length of the message
+    do
+    {
+        uint8_t EncodedByte = Remaining % 0x80;
+        Remaining = Remaining >> 0x07;
+        if(Remaining > 0x00)
+        {
+            EncodedByte |= 0x80;
+        }
+
+        EncodedBytes[SizeBytes++] = EncodedByte;
+    } while(Remaining > 0x00);
+
+    // Store the header and the flags for the fixed header
+    Buffer[MQTT_FIXED_HEADER_SIZE - SizeBytes - 0x01] = Header;
+
+    // Copy the encoded length
+    for(uint8_t i = 0x00; i < SizeBytes; i++)
+    {
+        Buffer[MQTT_FIXED_HEADER_SIZE - SizeBytes + i] = EncodedBytes[i];
+    }
+
+    return MQTT_FIXED_HEADER_SIZE - SizeBytes - 0x01;
+}
+
+uint16_t MQTT::_applyTopicAlias(uint8_t* Buffer, uint8_t Flags, uint16_t Length)
+{
+    uint8_t* Body = Buffer + MQTT_FIXED_HEADER_SIZE;
+    uint16_t TopicLength = (Body[0] << 0x08) | Body[1];
+    uint16_t IDLength = (Flags & 0x06) ? 0x02 : 0x00;
+    uint16_t Offset = sizeof(TopicLength) + TopicLength + IDLength;
+    uint16_t Alias;
+
+    // Short topics don't benefit from an alias. The property length must stay a single byte
+    if((TopicLength <= 0x03) || (Offset >= Length) || (Body[Offset] > (0x7F - 0x03)))
+    {
+        return Length;
+    }
+
+    uint8_t PropertyLength = Body[Offset];
+    uint16_t Tail = Length - Offset - 0x01;
+
+    // Known topic: Remove the topic and add the alias property
+    Alias = this->_mTopicAliases.Lookup((const char*)Body + sizeof(TopicLength), TopicLength);
+    if(Alias)
+    {
+        memmove(Body + sizeof(TopicLength), Body + sizeof(TopicLength) + TopicLength, IDLength);
+        memmove(Body + sizeof(TopicLength) + IDLength + 0x04, Body + Offset + 0x01, Tail);
+        Body[0] = 0x00;
+        Body[1] = 0x00;
+        Body[sizeof(TopicLength) + IDLength] = PropertyLength + 0x03;
+        Body[sizeof(TopicLength) + IDLength + 0x01] = MQTT_PROPERTY_TOPIC_ALIAS;
+        Body[sizeof(TopicLength) + IDLength + 0x02] = Alias >> 0x08;
+        Body[sizeof(TopicLength) + IDLength + 0x03] = Alias & 0xFF;
+        MQTTThread::Add(&this->_mStatistics.TopicAliasBytesSaved, (int32_t)TopicLength - 0x03);
+
+        return Length - TopicLength + 0x03;
+    }
+
+    // New topic: Keep the topic and define the alias, when the packet is still small enough
+    if(((Length + 0x03) > (MQTT_BUFFER_SIZE - MQTT_FIXED_HEADER_SIZE)) || ((uint32_t)(Length + 0x03 + MQTT_FIXED_HEADER_SIZE) > this->_mServerMaximumPacketSize))
+    {
+        return Length;
+    }
+
+    Alias = this->_mTopicAliases.Assign((const char*)Body + sizeof(TopicLength), TopicLength);
+    if(Alias)
+    {
+        memmove(Body + Offset + 0x04, Body + Offset + 0x01, Tail);
+        Body[Offset] = PropertyLength + 0x03;
+        Body[Offset + 0x01] = MQTT_PROPERTY_TOPIC_ALIAS;
+        Body[Offset + 0x02] = Alias >> 0x08;
+        Body[Offset + 0x03] = Alias & 0xFF;
+        MQTTThread::Add(&this->_mStatistics.TopicAliasBytesSaved, -0x03);
+
+        return Length + 0x03;
+    }
+
+    return Length;
+}
+
+MQTT::Error MQTT::_publishAcknowledge(uint16_t ID)
+{
+    uint8_t Temp[4];
+
+    if(!this->isConnected())
+    {
+        return NOT_CONNECTED;
+    }
+
+    Temp[0] = (PUBACK << 0x04);
+    Temp[1] = 0x02;
+    Temp[2] = (ID >> 0x08);
+    Temp[3] = (ID & 0xFF);
+
+    return this->_writeControl(Temp, sizeof(Temp));
+}
+
+MQTT::Error MQTT::_publishReceived(uint16_t ID)
+{
+    uint8_t Temp[4];
+
+    if(!this->isConnected())
+    {
+        return NOT_CONNECTED;
+    }
+
+    Temp[0] = (PUBREC << 0x04);
+    Temp[1] = 0x02;
+    Temp[2] = (ID >> 0x08);
+    Temp[3] = (ID & 0xFF);
+                        
+    return this->_writeControl(Temp, sizeof(Temp));
+}
+
+MQTT::Error MQTT::_publishRelease(uint16_t ID)
+{
+    uint8_t Temp[4];
+
+    if(!this->isConnected())
+    {
+        return NOT_CONNECTED;
+    }
+
+    Temp[0] = (PUBREL << 0x04) | (0x01 << 0x01);
+    Temp[1] = 0x02;
+    Temp[2] = (ID >> 0x08);
+    Temp[3] = (ID & 0xFF);
+
+    return this->_writeControl(Temp, sizeof(Temp));
+}
+
+MQTT::Error MQTT::_publishComplete(uint16_t ID)
+{
+    uint8_t Temp[4];
+
+    if(!this->isConnected())
+    {
+        return NOT_CONNECTED;
+    }
+
+    Temp[0] = (PUBCOMP << 0x04) | (0x01 << 0x01);
+    Temp[1] = 0x02;
+    Temp[2] = (ID >> 0x08);
+    Temp[3] = (ID & 0xFF);
+
+    return this->_writeControl(Temp, sizeof(Temp));
+}
+
+void MQTT::_init(IPAddress IP, uint16_t Port, uint16_t KeepAlive, const Publish_Delegate& Callback)
+{
+    this->_mIP = IP;
+    this->_mPort = Port;
+    this->_mKeepAlive = KeepAlive;
+    this->_mCallback = Callback;
+    this->_mCurrentMessageID = 0x01;
+    this->_mProtocolVersion = MQTT_VERSION;
+    this->_mVersion = MQTT_VERSION;
+    this->_mReasonCode = REASON_SUCCESS;
+    this->_mServerReceiveMaximum = 0xFFFF;
+    this->_mServerMaximumPacketSize = 0xFFFFFFFF;
+    this->_resetInFlight();
+    this->_mBufferPriority = PRIORITY_HIGH;
+    this->_mUnsentLength = 0x00;
+    this->_mUnsentOffset = 0x00;
+    this->_mDrained = false;
+    this->_mDiagnosticsTopic = NULL;
+    this->_mDiagnosticsInterval = 0x00;
+    this->_mLastDiagnostics = 0x00;
+    this->_mStallThreshold = 0x00;
+    this->_mStatistics.TopicAliasBytesSaved = 0x00;
+    this->_mStatistics.CompressionAttempts = 0x00;
+    this->_mStatistics.CompressedMessages = 0x00;
+    this->_mStatistics.CompressionInputBytes = 0x00;
+    this->_mStatistics.CompressionOutputBytes = 0x00;
+    this->_mStatistics.CompressionTime = 0x00;
+    this->_mStatistics.ConflatedMessages = 0x00;
+    this->_mStatistics.FilteredMessages = 0x00;
+    this->_mStatistics.DeadlineMisses[PRIORITY_CONTROL] = 0x00;
+    this->_mStatistics.DeadlineMisses[PRIORITY_HIGH] = 0x00;
+    this->_mStatistics.DeadlineMisses[PRIORITY_BULK] = 0x00;
+    this->_mStatistics.ExpiredMessages = 0x00;
+    this->_mStatistics.DroppedMessages = 0x00;
+    this->_mCompression = false;
+    this->_mWaitForHostPing = false;
+    this->_mQueued = false;
+    this->_mReceiveQueued = false;
+    this->_mThreadMode = false;
+    this->_mPingDue = false;
+    this->_mThreadRunning = false;
+    this->_mThreadError = NO_ERROR;
+
+    // The heap tracking of the host build measures the allocations of the timer, too
+    MQTT_Heap Heap;
+    MQTT_HeapUsage(&Heap);
+    this->_mHeapBytes = Heap.Bytes;
+    this->_mPingTimer = new Timer(this->_mKeepAlive * 1000UL, &MQTT::_requestPing, *this);
+    MQTT_HeapUsage(&Heap);
+    this->_mHeapBytes = MQTT_HEAP_TRACKING ? (Heap.Bytes - this->_mHeapBytes) : sizeof(Timer);
+    this->_mPingTimer->stop();
+}
+
+MQTT::Error MQTT::_beginPublish(MQTT::QoS QoS, const char* Topic, uint16_t TopicLength, uint8_t** Buffer, MQTT::Packet** Packet)
+{
+    if(!MQTTFeatures::Supports(QoS))
+    {
+        return this->_error(INVALID_PARAMETER);
+    }
+
+    if(!this->isConnected())
+    {
+        return this->_error(NOT_CONNECTED);
+    }
+
+    // Messages, which are transmitted directly, wait for the unsent bytes of the last message
+    if(!this->_mThreadRunning && !this->_mQueued)
+    {
+        MQTT::Error Error = this->_flush();
+        if(Error != NO_ERROR)
+        {
+            return this->_error(Error);
+        }
+    }
+
+    *Buffer = this->_getPublishBuffer(Packet, Topic, TopicLength);
+    if(*Buffer == NULL)
+    {
+        return this->_error(BUFFER_OVERFLOW);
+    }
+
+    // Clear the buffer
+    memset(*Buffer, 0x00, MQTT_BUFFER_SIZE);
+
+    return NO_ERROR;
+}
+
+MQTT::Error MQTT::_publishFormatted(const char* Topic, uint16_t* ID, MQTT::QoS QoS, const char* Format, va_list Arguments)
+{
+    MQTT::CallScope Profile(this, MQTT_PROFILE_PUBLISH);
+    MQTT::Writer Writer;
+    MQTT::Error Error;
+
+    if(Format == NULL)
+    {
+        return INVALID_PARAMETER;
+    }
+
+    Error = this->BeginPublish(&Writer, Topic, QoS);
+    if(Error != NO_ERROR)
+    {
+        return Error;
+    }
+
+    // Format the payload behind the topic. The output is truncated when the buffer is too small
+    int Written = vsnprintf((char*)(Writer._mBuffer + Writer._mStart), MQTT_BUFFER_SIZE - Writer._mStart, Format, Arguments);
+    if((Written < 0x00) || (Written >= (MQTT_BUFFER_SIZE - Writer._mStart)))
+    {
+        Writer._mOverflow = true;
+    }
+    else
+    {
+        Writer._mPosition += Written;
+    }
+
+    return this->EndPublish(&Writer, ID, false);
+}
+
+uint16_t MQTT::_payloadOffset(uint16_t ByteOffset, MQTT::QoS QoS) const
+{
+    // Quality of service 1 and 2 need a packet identifier
+    if(MQTTFeatures::HasID(QoS))
+    {
+        ByteOffset += 0x02;
+    }
+
+    // MQTT 5 uses properties
+    if(this->_mVersion == MQTT_VERSION_5)
+    {
+        ByteOffset += 0x01;
+    }
+
+    return ByteOffset;
+}
+
+bool MQTT::_filterPublish(const uint8_t* Topic, const uint8_t* Payload, uint16_t Length, MQTT_Filter_Sample* Sample)
+{
+    Sample->Index = -1;
+
+    if(!this->_mFilter.isActive())
+    {
+        return true;
+    }
+
+    if(this->_mFilter.Check((const char*)Topic + 0x02, ((uint16_t)Topic[0] << 0x08) | Topic[1], Payload, Length, millis(), Sample))
+    {
+        return true;
+    }
+
+    MQTTThread::Add(&this->_mStatistics.FilteredMessages, 0x01);
+
+    return false;
+}
+
+void MQTT::_discardPacket(MQTT::Packet* Packet)
 {
-    return this->Publish(Topic, Payload, Length, ID, QoS, Retain, false);
+    int16_t Staged;
+
+    if(Packet == NULL)
+    {
+        return;
+    }
+
+    // A staging message of the conflation table isn't part of a queue. Discarded packets have no length
+    Staged = this->_mConflation.IndexOf(Packet);
+    if(Staged >= 0x00)
+    {
+        this->_mConflation.Unstage(Staged);
+    }
+    else
+    {
+        Packet->Length = 0x00;
+        Packet->Slot = 0x00;
+        this->_commitPacket(Packet);
+    }
 }
 
-MQTT::Error MQTT::Publish(const char* Topic, const uint8_t* Payload, uint16_t Length, uint16_t* ID, MQTT::QoS QoS, bool Retain, bool DUP)
+MQTT::Error MQTT::_finishPublish(uint8_t* Buffer, MQTT::Packet* Packet, uint16_t ByteOffset, const uint8_t* Payload, uint16_t Length, uint16_t* ID, MQTT::QoS QoS, bool Retain, bool DUP)
 {
     uint8_t Flags = 0x00;
-    uint16_t ByteOffset = MQTT_FIXED_HEADER_SIZE;
+    MQTT::Error Error;
+    MQTT_Filter_Sample Sample;
+    uint16_t PayloadOffset = this->_payloadOffset(ByteOffset, QoS);
+    bool Escape = this->_mCompression && MQTT_NeedsEscape((Payload != NULL) ? Payload : Buffer + PayloadOffset, Length);
 
-    if((Payload == NULL) || ((Length - MQTT_FIXED_HEADER_SIZE - 2) > MQTT_BUFFER_SIZE)) 
+    // Skip messages without a relevant change. The payload of a writer is already in place. Skipped messages have no message ID
+    if(!this->_filterPublish(Buffer + MQTT_FIXED_HEADER_SIZE, (Payload != NULL) ? Payload : Buffer + PayloadOffset, Length, &Sample))
     {
-        return INVALID_PARAMETER;
+        this->_discardPacket(Packet);
+
+        if(ID != NULL)
+        {
+            *ID = 0x00;
+        }
+
+        return NO_ERROR;
     }
 
-    if(this->isConnected())
+    // Uncompressed payloads, which look like a compressed payload, need space for the escape marker
+    if(Escape && ((uint32_t)(PayloadOffset + MQTT_COMPRESSION_ESCAPE_SIZE + Length) > MQTT_BUFFER_SIZE))
     {
-        // Clear the buffer
-        memset(this->_mBuffer, 0x00, MQTT_BUFFER_SIZE);
+        this->_discardPacket(Packet);
 
-        // Copy the topic into the buffer
-        this->_copyString(Topic, &ByteOffset);
+        return this->_error(BUFFER_OVERFLOW);
+    }
+
+    // Quality of service 1 and 2 need a packet identifier
+    if(MQTTFeatures::HasID(QoS))
+    {
+        uint16_t MessageID = this->_getID();
 
-        // Quality of service 1 and 2 need a packet identifier
-        if((QoS == MQTT::QOS_1) || (QoS == MQTT::QOS_2))
+        // MQTT 5 brokers limit the number of unacknowledged QoS 1 and QoS 2 messages
+        if(!this->_acquireInFlight(MessageID))
         {
-            this->_mBuffer[ByteOffset++] = (this->_mCurrentMessageID >> 0x08);
-            this->_mBuffer[ByteOffset++] = (this->_mCurrentMessageID & 0xFF);
+            this->_discardPacket(Packet);
 
-            if(ID != NULL)
-            {
-                *ID = this->_mCurrentMessageID;
+            return this->_error(FLOW_CONTROL);
+        }
 
-                this->_increaseID();
-            }
+        Buffer[ByteOffset++] = (MessageID >> 0x08);
+        Buffer[ByteOffset++] = (MessageID & 0xFF);
+
+        if(ID != NULL)
+        {
+            *ID = MessageID;
         }
+    }
+
+    // MQTT 5 uses properties. No properties are used yet
+    if(this->_mVersion == MQTT_VERSION_5)
+    {
+        Buffer[ByteOffset++] = 0x00;
+    }
+
+    // Compress large payloads. The payload of a writer is already in the buffer, but the compressor needs a separate input.
+    // It is copied into a buffer from the pool and isn't compressed when no buffer is free
+    MQTTBuffer Input;
+    if(this->_mCompression && (Length >= MQTT_COMPRESSION_THRESHOLD) && ((Payload != NULL) || (Input = this->_mPool.Allocate()).isValid()))
+    {
+        uint32_t Start = micros();
+        MQTT::PhaseScope Phase(this, MQTT_PHASE_COMPRESSION);
 
-        // Copy the payload into the buffer
-        for(uint16_t i = 0x00; i < Length; i++)
+        if(Payload == NULL)
         {
-            this->_mBuffer[ByteOffset++] = Payload[i];
+            memcpy(Input.Data(), Buffer + ByteOffset, Length);
+            Payload = Input.Data();
         }
 
-        // Save the retain status
-        Flags |= (Retain << 0x00);
+        uint16_t Compressed = MQTT_Compress(Payload, Length, Buffer + ByteOffset, MQTT_BUFFER_SIZE - ByteOffset);
 
-        // Save the DUP status
-        Flags |= (DUP << 0x03);
+        MQTTThread::Add(&this->_mStatistics.CompressionTime, micros() - Start);
+        MQTTThread::Add(&this->_mStatistics.CompressionAttempts, 0x01);
+        MQTTThread::Add(&this->_mStatistics.CompressionInputBytes, Length);
+        if(Compressed > 0x00)
+        {
+            MQTTThread::Add(&this->_mStatistics.CompressedMessages, 0x01);
+            Payload = NULL;
+            Length = Compressed;
+            Escape = false;
+        }
+        MQTTThread::Add(&this->_mStatistics.CompressionOutputBytes, Length);
+    }
 
-        // Save the quality of service
-        Flags |= (uint8_t)((QoS & 0x03) << 0x01);
+    // Escape uncompressed payloads, so a receiver with enabled compression doesn't decompress them
+    if(Escape)
+    {
+        if(Payload == NULL)
+        {
+            memmove(Buffer + ByteOffset + MQTT_COMPRESSION_ESCAPE_SIZE, Buffer + ByteOffset, Length);
+        }
 
-        // Transmit the buffer
-        return this->_writeMessage(PUBLISH, Flags, ByteOffset - MQTT_FIXED_HEADER_SIZE);
+        memcpy(Buffer + ByteOffset, MQTT_COMPRESSION_ESCAPE, MQTT_COMPRESSION_ESCAPE_SIZE);
+        ByteOffset += MQTT_COMPRESSION_ESCAPE_SIZE;
     }
 
-    return NOT_CONNECTED;
-}
+    // Copy the payload into the buffer. The payload is already in place when it was written by a writer
+    if(Payload != NULL)
+    {
+        memcpy(Buffer + ByteOffset, Payload, Length);
+    }
+    ByteOffset += Length;
 
-MQTT::Error MQTT::Subscribe(const char* Topic)
-{
-    return this->Subscribe(Topic, QOS_0);
-}
+    // Save the retain status
+    Flags |= (Retain << 0x00);
 
-MQTT::Error MQTT::Subscribe(const char* Topic, MQTT::QoS QoS)
-{
-    uint16_t Length = MQTT_FIXED_HEADER_SIZE;
+    // Save the DUP status
+    Flags |= (DUP << 0x03);
 
-    if(Topic == NULL)
+    // Save the quality of service
+    Flags |= (uint8_t)((QoS & 0x03) << 0x01);
+
+    // Transmit the buffer. Queued messages are passed to the filter by the transmission
+    if(Packet != NULL)
     {
-        return INVALID_PARAMETER;
+        Packet->Filter = Sample;
     }
 
-    if(this->isConnected())
+    Error = this->_writeMessage(Buffer, Packet, PUBLISH, Flags, ByteOffset - MQTT_FIXED_HEADER_SIZE);
+    if((Packet == NULL) && (Error == NO_ERROR))
     {
-        // Set the message ID
-        this->_mBuffer[Length++] = (this->_mCurrentMessageID >> 0x08);
-        this->_mBuffer[Length++] = (this->_mCurrentMessageID & 0xFF);
-        this->_increaseID();
+        this->_mFilter.Commit(&Sample, millis());
+    }
 
-        // Copy the topic into the buffer
-        this->_copyString(Topic, &Length);
+    return Error;
+}
 
-        // Write the QoS into the buffer
-        this->_mBuffer[Length++] = (uint8_t)QoS;
+bool MQTT::_copyString(uint8_t* Buffer, const char* String, uint16_t* Offset)
+{
+    size_t StringLength = strlen(String);
 
-        // Transmit the buffer
-        return this->_writeMessage(SUBSCRIBE, (0x01 << 0x01), Length - MQTT_FIXED_HEADER_SIZE);
+    if(StringLength > MQTT_BUFFER_SIZE)
+    {
+        return false;
     }
 
-    return NOT_CONNECTED;
+    return this->_copyString(Buffer, String, StringLength, Offset);
 }
 
-MQTT::Error MQTT::Unsubscribe(const char* Topic)
+bool MQTT::_copyString(uint8_t* Buffer, const char* String, uint16_t Length, uint16_t* Offset)
 {
-    uint16_t Length = MQTT_FIXED_HEADER_SIZE;
-
-    if(Topic == NULL)
+    // The string is rejected instead of truncated, because the length prefix must match the string
+    if((uint32_t)(*Offset + 0x02 + Length) > MQTT_BUFFER_SIZE)
     {
-        return INVALID_PARAMETER;
+        return false;
     }
 
-    if(this->isConnected())
-    {
-        // Set the message ID
-        this->_mBuffer[Length++] = (this->_mCurrentMessageID >> 0x08);
-        this->_mBuffer[Length++] = (this->_mCurrentMessageID & 0xFF);
-        this->_increaseID();
+    // Set the length of the string
+    Buffer[(*Offset)++] = (Length >> 0x08);
+    Buffer[(*Offset)++] = (Length & 0xFF);
 
-        // Copy the topic into the buffer
-        this->_copyString(Topic, &Length);
+    // Copy the string into the transmit buffer
+    memcpy(Buffer + *Offset, String, Length);
+    *Offset += Length;
 
-        // Transmit the buffer
-        if(this->_writeMessage(UNSUBSCRIBE, (0x01 << 0x01), Length - MQTT_FIXED_HEADER_SIZE))
+    return true;
+}
+
+bool MQTT::_acquireInFlight(uint16_t ID)
+{
+    uint16_t Limit = (this->_mServerReceiveMaximum < MQTT_INFLIGHT_SIZE) ? this->_mServerReceiveMaximum : MQTT_INFLIGHT_SIZE;
+    uint16_t InFlight = this->_mInFlight;
+
+    // Count the message first, so concurrent producers can't exceed the Receive Maximum of the broker
+    do
+    {
+        if(InFlight >= Limit)
         {
-            return TRANSMISSION_ERROR;
+            return false;
         }
+    } while(!this->_mInFlight.compare_exchange_weak(InFlight, InFlight + 0x01));
 
-        return NO_ERROR;
+    for(uint8_t i = 0x00; i < MQTT_INFLIGHT_SIZE; i++)
+    {
+        uint16_t Expected = 0x00;
+
+        if(this->_mInFlightIDs[i].compare_exchange_strong(Expected, ID))
+        {
+            return true;
+        }
     }
 
-    return NOT_CONNECTED;
-}
+    this->_mInFlight--;
 
-uint8_t MQTT::_readByte(void)
-{
-    while(!this->_mClient.available());
-    return this->_mClient.read();
+    return false;
 }
 
-MQTT::Error MQTT::_readMessage(uint16_t* FixedHeaderSize, uint16_t* Bytes)
+bool MQTT::_releaseInFlight(uint16_t ID)
 {
-    uint8_t EncodedByte = 0x00;
-    uint16_t ReceivedBytes = 0x00;
-    uint16_t RemainingLength = 0x00;
-    uint32_t Packet = 0x01;
-
-    // Get the fixed header
-    this->_mBuffer[ReceivedBytes++] = this->_readByte();
-    do
+    if(ID == 0x00)
     {
-        EncodedByte = this->_readByte();
-        this->_mBuffer[ReceivedBytes++] = EncodedByte;
-        RemainingLength += (EncodedByte & 0x7F) * Packet;
-        Packet <<= 0x07;
-    } while(EncodedByte & (0x01 << 0x07));
-    *FixedHeaderSize = ReceivedBytes;
+        return false;
+    }
 
-    if((ReceivedBytes + RemainingLength) > MQTT_BUFFER_SIZE)
+    for(uint8_t i = 0x00; i < MQTT_INFLIGHT_SIZE; i++)
     {
-        return BUFFER_OVERFLOW;
+        uint16_t Expected = ID;
+
+        if(this->_mInFlightIDs[i].compare_exchange_strong(Expected, 0x00))
+        {
+            this->_mInFlight--;
+
+            return true;
+        }
     }
 
-    // Get the remaining message
-    for(uint16_t i = 0x00; i < RemainingLength; i++)
+    return false;
+}
+
+void MQTT::_resetInFlight(void)
+{
+    for(uint8_t i = 0x00; i < MQTT_INFLIGHT_SIZE; i++)
     {
-        this->_mBuffer[ReceivedBytes++] = this->_readByte();
+        this->_mInFlightIDs[i] = 0x00;
     }
 
-    *Bytes = ReceivedBytes;
+    this->_mInFlight = 0x00;
+}
 
-    return NO_ERROR;
+uint16_t MQTT::_publishID(const uint8_t* Buffer) const
+{
+    const uint8_t* Body = Buffer + MQTT_FIXED_HEADER_SIZE;
+    uint16_t TopicLength = (Body[0] << 0x08) | Body[1];
+
+    return (Body[sizeof(TopicLength) + TopicLength] << 0x08) | Body[sizeof(TopicLength) + TopicLength + 0x01];
 }
 
-MQTT::Error MQTT::_writeMessage(MQTT::ControlPacket ControlPacket, uint8_t Flags, uint16_t Length)
+uint16_t MQTT::_getID(void)
 {
-    uint16_t Remaining = Length;
-    uint8_t EncodedBytes[4];
-    uint8_t SizeBytes = 0x00;
-    uint8_t TransmissionLength = 0x00;
+    uint16_t ID;
 
-    // Encode the length of the message
+    // Zero isn't a valid message ID
     do
     {
-        uint8_t EncodedByte = Remaining % 0x80;
-        Remaining = Remaining >> 0x07;
-        if(Remaining > 0x00)
+        ID = this->_mCurrentMessageID.fetch_add(0x01);
+    } while(ID == 0x00);
+
+    return ID;
+}
+
+void MQTT::_sendPing(void)
+{
+    if(this->isConnected())
+    {
+        // Are we already waiting for a ping from the host?
+        if(this->_mWaitForHostPing)
         {
-            EncodedByte |= 0x80;
+            MQTTTrace::Emit(MQTT_TRACE_KEEPALIVE_TIMEOUT, 0x00, 0x00);
+            this->_mClient.stop();
         }
 
-        EncodedBytes[SizeBytes++] = EncodedByte;
-    } while(Remaining > 0x00);
+        // Send new ping
+        uint8_t Temp[2] = {(PINGREQ << 0x04), 0x00};
+        this->_writeControl(Temp, sizeof(Temp));
+        this->_mWaitForHostPing = true;
+    }
+}
 
-    // Store the header and the flags for the fixed header
-    this->_mBuffer[MQTT_FIXED_HEADER_SIZE - SizeBytes - 0x01] = (ControlPacket << 0x04) | (Flags & 0x0F);
+void MQTT::_requestPing(void)
+{
+    this->_mPingDue = true;
+}
 
-    // Copy the encoded length
-    for(uint8_t i = 0x00; i < SizeBytes; i++)
+void MQTT::_stopThread(void)
+{
+    if(!this->_mThreadRunning)
     {
-        this->_mBuffer[MQTT_FIXED_HEADER_SIZE - SizeBytes + i] = EncodedBytes[i];
+        return;
     }
 
-    TransmissionLength = Length + SizeBytes + 0x01;
-    if(_mClient.write(this->_mBuffer + (MQTT_FIXED_HEADER_SIZE - SizeBytes - 0x01), TransmissionLength) != TransmissionLength)
-    {
-        return TRANSMISSION_ERROR;
-    }
+    this->_mThreadRunning = false;
+    this->_mThread.Join();
 
-    return NO_ERROR;
+    // Messages, which were received by the thread, are dispatched here, because #Poll doesn't read the queue anymore
+    this->_dispatchInbound();
 }
 
-MQTT::Error MQTT::_publishAcknowledge(uint16_t ID)
+void MQTT::_dispatchInbound(void)
 {
-    uint8_t Temp[4];
+    MQTT::Message* Message;
 
-    if(!this->isConnected())
+    while(!this->_mReceiveQueued && ((Message = this->_mInbound.Peek()) != NULL))
     {
-        return NOT_CONNECTED;
-    }
+        if(this->_mCallback.isValid())
+        {
+            MQTT::PhaseScope Phase(this, MQTT_PHASE_DISPATCH);
 
-    Temp[0] = (PUBACK << 0x04);
-    Temp[1] = 0x02;
-    Temp[2] = (ID >> 0x08);
-    Temp[3] = (ID & 0xFF);
+            this->_mDispatchBuffer = Message->Buffer;
+            this->_mCallback(Message->TopicLength, Message->Topic, Message->PayloadLength, Message->Payload, Message->ID, Message->QoS, Message->DUP);
+            this->_mDispatchBuffer.Release();
+        }
 
-    if(this->_mClient.write(Temp, sizeof(Temp)) != sizeof(Temp))
-    {
-        return TRANSMISSION_ERROR;
+        MQTTTrace::Emit(MQTT_TRACE_DEQUEUE, MQTT_TRACE_QUEUE_INBOUND, Message->PayloadLength);
+        Message->Buffer.Release();
+        this->_mInbound.Release();
     }
-
-    return NO_ERROR;
 }
 
-MQTT::Error MQTT::_publishReceived(uint16_t ID)
+void MQTT::_threadLoop(void)
 {
-    uint8_t Temp[4];
-
-    if(!this->isConnected())
+    while(this->_mThreadRunning)
     {
-        return NOT_CONNECTED;
-    }
+        MQTT::Error Error = NO_ERROR;
 
-    Temp[0] = (PUBREC << 0x04);
-    Temp[1] = 0x02;
-    Temp[2] = (ID >> 0x08);
-    Temp[3] = (ID & 0xFF);
-                        
-    if(this->_mClient.write(Temp, sizeof(Temp)) != sizeof(Temp))
-    {
-        return TRANSMISSION_ERROR;
-    }
+        if(!this->isConnected())
+        {
+            this->_mThreadError = NOT_CONNECTED;
+            MQTTThread::Sleep();
 
-    return NO_ERROR;
-}
+            continue;
+        }
 
-MQTT::Error MQTT::_publishRelease(uint16_t ID)
-{
-    uint8_t Temp[4];
+        this->_publishDiagnostics();
 
-    if(!this->isConnected())
-    {
-        return NOT_CONNECTED;
-    }
+        // Transmit the messages from the application
+        Error = this->_transmitQueue();
 
-    Temp[0] = (PUBREL << 0x04) | (0x01 << 0x01);
-    Temp[1] = 0x02;
-    Temp[2] = (ID >> 0x08);
-    Temp[3] = (ID & 0xFF);
+        // Handle the keep-alive
+        if((millis() - this->_mLastPing) >= (this->_mKeepAlive * 1000UL))
+        {
+            this->_mLastPing = millis();
+            this->_sendPing();
+        }
+
+        // Process the messages from the broker
+        if(this->_mClient.available())
+        {
+            MQTT::Error ReceiveError = this->_receive();
+            if(ReceiveError)
+            {
+                Error = ReceiveError;
+            }
+        }
+        else
+        {
+            MQTTThread::Sleep();
+        }
+
+        if(Error)
+        {
+            this->_mThreadError = Error;
+        }
+    }
 
-    if(this->_mClient.write(Temp, sizeof(Temp)) != sizeof(Temp))
+    // Transmit the remaining messages. The queue is kept for the next connection when the connection is lost
+    if(this->isConnected())
     {
-        return TRANSMISSION_ERROR;
+        this->_transmitQueue();
     }
+}
 
-    return NO_ERROR;
+void MQTT::_threadEntry(void* Parameter)
+{
+    ((MQTT*)Parameter)->_threadLoop();
 }
 
-MQTT::Error MQTT::_publishComplete(uint16_t ID)
+MQTT::Writer::Writer(void) : _mBuffer(NULL), _mPacket(NULL), _mQoS(MQTT::QOS_0), _mTopicEnd(0x00), _mStart(0x00), _mPosition(0x00), _mOverflow(false)
 {
-    uint8_t Temp[4];
+}
 
-    if(!this->isConnected())
+size_t MQTT::Writer::write(uint8_t Data)
+{
+    return this->write(&Data, 0x01);
+}
+
+size_t MQTT::Writer::write(const uint8_t* Data, size_t Length)
+{
+    if((this->_mBuffer == NULL) || this->_mOverflow)
     {
-        return NOT_CONNECTED;
+        return 0x00;
     }
 
-    Temp[0] = (PUBCOMP << 0x04) | (0x01 << 0x01);
-    Temp[1] = 0x02;
-    Temp[2] = (ID >> 0x08);
-    Temp[3] = (ID & 0xFF);
-
-    if(this->_mClient.write(Temp, sizeof(Temp)) != sizeof(Temp))
+    // The payload is discarded when it doesn't fit into the buffer
+    if((this->_mPosition + Length) > MQTT_BUFFER_SIZE)
     {
-        return TRANSMISSION_ERROR;
+        this->_mOverflow = true;
+
+        return 0x00;
     }
 
-    return NO_ERROR;
+    memcpy(this->_mBuffer + this->_mPosition, Data, Length);
+    this->_mPosition += Length;
+
+    return Length;
 }
 
-void MQTT::_init(IPAddress IP, uint16_t Port, uint16_t KeepAlive, Publish_Callback Callback)
+bool MQTT::Writer::isValid(void) const
 {
-    this->_mIP = IP;
-    this->_mPort = Port;
-    this->_mKeepAlive = KeepAlive;
-    this->_mCallback = Callback;
-
-    this->_mPingTimer = new Timer(this->_mKeepAlive * 1000UL, &MQTT::_sendPing, *this);
-    this->_mPingTimer->stop();
+    return !this->_mOverflow;
 }
 
-void MQTT::_copyString(const char* String, uint16_t* Offset)
+uint16_t MQTT::Writer::Length(void) const
 {
-    uint16_t StringLength = 0x00;
-    uint16_t Temp_Offset = *Offset;
-
-    // Skip the two size bytes
-    Temp_Offset += 0x02;
+    return this->_mPosition - this->_mStart;
+}
 
-    // Copy each character from the string into the transmit buffer
-    while(*String && (Temp_Offset < MQTT_BUFFER_SIZE))
+uint8_t* MQTT::Writer::Buffer(void) const
+{
+    if((this->_mBuffer == NULL) || this->_mOverflow)
     {
-        _mBuffer[Temp_Offset++] = *String++;
-        StringLength++;
+        return NULL;
     }
 
-    // Set the length of the string
-    _mBuffer[Temp_Offset - StringLength - 0x01] = (StringLength & 0xFF);
-    _mBuffer[Temp_Offset - StringLength - 0x02] = (StringLength >> 0x08);
-
-    // Write the new offset
-    *Offset = Temp_Offset;
+    return this->_mBuffer + this->_mPosition;
 }
 
-void MQTT::_increaseID(void)
+uint16_t MQTT::Writer::Available(void) const
 {
-    if(this->_mCurrentMessageID == 0x00)
-    {
-        this->_mCurrentMessageID = 0x01;
-    }
-    else
+    if((this->_mBuffer == NULL) || this->_mOverflow)
     {
-       this->_mCurrentMessageID++;
+        return 0x00;
     }
+
+    return MQTT_BUFFER_SIZE - this->_mPosition;
 }
 
-void MQTT::_sendPing(void)
+bool MQTT::Writer::Advance(uint16_t Length)
 {
-    if(this->isConnected())
+    if((this->_mBuffer == NULL) || this->_mOverflow || (Length > this->Available()))
     {
-        // Are we already waiting for a ping from the host?
-        if(this->_mWaitForHostPing)
-        {
-            this->_mClient.stop();
-        }
+        this->_mOverflow = true;
 
-        // Send new ping
-        this->_mBuffer[0] = (PINGREQ << 0x04);
-        this->_mBuffer[1] = 0x00;
-        this->_mClient.write(this->_mBuffer, 0x02);
-        this->_mWaitForHostPing = true;
+        return false;
     }
+
+    this->_mPosition += Length;
+
+    return true;
 }
\ No newline at end of file
@@ -23,17 +23,42 @@
  */
 
 /** @file MQTT/MQTT.h
- *  @brief MQTT 3.1.1 implementation for the Particle IoT Argon.
+ *  @brief MQTT 3.1.1 and MQTT 5.0 implementation for the Particle IoT Argon.
  *		   Please read 
  *			- http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Table_2.6_-
+ *			- https://docs.oasis-open.org/mqtt/mqtt/v5.0/os/mqtt-v5.0-os.html
  *		   when you need more information.
  *
  *  @author Daniel Kampert
  *  @bug - Improve code to support larger messages than 256 bytes (needs a lot of rework :/)
  */
 
+#include <stdarg.h>
+
 #include "application.h"
 
+#include "mqtt_alias.h"
+#include "mqtt_buffer.h"
+#include "mqtt_capture.h"
+#include "mqtt_cbor.h"
+#include "mqtt_compression.h"
+#include "mqtt_conflation.h"
+#include "mqtt_deadline.h"
+#include "mqtt_delegate.h"
+#include "mqtt_features.h"
+#include "mqtt_filter.h"
+#include "mqtt_footprint.h"
+#include "mqtt_latency.h"
+#include "mqtt_metrics.h"
+#include "mqtt_profile.h"
+#include "mqtt_properties.h"
+#include "mqtt_queue.h"
+#include "mqtt_ratelimit.h"
+#include "mqtt_span.h"
+#include "mqtt_thread.h"
+#include "mqtt_topic.h"
+#include "mqtt_trace.h"
+
 class MQTT
 {
     public:
@@ -45,14 +70,94 @@ class MQTT
          */
         #define MQTT_DEFAULT_PORT                       1883
 
-        /** @brief MQTT version for the client.
+        /** @brief Constant for MQTT version 3.1.
+         */
+        #define MQTT_VERSION_3_1                        0x03
+
+        /** @brief Constant for MQTT version 3.1.1.
+         */
+        #define MQTT_VERSION_3_1_1                      0x04
+
+        /** @brief Constant for MQTT version 5.0.
          */
-        #define MQTT_VERSION                            MQTT_VERSION_3_1_1
+        #define MQTT_VERSION_5                          0x05
+
+        /** @brief Default MQTT version for the client. Use #SetProtocolVersion to change the version at runtime.
+         */
+        #ifndef MQTT_VERSION
+            #define MQTT_VERSION                        MQTT_VERSION_3_1_1
+        #endif
 
         /** @brief Size of the transceive buffer.
          */
         #define MQTT_BUFFER_SIZE                        256
 
+        /** @brief Number of messages in the inbound queue. Must be a power of two.
+         *         The inbound queue, the buffer pool and the inbound topic aliases are removed without #MQTT_FEATURE_INBOUND.
+         */
+        #ifndef MQTT_QUEUE_SIZE
+            #define MQTT_QUEUE_SIZE                     4
+        #endif
+
+        /** @brief Number of messages in the outbound queue. Must be a power of two.
+         *         Use 0 to remove the queue, when only direct publishing is used (no #SetPublishQueue and no I/O thread).
+         */
+        #ifndef MQTT_OUTBOUND_QUEUE_SIZE
+            #define MQTT_OUTBOUND_QUEUE_SIZE            MQTT_QUEUE_SIZE
+        #endif
+
+        /** @brief Number of messages in the outbound queue for bulk messages. Must be a power of two.
+         *         Bulk messages use the outbound queue when the size is 0.
+         */
+        #ifndef MQTT_BULK_QUEUE_SIZE
+            #define MQTT_BULK_QUEUE_SIZE                0
+        #endif
+
+        /** @brief Number of acknowledgements and pings, which wait for the transmission when the control class is rate limited. Must be a power of two.
+         */
+        #ifndef MQTT_CONTROL_QUEUE_SIZE
+            #define MQTT_CONTROL_QUEUE_SIZE             8
+        #endif
+
+        /** @brief Number of QoS 1 and QoS 2 messages, which can wait for the acknowledgement at the same time.
+         *         The acknowledgements are matched by the packet identifier. Publishing returns #FLOW_CONTROL when all are in use.
+         */
+        #ifndef MQTT_INFLIGHT_SIZE
+            #define MQTT_INFLIGHT_SIZE                  16
+        #endif
+
+        /** @brief Number of reference-counted receive buffers.
+         */
+        #ifndef MQTT_BUFFER_POOL_SIZE
+            #define MQTT_BUFFER_POOL_SIZE               MQTT_QUEUE_SIZE
+        #endif
+
+        /** @brief Time in ms, which the client waits for the next byte of a partially received message.
+         *         The connection is closed when the broker doesn't send the rest of the message in time.
+         */
+        #ifndef MQTT_READ_TIMEOUT
+            #define MQTT_READ_TIMEOUT                   5000
+        #endif
+
+        /** @brief Smallest payload, which is compressed when the compression is enabled.
+         */
+        #ifndef MQTT_COMPRESSION_THRESHOLD
+            #define MQTT_COMPRESSION_THRESHOLD          64
+        #endif
+
+        /** @brief Number of topics, which can be conflated (see #Conflate). Each topic needs two message buffers.
+         *         The conflation is removed when the size is 0.
+         */
+        #ifndef MQTT_CONFLATION_SIZE
+            #define MQTT_CONFLATION_SIZE                0
+        #endif
+
+        /** @brief Deadline in ms for queued messages without a deadline. Messages with an earlier deadline are transmitted first.
+         */
+        #ifndef MQTT_DEFAULT_DEADLINE
+            #define MQTT_DEFAULT_DEADLINE               10000
+        #endif
+
         /** @brief MQTT error codes.
          */
         typedef enum
@@ -66,6 +171,8 @@ class MQTT
             TIMEOUT = 0x06,							            /**< Timeout while connecting with server. */
             BUFFER_OVERFLOW = 0x07,							    /**< Transmit / Receive buffer overflow. */
             HOST_UNREACHABLE = 0x08,						    /**< Host unreachable. Call #connectionState to get a more detailed message. */
+            FLOW_CONTROL = 0x09,						        /**< Receive maximum of the MQTT 5 broker or #MQTT_INFLIGHT_SIZE reached. Wait for the acknowledgements. */
+            WOULD_BLOCK = 0x0A,						            /**< The socket doesn't accept more data. Wait until #isWritable returns #true. */
         } Error;
 
         /** @brief MQTT quality of service classes.
@@ -77,6 +184,15 @@ class MQTT
             QOS_2 = 0x02,						                /**< Quality of Service 2 - Exactly one. */
         } QoS;
 
+        /** @brief MQTT outbound traffic classes. A class is only transmitted when no message of a higher class is waiting.
+         */
+        typedef enum
+        {
+            PRIORITY_CONTROL = 0x00,						    /**< Acknowledgements and pings. */
+            PRIORITY_HIGH = 0x01,						        /**< Application messages. Default for all topics, subscriptions and unsubscriptions. */
+            PRIORITY_BULK = 0x02,						        /**< Application messages, which can wait. */
+        } Priority;
+
         /** @brief MQTT connect return codes.
          */
         typedef enum
@@ -89,6 +205,34 @@ class MQTT
             NOT_AUTHORIZED = 0x05,							    /**< The Client is not authorized to connect. */
         } ConnectionState;
 
+        /** @brief MQTT 5 reason codes. Call #reasonCode to get the reason code of the last acknowledgement.
+         */
+        typedef enum
+        {
+            REASON_SUCCESS = 0x00,							    /**< Success. */
+            REASON_GRANTED_QOS_1 = 0x01,						/**< Subscription granted with QoS 1. */
+            REASON_GRANTED_QOS_2 = 0x02,						/**< Subscription granted with QoS 2. */
+            REASON_NO_MATCHING_SUBSCRIBERS = 0x10,				/**< The message is accepted but there are no subscribers. */
+            REASON_UNSPECIFIED_ERROR = 0x80,					/**< Unspecified error. All reason codes from here are errors. */
+            REASON_MALFORMED_PACKET = 0x81,						/**< The packet could not be parsed. */
+            REASON_PROTOCOL_ERROR = 0x82,						/**< Protocol error. */
+            REASON_IMPLEMENTATION_ERROR = 0x83,					/**< Implementation specific error. */
+            REASON_UNSUPPORTED_PROTOCOL = 0x84,					/**< The broker doesn't support the requested protocol version. */
+            REASON_CLIENT_ID_INVALID = 0x85,					/**< The client identifier is not allowed. */
+            REASON_BAD_USER_PASSWORD = 0x86,					/**< Bad user name or password. */
+            REASON_NOT_AUTHORIZED = 0x87,						/**< The client is not authorized. */
+            REASON_SERVER_UNAVAILABLE = 0x88,					/**< The broker is not available. */
+            REASON_SERVER_BUSY = 0x89,							/**< The broker is busy. */
+            REASON_TOPIC_NAME_INVALID = 0x90,					/**< The topic name is not accepted. */
+            REASON_PACKET_ID_IN_USE = 0x91,						/**< The packet identifier is already in use. */
+            REASON_PACKET_ID_NOT_FOUND = 0x92,					/**< The packet identifier is not known. */
+            REASON_RECEIVE_MAXIMUM_EXCEEDED = 0x93,				/**< The receive maximum was exceeded. */
+            REASON_TOPIC_ALIAS_INVALID = 0x94,					/**< The topic alias is not valid. */
+            REASON_PACKET_TOO_LARGE = 0x95,						/**< The packet exceeded the maximum packet size. */
+            REASON_QUOTA_EXCEEDED = 0x97,						/**< An implementation or administrative quota was exceeded. */
+            REASON_PAYLOAD_FORMAT_INVALID = 0x99,				/**< The payload doesn't match the payload format indicator. */
+        } ReasonCode;
+
         /** @brief MQTT will settings object.
          */
         typedef struct
@@ -108,6 +252,66 @@ class MQTT
             const uint16_t PasswordLength;						/**< Length of the user password. */
         } User;
 
+        /** @brief MQTT received message object. Used to hand messages from the receive queue to the application.
+         */
+        typedef struct
+        {
+            uint16_t TopicLength;							    /**< Length of the topic string. */
+            uint16_t PayloadLength;							    /**< Length of the payload. */
+            uint16_t ID;							            /**< Message ID. */
+            MQTT::QoS QoS;							            /**< Quality of service of the received message. */
+            bool DUP;							                /**< Received DUP flag. */
+            char* Topic;							            /**< Pointer to the topic string. */
+            char* Payload;							            /**< Pointer to the payload. */
+            MQTTBuffer Buffer;							        /**< Receive buffer with the topic and the payload. */
+        } Message;
+
+        /** @brief MQTT message timing. Used to schedule queued messages.
+         */
+        typedef struct
+        {
+            uint32_t Deadline;							        /**< Time in ms until the message should be transmitted. 0 for no deadline. */
+            uint32_t Expiry;							        /**< Time in ms until the message is dropped. 0 for no expiry. */
+        } Timing;
+
+        /** @brief MQTT client statistics.
+         */
+        typedef struct
+        {
+            int32_t TopicAliasBytesSaved;							/**< Transmitted bytes saved by MQTT 5 topic aliases. Includes the bytes for the alias definitions. */
+            uint32_t CompressionAttempts;							/**< Number of payloads passed to the compressor. */
+            uint32_t CompressedMessages;							/**< Number of payloads, which were transmitted compressed. */
+            uint32_t CompressionInputBytes;							/**< Payload bytes passed to the compressor. */
+            uint32_t CompressionOutputBytes;						/**< Transmitted payload bytes for these payloads. The ratio to #CompressionInputBytes is the compression ratio. */
+            uint32_t CompressionTime;							    /**< Time in the compressor in us. Divide by #CompressionAttempts for the cost per message. */
+            uint32_t ConflatedMessages;							    /**< Pending messages, which were replaced by a newer message with the same topic. */
+            uint32_t FilteredMessages;							    /**< Messages, which were skipped by the report-by-exception filter. */
+            uint32_t DeadlineMisses[3];							    /**< Messages, which were transmitted after their deadline. Indexed by #Priority. */
+            uint32_t ExpiredMessages;							    /**< Queued messages, which were dropped after their expiry. */
+            uint32_t DroppedMessages;							    /**< Received messages, which were acknowledged and dropped, because the receive queue was full, no buffer was free or the payload couldn't be decompressed. */
+        } Statistics;
+
+        /** @brief MQTT publish template. Holds a complete publish message with a fixed topic, QoS and payload length.
+         *         Use #PrepareTemplate to build the message and #Publish to transmit it.
+         *         NOTE: The template is modified during the transmission and must not be shared between threads!
+         */
+        typedef struct
+        {
+            uint16_t Offset;							        /**< Offset of the fixed header. */
+            uint16_t Length;							        /**< Length of the complete message. */
+            uint16_t IDOffset;							        /**< Offset of the message ID. */
+            uint16_t PayloadOffset;							    /**< Offset of the payload. */
+            uint16_t PayloadLength;							    /**< Length of the payload. */
+            MQTT::QoS QoS;							            /**< Quality of service of the message. */
+            uint8_t Version;							        /**< MQTT version of the message. */
+            uint8_t Data[MQTT_BUFFER_SIZE];							/**< Encoded message. */
+        } PublishTemplate;
+
+        /** @brief Writer for the payload of a publish message. The payload is written directly into the transmit buffer.
+         *         Use #BeginPublish to start and #EndPublish to transmit the message.
+         */
+        class Writer;
+
         /** @brief                  Publish received callback prototype.
          *  @param TopicLength      Length of the topic string
          *  @param Topic            Pointer to the topic string
@@ -118,16 +322,118 @@ class MQTT
          */
         typedef void(*Publish_Callback)(uint16_t TopicLength, char* Topic, uint16_t PayloadLength, char* Payload, uint16_t ID, MQTT::QoS QoS, bool DUP);
 
+        /** @brief Publish received callback delegate. Can hold a #Publish_Callback, a function with a context pointer,
+         *         a member function or a small functor without using the heap (see #MQTTDelegate).
+         *         Example: MQTT::Publish_Delegate::Bind<Handler, &Handler::OnPublish>(&MyHandler)
+         */
+        typedef MQTTDelegate<void(uint16_t TopicLength, char* Topic, uint16_t PayloadLength, char* Payload, uint16_t ID, MQTT::QoS QoS, bool DUP)> Publish_Delegate;
+
+        /** @brief Drain callback delegate. Called by #Poll or the I/O thread when the unsent bytes of a message were transmitted.
+         */
+        typedef MQTTDelegate<void(void)> Drain_Delegate;
+
+        /** @brief Stall callback delegate. Called after a call into the client, which took longer than the threshold.
+         *         Parameters: Call, longest phase of the call and duration of the call in us.
+         */
+        typedef MQTTDelegate<void(MQTT_Profile_Call Call, MQTT_Profile_Phase Phase, uint32_t Duration)> Stall_Delegate;
+
         /** @brief	Can be used to check the connection state of the TCP client.
          *  @return	#true when connected
          */
         bool isConnected(void);
 
+        /** @brief	Check if the socket took all bytes of the transmitted messages. The unsent bytes of a short write
+         *          are transmitted by #Poll or the I/O thread and messages, which are transmitted directly, are rejected
+         *          with #WOULD_BLOCK until then.
+         *  @return	#true when a message can be transmitted
+         */
+        bool isWritable(void) const;
+
+        /** @brief          Get a snapshot of the packet, byte and error counters and the queue depths.
+         *                  All values are 0 unless the metrics are enabled with #MQTT_METRICS.
+         *  @param Metrics  Pointer to the snapshot
+         */
+        void metrics(MQTT_Metrics* Metrics) const;
+
+        /** @brief Clear the packet, byte and error counters and the latency histograms.
+         */
+        void ResetMetrics(void);
+
+        /** @brief          Get the summary of a latency histogram. The delay is measured from the transmission of a packet
+         *                  to the acknowledgement from the broker.
+         *                  All values are 0 unless the metrics are enabled with #MQTT_METRICS.
+         *  @param Type     Round-trip
+         *  @param Latency  Pointer to the summary
+         */
+        void latency(MQTT_Latency_Type Type, MQTT_Latency* Latency);
+
+        /** @brief          Publish the summary of the latency histograms as JSON.
+         *                  Example: {"publish":{"n":12,"p50":31,"p99":96,"max":104},"subscribe":{...},"ping":{...}}
+         *  @param Topic    Diagnostics topic
+         *  @return         Error code
+         */
+        MQTT::Error PublishDiagnostics(const char* Topic);
+
+        /** @brief          Publish the summary of the latency histograms periodically with #Poll or the I/O thread.
+         *                  NOTE: The topic string isn't copied and must be valid until the diagnostics are disabled!
+         *  @param Topic    Diagnostics topic
+         *  @param Interval Interval in ms. Use 0 to disable the diagnostics
+         *  @return         Error code
+         */
+        MQTT::Error SetDiagnostics(const char* Topic, uint32_t Interval);
+
+        /** @brief          Get the summary of the duration histogram of a call into the client. The values are in us.
+         *                  All values are 0 unless the profile is enabled with #MQTT_PROFILE.
+         *  @param Call     Call
+         *  @param Profile  Pointer to the summary
+         */
+        void profile(MQTT_Profile_Call Call, MQTT_Latency* Profile) const;
+
+        /** @brief              Get the RAM footprint of the client.
+         *  @param Footprint    Pointer to the footprint
+         */
+        void footprint(MQTT_Footprint* Footprint) const;
+
+        /** @brief          Write the packets of the capture ring as capture (see #MQTTCaptureReader).
+         *                  The capture contains only the header when the ring is disabled with #MQTT_CAPTURE.
+         *  @param Output   Output (i. e. #Serial)
+         */
+        void DumpCapture(Print& Output);
+
+        /** @brief Remove the packets from the capture ring.
+         */
+        void ClearCapture(void);
+
+        /** @brief          Pass the received packets of a capture through the parser and the publish callback as fast as possible.
+         *                  The transmitted packets are skipped. The client must not be connected, so the acknowledgements
+         *                  aren't transmitted.
+         *  @param Capture  Capture
+         *  @param Length   Length of the capture
+         *  @param Result   Pointer to the result of the replay
+         *  @return         Error code
+         */
+        MQTT::Error Replay(const uint8_t* Capture, uint32_t Length, MQTT_Replay* Result);
+
         /** @brief	Can be used after a #Connect call to check the return code of the broker.
          *  @return	Return code from the broker
          */
         MQTT::ConnectionState connectionState(void) const;
 
+        /** @brief	Get the MQTT version, which is used for the current connection.
+         *  @return	MQTT version
+         */
+        uint8_t protocolVersion(void) const;
+
+        /** @brief	Get the reason code (MQTT 5) or return code (MQTT 3.1.1) of the last received acknowledgement.
+         *  @return	Reason code (see #ReasonCode)
+         */
+        uint8_t reasonCode(void) const;
+
+        /** @brief	Get the statistics of the client.
+         *  @return	Statistics
+         */
+        const MQTT::Statistics& statistics(void) const;
+
         /** @brief Constructor.
          */
         MQTT(void);
@@ -214,22 +520,177 @@ class MQTT
          */
         void SetKeepAlive(uint16_t KeepAlive);
 
+        /** @brief          Set the requested MQTT version. The client falls back to MQTT 3.1.1 when
+         *                  the broker doesn't accept MQTT 5.
+         *                  NOTE: You have to reopen the connection to use the new settings!
+         *  @param Version  MQTT version (i. e. #MQTT_VERSION_5)
+         */
+        void SetProtocolVersion(uint8_t Version);
+
         /** @brief              Set the publish callback communication with the broker.
          *  @param Callback     Publish callback
          */
         void SetCallback(Publish_Callback Callback);
 
-        /** @brief  Poll the MQTT interface and process incomming messages.
+        /** @brief              Set the publish callback communication with the broker.
+         *  @param Callback     Publish callback delegate
+         */
+        void SetCallback(const Publish_Delegate& Callback);
+
+        /** @brief              Set the callback, which is called when the unsent bytes of a short write were transmitted.
+         *  @param Callback     Drain callback delegate
+         */
+        void SetDrainCallback(const Drain_Delegate& Callback);
+
+        /** @brief              Set the callback, which is called when a call into the client took longer than the threshold.
+         *                      The callback reports the phase, which took the most time (i. e. #MQTT_PHASE_CONNACK_WAIT).
+         *                      With the I/O thread, only the application callbacks are measured as separate phase.
+         *                      NOTE: The callback is called by the thread of the call and must not call the client!
+         *  @param Threshold    Threshold in us. Use 0 to disable the callback
+         *  @param Callback     Stall callback delegate
+         */
+        void SetStallCallback(uint32_t Threshold, const Stall_Delegate& Callback);
+
+        /** @brief          Enable or disable the publish queue. When enabled, #Publish, #Subscribe and #Unsubscribe
+         *                  only serialize the message into a lock-free multi-producer queue and can be called from
+         *                  any thread (i. e. a #Timer callback). The queue is transmitted by #Poll or the I/O thread.
+         *                  The queue can't be enabled when #MQTT_OUTBOUND_QUEUE_SIZE is 0.
+         *                  NOTE: The I/O thread always uses the queue!
+         *  @param Enable   #true to enable the queue
+         */
+        void SetPublishQueue(bool Enable);
+
+        /** @brief          Enable or disable the receive queue. When enabled, received messages are moved into
+         *                  a fixed number of message slots and passed to the application through a wait-free
+         *                  single-producer / single-consumer queue instead of calling the publish callback.
+         *                  Use #Receive and #ReleaseMessage to process the messages.
+         *                  NOTE: The socket is always read, so a slow application never stalls the connection. A message, which
+         *                  arrives while the queue is full or no buffer is free, is acknowledged and dropped. Dropped messages
+         *                  are counted in the statistics!
+         *  @param Enable   #true to enable the queue
+         */
+        void SetReceiveQueue(bool Enable);
+
+        /** @brief          Enable or disable the compression of published payloads. Payloads with at least #MQTT_COMPRESSION_THRESHOLD bytes
+         *                  are compressed with LZSS and marked with #MQTT_COMPRESSION_MAGIC when the compressed payload is smaller.
+         *                  Uncompressed payloads, which start with the marker, are escaped with #MQTT_COMPRESSION_ESCAPE, so they
+         *                  are never decompressed by the receiver. Payloads of #BeginPublish and #Publishf are only compressed when a buffer is free.
+         *                  Received compressed payloads are decompressed before they are passed to the application while the
+         *                  compression is enabled. A message is acknowledged, dropped and counted in the statistics, when the
+         *                  payload can't be decompressed or no buffer is free.
+         *                  NOTE: Decompression needs a free buffer from the buffer pool!
+         *  @param Enable   #true to enable the compression
+         */
+        void SetCompression(bool Enable);
+
+        /** @brief          Enable the conflation for a latest-value topic. A pending message for the topic in the outbound queue is replaced
+         *                  by a newer message, so only the latest value is transmitted. The newer message doesn't need a free queue entry.
+         *                  A replaced QoS 1 or QoS 2 message is never transmitted and its message ID is released, so no acknowledgement
+         *                  arrives for the ID, which was returned by #Publish.
+         *                  Set #MQTT_CONFLATION_SIZE to the number of topics to use the conflation.
+         *                  NOTE: Only used with the publish queue or the I/O thread. Must be called before publishing!
+         *  @param Topic    MQTT topic
+         *  @return         Error code
+         */
+        MQTT::Error Conflate(const char* Topic);
+
+        /** @brief              Enable the report-by-exception filter for a topic. A message is skipped when the payload is equal
+         *                      to the last transmitted payload. Skipped messages return #NO_ERROR with the message ID 0 and are counted
+         *                      in the statistics. Queued messages become the last transmitted payload when they are transmitted.
+         *                      NOTE: Must be called before publishing!
+         *  @param Topic        MQTT topic with up to #MQTT_FILTER_TOPIC_LENGTH characters
+         *  @param Heartbeat    Maximum time without a message in ms. 0 to disable the heartbeat
+         *  @return             Error code
+         */
+        MQTT::Error Filter(const char* Topic, uint32_t Heartbeat);
+
+        /** @brief              Enable the report-by-exception filter for a topic with numeric values (i. e. "21.5"). A message is skipped
+         *                      when the value differs by no more than the deadband from the last transmitted value.
+         *                      Payloads, which are no numbers, are compared like #Filter without deadband. A change between a number
+         *                      and a payload, which is no number, is always transmitted.
+         *                      NOTE: Must be called before publishing!
+         *  @param Topic        MQTT topic with up to #MQTT_FILTER_TOPIC_LENGTH characters
+         *  @param Deadband     Smallest change of the value, which is transmitted
+         *  @param Heartbeat    Maximum time without a message in ms. 0 to disable the heartbeat
+         *  @return             Error code
+         */
+        MQTT::Error Filter(const char* Topic, float Deadband, uint32_t Heartbeat);
+
+        /** @brief                      Limit the transmission rate of a traffic class with a token bucket for the bytes and a token bucket for the messages.
+         *                              Each bucket allows a burst of one second. Queued messages wait until the class has enough tokens and messages,
+         *                              which are transmitted directly, are rejected with #FLOW_CONTROL.
+         *                              Control packets are queued when the control class is limited.
+         *                              NOTE: Must be called before publishing!
+         *  @param Priority             Traffic class
+         *  @param BytesPerSecond       Transmitted bytes per second. 0 for no limit
+         *  @param MessagesPerSecond    Transmitted messages per second. 0 for no limit
+         *  @return                     Error code
+         */
+        MQTT::Error SetRateLimit(MQTT::Priority Priority, uint32_t BytesPerSecond, uint32_t MessagesPerSecond);
+
+        /** @brief          Set the traffic class of a topic. Bulk messages use a separate outbound queue (see #MQTT_BULK_QUEUE_SIZE),
+         *                  so they never delay messages with a higher priority. Without the bulk queue, bulk messages share the
+         *                  outbound queue and only use the rate limit of their class.
+         *                  NOTE: Must be called before publishing!
+         *  @param Topic    MQTT topic with up to #MQTT_PRIORITY_TOPIC_LENGTH characters
+         *  @param Priority #PRIORITY_HIGH or #PRIORITY_BULK
+         *  @return         Error code
+         */
+        MQTT::Error SetPriority(const char* Topic, MQTT::Priority Priority);
+
+        /** @brief  Get the oldest message from the receive queue. The message stays valid until #ReleaseMessage is called.
+         *          NOTE: Must only be called by one thread!
+         *  @return Pointer to the message or #NULL when no message is available
+         */
+        MQTT::Message* Receive(void);
+
+        /** @brief Return the message from #Receive to the receive queue.
+         */
+        void ReleaseMessage(void);
+
+        /** @brief  Keep the message, which is currently passed to the publish callback, after the callback has returned.
+         *          The Topic and Payload pointers of the callback stay valid as long as the returned handle
+         *          (or a copy of it) exists. The receive buffer returns to the pool when the last handle is released.
+         *          NOTE: Must only be called from the publish callback!
+         *  @return Handle for the receive buffer. The handle is empty when the message wasn't received into the pool
+         */
+        MQTTBuffer RetainMessage(void);
+
+        /** @brief  Poll the MQTT interface and process incomming messages. Sends the keep-alive ping, too,
+         *          so it must be called at least once per keep-alive interval.
          *  @return Error code
          */
         MQTT::Error Poll(void);
 
+        /** @brief  Start a dedicated I/O thread, which owns the network connection and handles
+         *          the parsing, the acknowledgements and the keep-alive.
+         *          Published messages are passed to the thread and received messages are passed
+         *          back to #Poll through lock-free queues. #Poll doesn't block anymore and only
+         *          calls the publish callback for the received messages.
+         *          The thread is stopped during a reconnect with #Connect and started again
+         *          when the broker has accepted the connection.
+         *          NOTE: Use #Connect first! The thread needs the outbound queue (see #MQTT_OUTBOUND_QUEUE_SIZE)!
+         *  @return Error code
+         */
+        MQTT::Error StartThread(void);
+
+        /** @brief Transmit all pending messages and stop the I/O thread. Received messages, which are
+         *         still queued, are passed to the publish callback.
+         *         The client uses the #Poll function and the ping timer again.
+         */
+        void StopThread(void);
+
+        /** @brief	Check if the I/O thread is running.
+         *  @return	#true when the thread is running
+         */
+        bool isThreadRunning(void) const;
+
         /** @brief          Publish a message with a given topic.
          *  @param Topic    MQTT topic
          *  @param Payload  Message payload
          *  @return         Error code
          */
-        MQTT::Error Publish(const char* Topic, String Payload);
+        MQTT::Error Publish(const char* Topic, const String& Payload);
 
         /** @brief          Publish a message with a given topic.
          *  @param Topic    MQTT topic
@@ -283,6 +744,158 @@ class MQTT
          */
         MQTT::Error Publish(const char* Topic, const uint8_t* Payload, uint16_t Length, uint16_t* ID, MQTT::QoS QoS, bool Retain, bool DUP);
 
+        /** @brief              Publish a message with a given topic.
+         *  @param Topic        MQTT topic. Doesn't need a null terminator
+         *  @param TopicLength  Length of the topic
+         *  @param Payload      Message payload
+         *  @return             Error code
+         */
+        MQTT::Error Publish(const char* Topic, uint16_t TopicLength, const MQTTSpan& Payload);
+
+        /** @brief              Publish a message with a given topic.
+         *  @param Topic        MQTT topic. Doesn't need a null terminator
+         *  @param TopicLength  Length of the topic
+         *  @param Payload      Message payload
+         *  @param ID           Pointer to message ID.
+         *                      NOTE: Is used only with QoS 1 and QoS 2!
+         *  @param QoS          Quality of service for the message
+         *  @return             Error code
+         */
+        MQTT::Error Publish(const char* Topic, uint16_t TopicLength, const MQTTSpan& Payload, uint16_t* ID, MQTT::QoS QoS);
+
+        /** @brief              Publish a message with a given topic.
+         *  @param Topic        MQTT topic. Doesn't need a null terminator
+         *  @param TopicLength  Length of the topic
+         *  @param Payload      Message payload
+         *  @param ID           Pointer to message ID.
+         *                      NOTE: Is used only with QoS 1 and QoS 2!
+         *  @param QoS          Quality of service for the message
+         *  @param Retain       Retain flag for the broker
+         *  @param DUP          DUP flag for the broker
+         *  @return             Error code
+         */
+        MQTT::Error Publish(const char* Topic, uint16_t TopicLength, const MQTTSpan& Payload, uint16_t* ID, MQTT::QoS QoS, bool Retain, bool DUP);
+
+        /** @brief          Publish a message with a deadline and an expiry. Queued messages of a traffic class are transmitted in the order
+         *                  of their deadlines (earliest deadline first) and messages are dropped before the transmission when they are expired.
+         *                  Messages without a deadline use #MQTT_DEFAULT_DEADLINE.
+         *                  NOTE: Only used with the publish queue or the I/O thread!
+         *  @param Topic    MQTT topic
+         *  @param Payload  Message payload
+         *  @param Length   Payload length
+         *  @param ID       Pointer to message ID.
+         *                  NOTE: Is used only with QoS 1 and QoS 2!
+         *  @param QoS      Quality of service for the message
+         *  @param Timing   Deadline and expiry of the message (i. e. {200, 5000})
+         *  @return         Error code
+         */
+        MQTT::Error Publish(const char* Topic, const uint8_t* Payload, uint16_t Length, uint16_t* ID, MQTT::QoS QoS, const MQTT::Timing& Timing);
+
+        /** @brief          Publish a message with a prepared topic.
+         *  @param Topic    Prepared topic (see #MQTTPreparedTopic)
+         *  @param Payload  Message payload
+         *  @param Length   Payload length
+         *  @return         Error code
+         */
+        MQTT::Error Publish(const MQTTTopic& Topic, const uint8_t* Payload, uint16_t Length);
+
+        /** @brief          Publish a message with a prepared topic.
+         *  @param Topic    Prepared topic (see #MQTTPreparedTopic)
+         *  @param Payload  Message payload
+         *  @param Length   Payload length
+         *  @param ID       Pointer to message ID.
+         *                  NOTE: Is used only with QoS 1 and QoS 2!
+         *  @param QoS      Quality of service for the message
+         *  @return         Error code
+         */
+        MQTT::Error Publish(const MQTTTopic& Topic, const uint8_t* Payload, uint16_t Length, uint16_t* ID, MQTT::QoS QoS);
+
+        /** @brief          Publish a message with a prepared topic.
+         *  @param Topic    Prepared topic (see #MQTTPreparedTopic)
+         *  @param Payload  Message payload
+         *  @param Length   Payload length
+         *  @param ID       Pointer to message ID.
+         *                  NOTE: Is used only with QoS 1 and QoS 2!
+         *  @param QoS      Quality of service for the message
+         *  @param Retain   Retain flag for the broker
+         *  @return         Error code
+         */
+        MQTT::Error Publish(const MQTTTopic& Topic, const uint8_t* Payload, uint16_t Length, uint16_t* ID, MQTT::QoS QoS, bool Retain);
+
+        /** @brief          Publish a message with a prepared topic.
+         *  @param Topic    Prepared topic (see #MQTTPreparedTopic)
+         *  @param Payload  Message payload
+         *  @param Length   Payload length
+         *  @param ID       Pointer to message ID.
+         *                  NOTE: Is used only with QoS 1 and QoS 2!
+         *  @param QoS      Quality of service for the message
+         *  @param Retain   Retain flag for the broker
+         *  @param DUP      DUP flag for the broker
+         *  @return         Error code
+         */
+        MQTT::Error Publish(const MQTTTopic& Topic, const uint8_t* Payload, uint16_t Length, uint16_t* ID, MQTT::QoS QoS, bool Retain, bool DUP);
+
+        /** @brief          Publish a formatted message with a given topic. The payload is formatted directly into the transmit buffer.
+         *  @param Topic    MQTT topic
+         *  @param Format   printf-style format string
+         *  @return         Error code
+         */
+        MQTT::Error Publishf(const char* Topic, const char* Format, ...);
+
+        /** @brief          Publish a formatted message with a given topic. The payload is formatted directly into the transmit buffer.
+         *  @param Topic    MQTT topic
+         *  @param ID       Pointer to message ID.
+         *                  NOTE: Is used only with QoS 1 and QoS 2!
+         *  @param QoS      Quality of service for the message
+         *  @param Format   printf-style format string
+         *  @return         Error code
+         */
+        MQTT::Error Publishf(const char* Topic, uint16_t* ID, MQTT::QoS QoS, const char* Format, ...);
+
+        /** @brief          Start a publish message, which payload is written with a #Writer.
+         *                  NOTE: Don't call any other function of the client until #EndPublish or #CancelPublish is called!
+         *  @param Writer   Pointer to the writer
+         *  @param Topic    MQTT topic
+         *  @param QoS      Quality of service for the message
+         *  @return         Error code
+         */
+        MQTT::Error BeginPublish(MQTT::Writer* Writer, const char* Topic, MQTT::QoS QoS);
+
+        /** @brief          Transmit a publish message from #BeginPublish.
+         *  @param Writer   Pointer to the writer
+         *  @param ID       Pointer to message ID.
+         *                  NOTE: Is used only with QoS 1 and QoS 2!
+         *  @param Retain   Retain flag for the broker
+         *  @return         Error code
+         */
+        MQTT::Error EndPublish(MQTT::Writer* Writer, uint16_t* ID, bool Retain);
+
+        /** @brief          Discard a publish message from #BeginPublish.
+         *  @param Writer   Pointer to the writer
+         */
+        void CancelPublish(MQTT::Writer* Writer);
+
+        /** @brief                  Build a publish template for messages with a fixed topic, QoS and payload length.
+         *                          The template must be prepared again when the MQTT version of the connection changes.
+         *  @param Template         Pointer to the template
+         *  @param Topic            Prepared topic (see #MQTTPreparedTopic)
+         *  @param PayloadLength    Payload length
+         *  @param QoS              Quality of service for the message
+         *  @param Retain           Retain flag for the broker
+         *  @return                 Error code
+         */
+        MQTT::Error PrepareTemplate(MQTT::PublishTemplate* Template, const MQTTTopic& Topic, uint16_t PayloadLength, MQTT::QoS QoS, bool Retain);
+
+        /** @brief          Publish a message with a template. Only the message ID and the payload are written.
+         *                  Payloads, which start with #MQTT_COMPRESSION_MAGIC, are rejected while the compression is enabled.
+         *  @param Template Pointer to the template from #PrepareTemplate
+         *  @param Payload  Message payload with the length of the template
+         *  @param ID       Pointer to message ID.
+         *                  NOTE: Is used only with QoS 1 and QoS 2!
+         *  @return         Error code
+         */
+        MQTT::Error Publish(MQTT::PublishTemplate* Template, const uint8_t* Payload, uint16_t* ID);
+
         /** @brief          Subscribe a topic.
          *  @param Topic    MQTT topic
          *  @return         Error code
@@ -296,12 +909,27 @@ class MQTT
          */
         MQTT::Error Subscribe(const char* Topic, MQTT::QoS QoS);
 
+        /** @brief              Subscribe a topic.
+         *  @param Topic        MQTT topic. Doesn't need a null terminator
+         *  @param TopicLength  Length of the topic
+         *  @param QoS          Quality of service for the topic
+         *  @return             Error code
+         */
+        MQTT::Error Subscribe(const char* Topic, uint16_t TopicLength, MQTT::QoS QoS);
+
         /** @brief          Unsubscribe a topic.
          *  @param Topic    MQTT topic
          *  @return         Error code
          */
         MQTT::Error Unsubscribe(const char* Topic);
 
+        /** @brief              Unsubscribe a topic.
+         *  @param Topic        MQTT topic. Doesn't need a null terminator
+         *  @param TopicLength  Length of the topic
+         *  @return             Error code
+         */
+        MQTT::Error Unsubscribe(const char* Topic, uint16_t TopicLength);
+
     private:
         /** @brief Size of the fixed header.
          */
@@ -327,41 +955,344 @@ class MQTT
             DISCONNECT = 0x0E,
         } ControlPacket;
 
+        /** @brief MQTT transmit packet object. Used to hand packets from the application to the I/O thread.
+         */
+        typedef struct
+        {
+            uint16_t Offset;
+            uint16_t Length;
+            uint8_t Slot;
+            uint8_t Priority;
+            bool HasDeadline;
+            bool HasExpiry;
+            uint32_t Deadline;
+            uint32_t Expiry;
+            MQTT_Filter_Sample Filter;
+            uint8_t Data[MQTT_BUFFER_SIZE];
+        } Packet;
+
+        /** @brief MQTT control packet object. Used to queue acknowledgements and pings when the control class is rate limited.
+         */
+        typedef struct
+        {
+            uint8_t Length;
+            uint8_t Data[4];
+        } Frame;
+
+        /** @brief Measures a call into the client from the constructor to the destructor.
+         */
+        class CallScope
+        {
+            public:
+                CallScope(MQTT* Client, MQTT_Profile_Call Call) : _mClient(Client), _mCall(Call)
+                {
+                    if(MQTT_PROFILE)
+                    {
+                        Client->_mProfile.Begin(micros(), this);
+                    }
+                }
+
+                ~CallScope()
+                {
+                    if(MQTT_PROFILE)
+                    {
+                        this->_mClient->_endCall(this->_mCall);
+                    }
+                }
+
+            private:
+                MQTT* _mClient;
+                MQTT_Profile_Call _mCall;
+        };
+
+        /** @brief Measures a phase of a call from the constructor to the destructor.
+         */
+        class PhaseScope
+        {
+            public:
+                PhaseScope(MQTT* Client, MQTT_Profile_Phase Phase) : _mClient(Client), _mPhase(Phase), _mStart(MQTT_PROFILE ? micros() : 0x00)
+                {
+                }
+
+                ~PhaseScope()
+                {
+                    if(MQTT_PROFILE)
+                    {
+                        this->_mClient->_endPhase(this->_mPhase, this->_mStart);
+                    }
+                }
+
+            private:
+                MQTT* _mClient;
+                MQTT_Profile_Phase _mPhase;
+                uint32_t _mStart;
+        };
+
         Timer* _mPingTimer;
 
+        MQTTThread _mThread;
+        MQTTQueue<MQTT::Message, MQTTFeatures::Inbound ? MQTT_QUEUE_SIZE : 0> _mInbound;
+        MQTTBufferPool<MQTT_BUFFER_SIZE, MQTTFeatures::Inbound ? MQTT_BUFFER_POOL_SIZE : 0> _mPool;
+        MQTTBuffer _mDispatchBuffer;
+        MQTTDeadlineQueue<MQTT::Packet, MQTT_OUTBOUND_QUEUE_SIZE> _mOutbound;
+        MQTTDeadlineQueue<MQTT::Packet, MQTT_BULK_QUEUE_SIZE> _mBulk;
+        MQTTMPSCQueue<MQTT::Frame, MQTT_CONTROL_QUEUE_SIZE> _mControl;
+        MQTTRateLimiter _mRateLimit[3];
+        MQTTPriorityTable _mPriorities;
+        MQTT::Priority _mBufferPriority;
+        MQTTConflationTable<MQTT::Packet, MQTT_CONFLATION_SIZE> _mConflation;
+        MQTTFilter _mFilter;
+        MQTTMetrics<(MQTT_METRICS != 0)> _mMetrics;
+        MQTTLatency<(MQTT_METRICS != 0)> _mLatency;
+        MQTTProfile<(MQTT_PROFILE != 0)> _mProfile;
+        MQTTCapture<(MQTT_CAPTURE != 0)> _mCapture;
+
         TCPClient _mClient;
         IPAddress _mIP;
         ConnectionState _mConnectionState;
         
         uint8_t _mBuffer[MQTT_BUFFER_SIZE];
+        uint8_t _mUnsent[MQTT_BUFFER_SIZE];
+        std::atomic<uint16_t> _mUnsentLength;
+        uint16_t _mUnsentOffset;
+        bool _mDrained;
+
+        uint32_t _mServerMaximumPacketSize;
 
         uint16_t _mPort;
         uint16_t _mKeepAlive;
-        uint16_t _mCurrentMessageID;
+        uint16_t _mServerReceiveMaximum;
+        std::atomic<uint16_t> _mInFlight;
+        std::atomic<uint16_t> _mInFlightIDs[MQTT_INFLIGHT_SIZE];
+
+        uint8_t _mProtocolVersion;
+        uint8_t _mVersion;
+        uint8_t _mReasonCode;
+        std::atomic<uint16_t> _mCurrentMessageID;
+
+        uint32_t _mLastPing;
+
+        const char* _mDiagnosticsTopic;
+        uint32_t _mDiagnosticsInterval;
+        uint32_t _mLastDiagnostics;
+        uint32_t _mStallThreshold;
+        uint32_t _mHeapBytes;
 
         bool _mWaitForHostPing;
+        bool _mQueued;
+        bool _mReceiveQueued;
+        bool _mCompression;
+        bool _mThreadMode;
+        std::atomic<bool> _mPingDue;
+        std::atomic<bool> _mThreadRunning;
+        std::atomic<MQTT::Error> _mThreadError;
 
-        Publish_Callback _mCallback;
+        Publish_Delegate _mCallback;
+        Drain_Delegate _mDrainCallback;
+        Stall_Delegate _mStallCallback;
 
-        /** @brief	Read a single byte from the TCP client.
-         *  @return	Received byte
+        MQTTTopicAliases _mTopicAliases;
+        MQTTInboundAliases<MQTTFeatures::Inbound ? MQTT_TOPIC_ALIAS_SIZE : 0> _mInboundAliases;
+        MQTT::Statistics _mStatistics;
+
+        /** @brief              Open a connection with the MQTT broker.
+         *  @param ClientID     The Client Identifier identifies the Client to the Server.
+         *  @param CleanSession The Client and Server can store Session state to enable reliable messaging to continue across a sequence of Network Connections.
+         *  @param Will         Pointer to configuration object for the Will message
+         *  @param User         Pointer to user settings object.
+         *  @param Version      MQTT version
+         *  @return             Error code
+         */
+        MQTT::Error _connect(const char* ClientID, bool CleanSession, MQTT::Will* Will, MQTT::User* User, uint8_t Version);
+
+        /** @brief                  Process the properties and the reason code of a MQTT 5 connect acknowledgement.
+         *  @param FixedHeaderSize  Size of the fixed header
+         *  @param Bytes            Received bytes
+         *  @return                 Connection state
+         */
+        MQTT::ConnectionState _processConnectionAcknowledge(uint16_t FixedHeaderSize, uint16_t Bytes);
+
+        /** @brief	        Read a single byte from the TCP client. Waits at most #MQTT_READ_TIMEOUT ms for the byte.
+         *  @param Data     Pointer to the received byte
+         *  @param Thread   #true when the I/O thread reads. The thread gives up when it is stopped
+         *  @return	        #true when successful
          */
-        uint8_t _readByte(void);
+        bool _readByte(uint8_t* Data, bool Thread);
 
         /** @brief	                Get the answer from the broker.
+         *  @param Buffer           Receive buffer
          *  @param FixedHeaderSize  Pointer to size of the fixed header
          *  @param Bytes            Pointer to received bytes
          *  @return	                Error code
          */
-        MQTT::Error _readMessage(uint16_t* FixedHeaderSize, uint16_t* Bytes);
+        MQTT::Error _readMessage(uint8_t* Buffer, uint16_t* FixedHeaderSize, uint16_t* Bytes);
+
+        /** @brief	Receive and process the next message from the broker.
+         *  @return	Error code
+         */
+        MQTT::Error _receive(void);
+
+        /** @brief          Close the connection after a protocol error of the broker.
+         *                  MQTT 5 connections are closed with a DISCONNECT message, which contains the reason code.
+         *  @param Reason   Reason code
+         *  @return         #TRANSMISSION_ERROR
+         */
+        MQTT::Error _protocolError(MQTT::ReasonCode Reason);
+
+        /** @brief	                Process a received message.
+         *  @param Handle           Handle for the receive buffer. Empty when the transmit buffer was used
+         *  @param Buffer           Receive buffer
+         *  @param FixedHeaderSize  Size of the fixed header
+         *  @param Bytes            Received bytes
+         *  @return	                Error code
+         */
+        MQTT::Error _processMessage(const MQTTBuffer& Handle, uint8_t* Buffer, uint16_t FixedHeaderSize, uint16_t Bytes);
+
+        /** @brief	        Get the buffer for the next transmitted message. This is the transmit buffer or
+         *                  a free entry of the outbound queue of the class when the queue or the I/O thread is used.
+         *  @param Packet   Pointer to the claimed queue entry. Set to #NULL when the transmit buffer is used
+         *  @param Priority Traffic class of the message
+         *  @return	        Pointer to the buffer or #NULL when the outbound queue is full
+         */
+        uint8_t* _getBuffer(MQTT::Packet** Packet, MQTT::Priority Priority);
+
+        /** @brief	        Get the buffer for the next transmitted publish message. A message for a conflated topic uses the staging
+         *                  message of the conflation table instead of a queue entry (see #_conflate).
+         *  @param Packet   Pointer to the claimed queue entry or staging message. Set to #NULL when the transmit buffer is used
+         *  @param Topic    MQTT topic. Doesn't need a null terminator
+         *  @param Length   Length of the topic
+         *  @return	        Pointer to the buffer or #NULL when the outbound queue is full
+         */
+        uint8_t* _getPublishBuffer(MQTT::Packet** Packet, const char* Topic, uint16_t Length);
+
+        /** @brief	        Initialize the scheduling fields of a claimed queue entry or staging message.
+         *  @param Packet   Queue entry or staging message
+         *  @param Priority Traffic class of the message
+         */
+        void _preparePacket(MQTT::Packet* Packet, MQTT::Priority Priority);
+
+        /** @brief	        Pass a queue entry from #_getBuffer to the outbound queue of the class.
+         *  @param Packet   Queue entry
+         */
+        void _commitPacket(MQTT::Packet* Packet);
+
+        /** @brief	        Get the traffic class of a topic.
+         *  @param Topic    Topic string
+         *  @param Length   Length of the topic
+         *  @return	        Traffic class
+         */
+        MQTT::Priority _priority(const char* Topic, uint16_t Length) const;
+
+        /** @brief	Transmit the messages from the outbound queues in the order of the traffic classes, as long as the classes have enough tokens.
+         *  @return	Error code
+         */
+        MQTT::Error _transmitQueue(void);
+
+        /** @brief	        Transmit the next queued control packet.
+         *  @param Now      Current time in ms
+         *  @param Error    Pointer to the error code
+         *  @return	        #true when a packet was transmitted
+         */
+        bool _transmitControl(uint32_t Now, MQTT::Error* Error);
+
+        /** @brief	        Transmit the next message from an outbound queue.
+         *                  The rate limit of the traffic class of the message is used.
+         *  @param Queue    Outbound queue
+         *  @param Now      Current time in ms
+         *  @param Error    Pointer to the error code
+         *  @return	        #true when a message was transmitted
+         */
+        template<typename Q>
+        bool _transmitPacket(Q& Queue, uint32_t Now, MQTT::Error* Error);
+
+        /** @brief	        Count an error in the metrics.
+         *  @param Error    Error code
+         *  @return	        Error code
+         */
+        MQTT::Error _error(MQTT::Error Error);
+
+        /** @brief	        Store the timestamp of a transmitted QoS 1 or QoS 2 PUBLISH, SUBSCRIBE or PINGREQ packet.
+         *  @param Data     Message
+         *  @param Length   Length of the message
+         */
+        void _startLatency(const uint8_t* Data, uint16_t Length);
+
+        /** @brief Publish the diagnostics when the interval has passed.
+         */
+        void _publishDiagnostics(void);
+
+        /** @brief	        Finish the measurement of a call and report a stall.
+         *  @param Call     Call
+         */
+        void _endCall(MQTT_Profile_Call Call);
+
+        /** @brief	        Add the duration of a phase to the current call.
+         *  @param Phase    Phase
+         *  @param Start    Start of the phase in us
+         */
+        void _endPhase(MQTT_Profile_Phase Phase, uint32_t Start);
+
+        /** @brief	        Transmit a message. The bytes, which the socket doesn't take, are kept for #_flush.
+         *                  NOTE: Call #_flush first!
+         *  @param Data     Message
+         *  @param Length   Length of the message
+         *  @return	        Error code
+         */
+        MQTT::Error _write(const uint8_t* Data, uint16_t Length);
+
+        /** @brief	Transmit the unsent bytes of the last message.
+         *  @return	#NO_ERROR when all bytes are transmitted, #WOULD_BLOCK when bytes are left or #TRANSMISSION_ERROR
+         */
+        MQTT::Error _flush(void);
+
+        /** @brief	        Check if a queued message is expired.
+         *  @param Packet   Queue entry
+         *  @param Now      Current time in ms
+         *  @return	        #true when expired
+         */
+        bool _isExpired(const MQTT::Packet* Packet, uint32_t Now) const;
+
+        /** @brief	        Transmit an acknowledgement or a ping. The packet is queued when the control class is rate limited.
+         *  @param Data     Control packet
+         *  @param Length   Length of the control packet
+         *  @return	        Error code
+         */
+        MQTT::Error _writeControl(const uint8_t* Data, uint8_t Length);
 
         /** @brief	                Transmit a message to the broker.
+         *  @param Buffer           Buffer from #_getBuffer with the message
+         *  @param Packet           Queue entry from #_getBuffer
          *  @param ControlPacket    Type of the transmitted MQTT control packet
          *  @param Flags            Additional flags for the control packet
          *  @param Length           Length of the message without the fixed header.
          *  @return	                Error code
          */
-        MQTT::Error _writeMessage(MQTT::ControlPacket ControlPacket, uint8_t Flags, uint16_t Length);
+        MQTT::Error _writeMessage(uint8_t* Buffer, MQTT::Packet* Packet, MQTT::ControlPacket ControlPacket, uint8_t Flags, uint16_t Length);
+
+        /** @brief	        Move a publish message for a conflated topic into the conflation table. The queue entry of the first
+         *                  pending message transmits the latest message. A staging message claims a queue entry only when no
+         *                  message is pending and the queue entries of newer messages are discarded.
+         *  @param Entry    Pointer to the queue entry or staging message with the message. Set to the queue entry, which must be
+         *                  committed, or #NULL
+         *  @return	        Error code
+         */
+        MQTT::Error _conflate(MQTT::Packet** Entry);
+
+        /** @brief	        Encode the fixed header in front of a message.
+         *  @param Buffer   Buffer with the message at #MQTT_FIXED_HEADER_SIZE
+         *  @param Header   Control packet type and flags
+         *  @param Length   Length of the message without the fixed header
+         *  @return	        Offset of the fixed header in the buffer
+         */
+        uint8_t _encodeHeader(uint8_t* Buffer, uint8_t Header, uint16_t Length);
+
+        /** @brief	        Replace the topic of a MQTT 5 publish message with a topic alias or define a new alias.
+         *  @param Buffer   Buffer with the message at #MQTT_FIXED_HEADER_SIZE
+         *  @param Flags    Flags of the publish message
+         *  @param Length   Length of the message without the fixed header
+         *  @return	        New length of the message
+         */
+        uint16_t _applyTopicAlias(uint8_t* Buffer, uint8_t Flags, uint16_t Length);
 
         /** @brief      Transmit a publish acknowledgement control package.
          *  @param ID   Message ID
@@ -387,25 +1318,210 @@ class MQTT
          */
         MQTT::Error _publishComplete(uint16_t ID);
 
+        /** @brief	            Check the flow control and get the buffer for a publish message.
+         *  @param QoS          Quality of service for the message
+         *  @param Topic        MQTT topic. Doesn't need a null terminator
+         *  @param TopicLength  Length of the topic
+         *  @param Buffer       Pointer to the buffer
+         *  @param Packet       Pointer to the queue entry
+         *  @return	            Error code
+         */
+        MQTT::Error _beginPublish(MQTT::QoS QoS, const char* Topic, uint16_t TopicLength, uint8_t** Buffer, MQTT::Packet** Packet);
+
+        /** @brief	            Publish a message with a given topic.
+         *  @param Topic        MQTT topic. Doesn't need a null terminator
+         *  @param TopicLength  Length of the topic
+         *  @param Payload      Message payload
+         *  @param ID           Pointer to message ID
+         *  @param QoS          Quality of service for the message
+         *  @param Retain       Retain flag for the broker
+         *  @param DUP          DUP flag for the broker
+         *  @param Timing       Deadline and expiry of the message
+         *  @return	            Error code
+         */
+        MQTT::Error _publish(const char* Topic, uint16_t TopicLength, const MQTTSpan& Payload, uint16_t* ID, MQTT::QoS QoS, bool Retain, bool DUP, const MQTT::Timing& Timing);
+
+        /** @brief	            Add the message ID, the properties and the payload behind the topic and transmit the publish message.
+         *                      The payload is already in place (see #_payloadOffset) when #Payload is #NULL.
+         *  @param Buffer       Buffer from #_beginPublish
+         *  @param Packet       Queue entry from #_beginPublish
+         *  @param ByteOffset   Offset behind the topic
+         *  @param Payload      Message payload
+         *  @param Length       Payload length
+         *  @param ID           Pointer to message ID
+         *  @param QoS          Quality of service for the message
+         *  @param Retain       Retain flag for the broker
+         *  @param DUP          DUP flag for the broker
+         *  @return	            Error code
+         */
+        MQTT::Error _finishPublish(uint8_t* Buffer, MQTT::Packet* Packet, uint16_t ByteOffset, const uint8_t* Payload, uint16_t Length, uint16_t* ID, MQTT::QoS QoS, bool Retain, bool DUP);
+
+        /** @brief	            Publish a message with a formatted payload.
+         *  @param Topic        MQTT topic
+         *  @param ID           Pointer to message ID
+         *  @param QoS          Quality of service for the message
+         *  @param Format       printf-style format string
+         *  @param Arguments    Arguments for the format string
+         *  @return	            Error code
+         */
+        MQTT::Error _publishFormatted(const char* Topic, uint16_t* ID, MQTT::QoS QoS, const char* Format, va_list Arguments);
+
+        /** @brief	            Get the offset of the payload in a publish message.
+         *  @param ByteOffset   Offset behind the topic
+         *  @param QoS          Quality of service for the message
+         *  @return	            Offset of the payload
+         */
+        uint16_t _payloadOffset(uint16_t ByteOffset, MQTT::QoS QoS) const;
+
+        /** @brief	        Check a publish message with the report-by-exception filter.
+         *  @param Topic    Encoded topic with length prefix
+         *  @param Payload  Payload
+         *  @param Length   Payload length
+         *  @param Sample   Pointer to the checked payload. Passed to the filter when the message was transmitted
+         *  @return         #true when the message should be transmitted
+         */
+        bool _filterPublish(const uint8_t* Topic, const uint8_t* Payload, uint16_t Length, MQTT_Filter_Sample* Sample);
+
+        /** @brief	        Release a queue entry from #_getBuffer without transmitting a message.
+         *  @param Packet   Queue entry. Can be #NULL
+         */
+        void _discardPacket(MQTT::Packet* Packet);
+
         /** @brief              Load all neccessary variables and initialize the timer.
          *  @param IP           IP address of the MQTT broker
          *  @param Port         Port used by the MQTT client
          *  @param KeepAlive    Keep-alive time used by the MQTT client
          *  @param Callback     Publish received callback
          */
-        void _init(IPAddress IP, uint16_t Port, uint16_t KeepAlive, Publish_Callback Callback);
+        void _init(IPAddress IP, uint16_t Port, uint16_t KeepAlive, const Publish_Delegate& Callback);
 
-        /** @brief          Copy an UTF-8 string into the transmit buffer.
+        /** @brief          Copy an UTF-8 string into a transmit buffer.
+         *  @param Buffer   Transmit buffer
          *  @param String   UTF-8 string
          *  @param Offset   Byte offset in the transmit buffer
+         *  @return         #false when the string doesn't fit into the buffer
+         */
+        bool _copyString(uint8_t* Buffer, const char* String, uint16_t* Offset);
+
+        /** @brief          Copy an UTF-8 string or binary data with a given length into a transmit buffer.
+         *  @param Buffer   Transmit buffer
+         *  @param String   UTF-8 string or binary data
+         *  @param Length   Length of the string
+         *  @param Offset   Byte offset in the transmit buffer
+         *  @return         #false when the string doesn't fit into the buffer
+         */
+        bool _copyString(uint8_t* Buffer, const char* String, uint16_t Length, uint16_t* Offset);
+
+        /** @brief      Add a QoS 1 or QoS 2 message to the unacknowledged messages. Can be called by any thread.
+         *  @param ID   Packet identifier
+         *  @return     #false when the Receive Maximum of the broker or #MQTT_INFLIGHT_SIZE messages are in flight
+         */
+        bool _acquireInFlight(uint16_t ID);
+
+        /** @brief      Release an unacknowledged QoS 1 or QoS 2 message for the flow control. Can be called by any thread.
+         *  @param ID   Packet identifier
+         *  @return     #false when no message with the identifier is in flight
+         */
+        bool _releaseInFlight(uint16_t ID);
+
+        /** @brief Remove all unacknowledged messages.
+         */
+        void _resetInFlight(void);
+
+        /** @brief          Get the packet identifier of a QoS 1 or QoS 2 PUBLISH message in a transmit buffer.
+         *  @param Buffer   Transmit buffer
+         *  @return         Packet identifier
          */
-        void _copyString(const char* String, uint16_t* Offset);
+        uint16_t _publishID(const uint8_t* Buffer) const;
 
-        /** @brief Increase the message ID.
+        /** @brief  Get a new message ID. Can be called by any thread.
+         *  @return Message ID
          */
-        void _increaseID(void);
+        uint16_t _getID(void);
 
-        /** @brief Send a ping control packet to the broker.
+        /** @brief Send a ping control packet to the broker. Closes the connection when the last ping wasn't answered.
          */
         void _sendPing(void);
+
+        /** @brief Callback of the ping timer. Only marks the ping as due, because the socket is used by the thread of #Poll.
+         */
+        void _requestPing(void);
+
+        /** @brief Stop the I/O thread and dispatch the remaining received messages.
+         *         The thread mode is kept, so #Connect can start the thread again.
+         */
+        void _stopThread(void);
+
+        /** @brief Pass the messages from the receive queue of the I/O thread to the publish callback.
+         */
+        void _dispatchInbound(void);
+
+        /** @brief I/O thread loop. Runs until #StopThread is called.
+         */
+        void _threadLoop(void);
+
+        /** @brief              Entry point of the I/O thread.
+         *  @param Parameter    Pointer to the client object
+         */
+        static void _threadEntry(void* Parameter);
+};
+
+class MQTT::Writer : public Print
+{
+    public:
+        /** @brief Constructor.
+         */
+        Writer(void);
+
+        using Print::write;
+
+        /** @brief          Write a single byte into the payload.
+         *  @param Data     Byte
+         *  @return         Number of written bytes
+         */
+        virtual size_t write(uint8_t Data);
+
+        /** @brief          Write data into the payload.
+         *  @param Data     Data
+         *  @param Length   Length of the data
+         *  @return         Number of written bytes
+         */
+        virtual size_t write(const uint8_t* Data, size_t Length);
+
+        /** @brief	Check if the payload fits into the transmit buffer.
+         *  @return	#false when the payload was too large
+         */
+        bool isValid(void) const;
+
+        /** @brief	Get the length of the payload.
+         *  @return	Length in bytes
+         */
+        uint16_t Length(void) const;
+
+        /** @brief	Get the current write position in the payload. Can be used to encode data in place (i. e. with #MQTTCBORWriter).
+         *  @return	Pointer to the write position or #NULL when no message is started
+         */
+        uint8_t* Buffer(void) const;
+
+        /** @brief	Get the free space behind the write position.
+         *  @return	Free bytes
+         */
+        uint16_t Available(void) const;
+
+        /** @brief	        Add data, which was encoded in place at #Buffer, to the payload.
+         *  @param Length   Number of encoded bytes
+         *  @return	        #true when successful
+         */
+        bool Advance(uint16_t Length);
+
+    private:
+        friend class MQTT;
+
+        uint8_t* _mBuffer;
+        MQTT::Packet* _mPacket;
+        MQTT::QoS _mQoS;
+        uint16_t _mTopicEnd;
+        uint16_t _mStart;
+        uint16_t _mPosition;
+        bool _mOverflow;
 };
\ No newline at end of file
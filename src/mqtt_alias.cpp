@@ -0,0 +1,99 @@
+/*
+ * MQTT_Alias.cpp
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: MQTT 5.0 topic alias tables.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTT_Alias.cpp
+ *  @brief MQTT 5.0 topic alias tables.
+ *
+ *  @author Daniel Kampert
+ */
+
+#include <string.h>
+
+#include "mqtt_alias.h"
+#include "mqtt_topic.h"
+
+MQTTTopicAliases::MQTTTopicAliases(void)
+{
+    this->Reset(0x00);
+}
+
+void MQTTTopicAliases::Reset(uint16_t Maximum)
+{
+    memset(this->_mOutbound, 0x00, sizeof(this->_mOutbound));
+
+    this->_mUseCounter = 0x00;
+    this->_mMaximum = (Maximum < MQTT_TOPIC_ALIAS_SIZE) ? Maximum : MQTT_TOPIC_ALIAS_SIZE;
+}
+
+uint16_t MQTTTopicAliases::Lookup(const char* Topic, uint16_t Length)
+{
+    uint32_t Hash = MQTT_HashTopic(Topic, Length);
+
+    for(uint16_t i = 0x00; i < this->_mMaximum; i++)
+    {
+        Entry* Current = &this->_mOutbound[i];
+
+        if((Current->Length == Length) && (Current->Hash == Hash) && (memcmp(Current->Topic, Topic, Length) == 0x00))
+        {
+            Current->LastUse = ++this->_mUseCounter;
+
+            return i + 0x01;
+        }
+    }
+
+    return 0x00;
+}
+
+uint16_t MQTTTopicAliases::Assign(const char* Topic, uint16_t Length)
+{
+    uint16_t Index = 0x00;
+
+    if((this->_mMaximum == 0x00) || (Length == 0x00) || (Length > MQTT_TOPIC_ALIAS_LENGTH))
+    {
+        return 0x00;
+    }
+
+    // Use a free alias or the least recently used one
+    for(uint16_t i = 0x00; i < this->_mMaximum; i++)
+    {
+        if(this->_mOutbound[i].Length == 0x00)
+        {
+            Index = i;
+            break;
+        }
+
+        if(this->_mOutbound[i].LastUse < this->_mOutbound[Index].LastUse)
+        {
+            Index = i;
+        }
+    }
+
+    Entry* Current = &this->_mOutbound[Index];
+    Current->Hash = MQTT_HashTopic(Topic, Length);
+    Current->LastUse = ++this->_mUseCounter;
+    Current->Length = Length;
+    memcpy(Current->Topic, Topic, Length);
+
+    return Index + 0x01;
+}
\ No newline at end of file
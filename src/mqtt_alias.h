@@ -0,0 +1,183 @@
+/*
+ * MQTT_Alias.h
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: MQTT 5.0 topic alias tables.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTT_Alias.h
+ *  @brief MQTT 5.0 topic alias tables.
+ *
+ *  @author Daniel Kampert
+ */
+
+#ifndef MQTT_ALIAS_H_
+#define MQTT_ALIAS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/** @brief Number of topic aliases for each direction.
+ */
+#ifndef MQTT_TOPIC_ALIAS_SIZE
+    #define MQTT_TOPIC_ALIAS_SIZE                   4
+#endif
+
+/** @brief Maximum length of a topic, which can be replaced by an alias.
+ */
+#ifndef MQTT_TOPIC_ALIAS_LENGTH
+    #define MQTT_TOPIC_ALIAS_LENGTH                 64
+#endif
+
+/** @brief Outbound topic alias table. The table maps topics to aliases and replaces the least recently
+ *         used alias when the table is full.
+ */
+class MQTTTopicAliases
+{
+    public:
+        /** @brief Constructor.
+         */
+        MQTTTopicAliases(void);
+
+        /** @brief          Clear the table. Must be called for each new connection.
+         *  @param Maximum  Topic alias maximum of the broker
+         */
+        void Reset(uint16_t Maximum);
+
+        /** @brief          Get the outbound alias for a topic.
+         *  @param Topic    Topic string
+         *  @param Length   Length of the topic
+         *  @return         Alias or 0 when the topic has no alias
+         */
+        uint16_t Lookup(const char* Topic, uint16_t Length);
+
+        /** @brief          Assign an outbound alias to a topic. The least recently used alias is reused when all aliases are in use.
+         *  @param Topic    Topic string
+         *  @param Length   Length of the topic
+         *  @return         Alias or 0 when no alias can be used
+         */
+        uint16_t Assign(const char* Topic, uint16_t Length);
+
+    private:
+        typedef struct
+        {
+            uint32_t Hash;
+            uint32_t LastUse;
+            uint16_t Length;
+            char Topic[MQTT_TOPIC_ALIAS_LENGTH];
+        } Entry;
+
+        Entry _mOutbound[MQTT_TOPIC_ALIAS_SIZE];
+
+        uint32_t _mUseCounter;
+        uint16_t _mMaximum;
+};
+
+/** @brief Inbound topic alias table. The table stores the aliases defined by the broker.
+ *  @tparam Size    Number of aliases
+ */
+template<uint8_t Size>
+class MQTTInboundAliases
+{
+    public:
+        /** @brief Constructor.
+         */
+        MQTTInboundAliases(void)
+        {
+            this->Reset();
+        }
+
+        /** @brief Clear the table. Must be called for each new connection.
+         */
+        void Reset(void)
+        {
+            memset(this->_mEntries, 0x00, sizeof(this->_mEntries));
+        }
+
+        /** @brief          Store an alias from the broker.
+         *  @param Alias    Alias
+         *  @param Topic    Topic string
+         *  @param Length   Length of the topic
+         *  @return         #true when successful
+         */
+        bool Set(uint16_t Alias, const char* Topic, uint16_t Length)
+        {
+            if((Alias == 0x00) || (Alias > Size) || (Length > MQTT_TOPIC_ALIAS_LENGTH))
+            {
+                return false;
+            }
+
+            Entry* Current = &this->_mEntries[Alias - 0x01];
+            Current->Length = Length;
+            memcpy(Current->Topic, Topic, Length);
+
+            return true;
+        }
+
+        /** @brief          Get the topic of an alias.
+         *  @param Alias    Alias
+         *  @param Length   Pointer to the length of the topic
+         *  @return         Pointer to the topic or #NULL when the alias is unknown
+         */
+        char* Get(uint16_t Alias, uint16_t* Length)
+        {
+            if((Alias == 0x00) || (Alias > Size) || (this->_mEntries[Alias - 0x01].Length == 0x00))
+            {
+                return NULL;
+            }
+
+            *Length = this->_mEntries[Alias - 0x01].Length;
+
+            return this->_mEntries[Alias - 0x01].Topic;
+        }
+
+    private:
+        typedef struct
+        {
+            uint16_t Length;
+            char Topic[MQTT_TOPIC_ALIAS_LENGTH];
+        } Entry;
+
+        Entry _mEntries[Size];
+};
+
+/** @brief Removed inbound topic alias table. All aliases from the broker are unknown.
+ */
+template<>
+class MQTTInboundAliases<0>
+{
+    public:
+        void Reset(void)
+        {
+        }
+
+        bool Set(uint16_t, const char*, uint16_t)
+        {
+            return false;
+        }
+
+        char* Get(uint16_t, uint16_t*)
+        {
+            return NULL;
+        }
+};
+
+#endif
\ No newline at end of file
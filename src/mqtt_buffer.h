@@ -0,0 +1,207 @@
+/*
+ * MQTT_Buffer.h
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Reference-counted receive buffers for the MQTT client.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTT_Buffer.h
+ *  @brief Reference-counted receive buffers for the MQTT client.
+ *
+ *  @author Daniel Kampert
+ */
+
+#ifndef MQTT_BUFFER_H_
+#define MQTT_BUFFER_H_
+
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+
+/** @brief Handle for a buffer from a #MQTTBufferPool. Each copy of the handle holds a reference
+ *         and the buffer returns to the pool when the last handle is released or destroyed.
+ */
+class MQTTBuffer
+{
+    public:
+        /** @brief Constructor. Creates an empty handle.
+         */
+        MQTTBuffer(void) : _mReferences(NULL), _mData(NULL)
+        {
+        }
+
+        /** @brief              Constructor. Takes over the reference for a buffer.
+         *  @param References   Pointer to the reference counter of the buffer
+         *  @param Data         Pointer to the buffer
+         */
+        MQTTBuffer(std::atomic<uint8_t>* References, uint8_t* Data) : _mReferences(References), _mData(Data)
+        {
+        }
+
+        /** @brief          Copy constructor. Adds a reference to the buffer.
+         *  @param Other    Handle to copy
+         */
+        MQTTBuffer(const MQTTBuffer& Other) : _mReferences(Other._mReferences), _mData(Other._mData)
+        {
+            if(this->_mReferences != NULL)
+            {
+                this->_mReferences->fetch_add(0x01, std::memory_order_relaxed);
+            }
+        }
+
+        /** @brief Deconstructor. Releases the reference.
+         */
+        ~MQTTBuffer()
+        {
+            this->Release();
+        }
+
+        /** @brief          Assignment operator. Releases the current reference and adds a reference to the new buffer.
+         *  @param Other    Handle to copy
+         *  @return         This handle
+         */
+        MQTTBuffer& operator=(const MQTTBuffer& Other)
+        {
+            if(this != &Other)
+            {
+                this->Release();
+
+                this->_mReferences = Other._mReferences;
+                this->_mData = Other._mData;
+                if(this->_mReferences != NULL)
+                {
+                    this->_mReferences->fetch_add(0x01, std::memory_order_relaxed);
+                }
+            }
+
+            return *this;
+        }
+
+        /** @brief Release the reference. The handle is empty afterwards.
+         */
+        void Release(void)
+        {
+            if(this->_mReferences != NULL)
+            {
+                this->_mReferences->fetch_sub(0x01, std::memory_order_acq_rel);
+            }
+
+            this->_mReferences = NULL;
+            this->_mData = NULL;
+        }
+
+        /** @brief	Check if the handle holds a buffer.
+         *  @return	#true when valid
+         */
+        bool isValid(void) const
+        {
+            return (this->_mData != NULL);
+        }
+
+        /** @brief	Get the buffer.
+         *  @return	Pointer to the buffer or #NULL for an empty handle
+         */
+        uint8_t* Data(void) const
+        {
+            return this->_mData;
+        }
+
+    private:
+        std::atomic<uint8_t>* _mReferences;
+        uint8_t* _mData;
+};
+
+/** @brief Fixed pool of reference-counted buffers.
+ *  @tparam Size    Size of each buffer
+ *  @tparam Count   Number of buffers
+ */
+template<uint16_t Size, uint8_t Count>
+class MQTTBufferPool
+{
+    public:
+        /** @brief Constructor.
+         */
+        MQTTBufferPool(void)
+        {
+            for(uint8_t i = 0x00; i < Count; i++)
+            {
+                this->_mReferences[i].store(0x00, std::memory_order_relaxed);
+            }
+        }
+
+        /** @brief  Get a free buffer from the pool. Can be called by any thread.
+         *  @return Handle for the buffer. The handle is empty when all buffers are in use.
+         */
+        MQTTBuffer Allocate(void)
+        {
+            for(uint8_t i = 0x00; i < Count; i++)
+            {
+                uint8_t Expected = 0x00;
+
+                if(this->_mReferences[i].compare_exchange_strong(Expected, 0x01, std::memory_order_acquire))
+                {
+                    return MQTTBuffer(&this->_mReferences[i], this->_mData[i]);
+                }
+            }
+
+            return MQTTBuffer();
+        }
+
+        /** @brief  Get the number of free buffers.
+         *  @return Number of buffers
+         */
+        uint8_t Available(void) const
+        {
+            uint8_t Free = 0x00;
+
+            for(uint8_t i = 0x00; i < Count; i++)
+            {
+                if(this->_mReferences[i].load(std::memory_order_relaxed) == 0x00)
+                {
+                    Free++;
+                }
+            }
+
+            return Free;
+        }
+
+    private:
+        std::atomic<uint8_t> _mReferences[Count];
+        uint8_t _mData[Count][Size];
+};
+
+/** @brief Removed buffer pool. All allocations return an empty handle.
+ */
+template<uint16_t Size>
+class MQTTBufferPool<Size, 0>
+{
+    public:
+        MQTTBuffer Allocate(void)
+        {
+            return MQTTBuffer();
+        }
+
+        uint8_t Available(void) const
+        {
+            return 0x00;
+        }
+};
+
+#endif
\ No newline at end of file
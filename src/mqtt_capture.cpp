@@ -0,0 +1,72 @@
+/*
+ * MQTT_Capture.cpp
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Wire capture ring for the MQTT client.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTT_Capture.cpp
+ *  @brief Wire capture ring for the MQTT client.
+ *
+ *  @author Daniel Kampert
+ */
+
+#include <string.h>
+
+#include "mqtt_capture.h"
+
+MQTTCaptureReader::MQTTCaptureReader(const uint8_t* Buffer, uint32_t Length) : _mBuffer(Buffer), _mLength(Length), _mOffset(MQTT_CAPTURE_FILE_HEADER)
+{
+}
+
+bool MQTTCaptureReader::isValid(void) const
+{
+    return (this->_mBuffer != NULL) && (this->_mLength >= MQTT_CAPTURE_FILE_HEADER) && !memcmp(this->_mBuffer, "MQCP", 0x04);
+}
+
+uint8_t MQTTCaptureReader::Version(void) const
+{
+    return this->isValid() ? this->_mBuffer[0x04] : 0x00;
+}
+
+bool MQTTCaptureReader::Next(MQTT_Capture_Record* Record)
+{
+    const uint8_t* Header = this->_mBuffer + this->_mOffset;
+
+    if(!this->isValid() || (Record == NULL) || ((this->_mOffset + MQTT_CAPTURE_RECORD_HEADER) > this->_mLength))
+    {
+        return false;
+    }
+
+    Record->Time = Header[0] | (Header[1] << 0x08) | ((uint32_t)Header[2] << 0x10) | ((uint32_t)Header[3] << 0x18);
+    Record->Direction = Header[4];
+    Record->Length = Header[5] | (Header[6] << 0x08);
+    Record->Data = Header + MQTT_CAPTURE_RECORD_HEADER;
+
+    // Reject a truncated record
+    if((this->_mOffset + MQTT_CAPTURE_RECORD_HEADER + Record->Length) > this->_mLength)
+    {
+        return false;
+    }
+
+    this->_mOffset += MQTT_CAPTURE_RECORD_HEADER + Record->Length;
+
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,255 @@
+/*
+ * MQTT_Capture.h
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Wire capture ring for the MQTT client.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTT_Capture.h
+ *  @brief Wire capture ring for the MQTT client.
+ *
+ *  @author Daniel Kampert
+ */
+
+#ifndef MQTT_CAPTURE_H_
+#define MQTT_CAPTURE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "application.h"
+#include "mqtt_thread.h"
+
+/** @brief Set to 1 to record the transmitted and received packets in a capture ring.
+ */
+#ifndef MQTT_CAPTURE
+    #define MQTT_CAPTURE                            0
+#endif
+
+/** @brief Size of the capture ring in bytes. The oldest packets are overwritten when the ring is full.
+ */
+#ifndef MQTT_CAPTURE_SIZE
+    #define MQTT_CAPTURE_SIZE                       4096
+#endif
+
+/** @brief Size of the record header (time, direction and length).
+ */
+#define MQTT_CAPTURE_RECORD_HEADER                  7
+
+/** @brief Size of the capture header (magic and protocol version).
+ */
+#define MQTT_CAPTURE_FILE_HEADER                    5
+
+/** @brief Direction of a captured packet.
+ */
+typedef enum
+{
+    MQTT_CAPTURE_INBOUND = 0x00,                            /**< Packet received from the broker. */
+    MQTT_CAPTURE_OUTBOUND = 0x01,                           /**< Packet transmitted to the broker. */
+} MQTT_Capture_Direction;
+
+/** @brief Captured packet.
+ */
+typedef struct
+{
+    uint32_t Time;                                          /**< Timestamp in ms. */
+    uint8_t Direction;                                      /**< Direction (see #MQTT_Capture_Direction). */
+    const uint8_t* Data;                                    /**< Pointer to the packet. */
+    uint16_t Length;                                        /**< Length of the packet. */
+} MQTT_Capture_Record;
+
+/** @brief Result of a replay.
+ */
+typedef struct
+{
+    uint32_t Packets;                                       /**< Processed packets. */
+    uint32_t Messages;                                      /**< Processed PUBLISH packets. */
+    uint32_t Bytes;                                         /**< Processed bytes. */
+    uint32_t Errors;                                        /**< Packets, which were rejected by the parser. */
+    uint32_t Duration;                                      /**< Duration of the replay in us. */
+} MQTT_Replay;
+
+/** @brief Reader for a capture. A capture starts with the magic "MQCP" and the MQTT protocol version, followed by the records.
+ *         Each record contains the time in ms (4 bytes, little endian), the direction (1 byte), the length (2 bytes, little endian)
+ *         and the packet.
+ */
+class MQTTCaptureReader
+{
+    public:
+        /** @brief          Constructor.
+         *  @param Buffer   Capture
+         *  @param Length   Length of the capture
+         */
+        MQTTCaptureReader(const uint8_t* Buffer, uint32_t Length);
+
+        /** @brief  Check if the capture has a valid header.
+         *  @return #true when valid
+         */
+        bool isValid(void) const;
+
+        /** @brief  Get the protocol version of the captured connection.
+         *  @return Protocol version
+         */
+        uint8_t Version(void) const;
+
+        /** @brief          Get the next record.
+         *  @param Record   Pointer to the record object
+         *  @return         #true when a record was read
+         */
+        bool Next(MQTT_Capture_Record* Record);
+
+    private:
+        const uint8_t* _mBuffer;
+        uint32_t _mLength;
+        uint32_t _mOffset;
+};
+
+/** @brief Capture ring with the raw packets at the transport boundary.
+ *  @tparam Enabled #false to remove the ring. All functions are empty then
+ */
+template<bool Enabled>
+class MQTTCapture
+{
+    public:
+        /** @brief Constructor.
+         */
+        MQTTCapture(void) : _mHead(0x00), _mTail(0x00)
+        {
+        }
+
+        /** @brief Remove all records.
+         */
+        void Clear(void)
+        {
+            this->_mLock.Lock();
+            this->_mHead = 0x00;
+            this->_mTail = 0x00;
+            this->_mLock.Unlock();
+        }
+
+        /** @brief              Add a packet with the current time to the ring. Can be called by any thread.
+         *  @param Direction    Direction
+         *  @param Data         Packet
+         *  @param Length       Length of the packet
+         */
+        void Record(MQTT_Capture_Direction Direction, const uint8_t* Data, uint16_t Length)
+        {
+            uint32_t Time = millis();
+            uint32_t Size = MQTT_CAPTURE_RECORD_HEADER + Length;
+            uint8_t Header[MQTT_CAPTURE_RECORD_HEADER] = {(uint8_t)Time, (uint8_t)(Time >> 0x08), (uint8_t)(Time >> 0x10), (uint8_t)(Time >> 0x18),
+                                                          (uint8_t)Direction, (uint8_t)Length, (uint8_t)(Length >> 0x08)};
+
+            if(Size > MQTT_CAPTURE_SIZE)
+            {
+                return;
+            }
+
+            this->_mLock.Lock();
+
+            // Remove the oldest records until the packet fits
+            while((MQTT_CAPTURE_SIZE - (this->_mHead - this->_mTail)) < Size)
+            {
+                this->_mTail += MQTT_CAPTURE_RECORD_HEADER + (this->_mData[(this->_mTail + 0x05) % MQTT_CAPTURE_SIZE] | (this->_mData[(this->_mTail + 0x06) % MQTT_CAPTURE_SIZE] << 0x08));
+            }
+
+            this->_copy(Header, sizeof(Header));
+            this->_copy(Data, Length);
+
+            this->_mLock.Unlock();
+        }
+
+        /** @brief          Write the ring as capture, starting with the oldest record (see #MQTTCaptureReader).
+         *                  NOTE: The ring is locked until the capture is written!
+         *  @param Output   Output (i. e. #Serial)
+         *  @param Version  Protocol version of the connection
+         */
+        void Dump(Print& Output, uint8_t Version)
+        {
+            uint8_t Header[MQTT_CAPTURE_FILE_HEADER] = {'M', 'Q', 'C', 'P', Version};
+
+            this->_mLock.Lock();
+
+            Output.write(Header, sizeof(Header));
+            for(uint32_t Position = this->_mTail; Position != this->_mHead;)
+            {
+                uint32_t Index = Position % MQTT_CAPTURE_SIZE;
+                uint32_t Length = MQTT_CAPTURE_SIZE - Index;
+
+                if(Length > (this->_mHead - Position))
+                {
+                    Length = this->_mHead - Position;
+                }
+
+                Output.write(this->_mData + Index, Length);
+                Position += Length;
+            }
+
+            this->_mLock.Unlock();
+        }
+
+    private:
+        uint8_t _mData[MQTT_CAPTURE_SIZE];
+        uint32_t _mHead;
+        uint32_t _mTail;
+        MQTTMutex _mLock;
+
+        void _copy(const uint8_t* Data, uint32_t Length)
+        {
+            for(uint32_t Copied = 0x00; Copied < Length;)
+            {
+                uint32_t Index = this->_mHead % MQTT_CAPTURE_SIZE;
+                uint32_t Chunk = MQTT_CAPTURE_SIZE - Index;
+
+                if(Chunk > (Length - Copied))
+                {
+                    Chunk = Length - Copied;
+                }
+
+                memcpy(this->_mData + Index, Data + Copied, Chunk);
+                Copied += Chunk;
+                this->_mHead += Chunk;
+            }
+        }
+};
+
+/** @brief Disabled capture ring. The calls are removed by the compiler.
+ */
+template<>
+class MQTTCapture<false>
+{
+    public:
+        void Clear(void)
+        {
+        }
+
+        void Record(MQTT_Capture_Direction, const uint8_t*, uint16_t)
+        {
+        }
+
+        void Dump(Print& Output, uint8_t Version)
+        {
+            uint8_t Header[MQTT_CAPTURE_FILE_HEADER] = {'M', 'Q', 'C', 'P', Version};
+
+            Output.write(Header, sizeof(Header));
+        }
+};
+
+#endif
\ No newline at end of file
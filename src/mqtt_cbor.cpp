@@ -0,0 +1,383 @@
+/*
+ * MQTT_CBOR.cpp
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: CBOR payload encoder and decoder.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTT_CBOR.cpp
+ *  @brief CBOR payload encoder and decoder.
+ *
+ *  @author Daniel Kampert
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "mqtt_cbor.h"
+
+MQTTCBORWriter::MQTTCBORWriter(uint8_t* Buffer, uint16_t Size) : _mBuffer(Buffer), _mSize(Size), _mOffset(0x00), _mOverflow(Buffer == NULL)
+{
+}
+
+void MQTTCBORWriter::BeginMap(uint16_t Count)
+{
+    this->_writeHead(MQTT_CBOR_MAP, Count);
+}
+
+void MQTTCBORWriter::BeginArray(uint16_t Count)
+{
+    this->_writeHead(MQTT_CBOR_ARRAY, Count);
+}
+
+void MQTTCBORWriter::AddUnsigned(uint64_t Value)
+{
+    this->_writeHead(MQTT_CBOR_UNSIGNED, Value);
+}
+
+void MQTTCBORWriter::AddInteger(int64_t Value)
+{
+    // Negative integers are encoded as -1 - n
+    if(Value < 0x00)
+    {
+        this->_writeHead(MQTT_CBOR_NEGATIVE, (uint64_t)(-(Value + 0x01)));
+    }
+    else
+    {
+        this->_writeHead(MQTT_CBOR_UNSIGNED, (uint64_t)Value);
+    }
+}
+
+void MQTTCBORWriter::AddFloat(float Value)
+{
+    uint32_t Bits;
+    uint8_t Temp[5];
+
+    memcpy(&Bits, &Value, sizeof(Bits));
+    Temp[0] = 0xFA;
+    for(uint8_t i = 0x00; i < 0x04; i++)
+    {
+        Temp[0x01 + i] = Bits >> (0x18 - (i << 0x03));
+    }
+
+    this->_writeData(Temp, sizeof(Temp));
+}
+
+void MQTTCBORWriter::AddDouble(double Value)
+{
+    uint64_t Bits;
+    uint8_t Temp[9];
+
+    memcpy(&Bits, &Value, sizeof(Bits));
+    Temp[0] = 0xFB;
+    for(uint8_t i = 0x00; i < 0x08; i++)
+    {
+        Temp[0x01 + i] = Bits >> (0x38 - (i << 0x03));
+    }
+
+    this->_writeData(Temp, sizeof(Temp));
+}
+
+void MQTTCBORWriter::AddBool(bool Value)
+{
+    this->_writeHead(MQTT_CBOR_SIMPLE, Value ? MQTT_CBOR_TRUE : MQTT_CBOR_FALSE);
+}
+
+void MQTTCBORWriter::AddNull(void)
+{
+    this->_writeHead(MQTT_CBOR_SIMPLE, MQTT_CBOR_NULL);
+}
+
+void MQTTCBORWriter::AddText(const char* Text)
+{
+    this->AddText(Text, (Text != NULL) ? strlen(Text) : 0x00);
+}
+
+void MQTTCBORWriter::AddText(const char* Text, uint16_t Length)
+{
+    this->_writeHead(MQTT_CBOR_TEXT, Length);
+    this->_writeData((const uint8_t*)Text, Length);
+}
+
+void MQTTCBORWriter::AddBytes(const uint8_t* Data, uint16_t Length)
+{
+    this->_writeHead(MQTT_CBOR_BYTES, Length);
+    this->_writeData(Data, Length);
+}
+
+bool MQTTCBORWriter::isValid(void) const
+{
+    return !this->_mOverflow;
+}
+
+uint16_t MQTTCBORWriter::Length(void) const
+{
+    return this->_mOverflow ? 0x00 : this->_mOffset;
+}
+
+void MQTTCBORWriter::_writeHead(uint8_t Major, uint64_t Value)
+{
+    uint8_t Temp[9];
+    uint8_t Bytes;
+
+    // Use the shortest encoding for the argument
+    if(Value < 0x18)
+    {
+        Temp[0] = (Major << 0x05) | Value;
+        Bytes = 0x00;
+    }
+    else if(Value <= 0xFF)
+    {
+        Temp[0] = (Major << 0x05) | 0x18;
+        Bytes = 0x01;
+    }
+    else if(Value <= 0xFFFF)
+    {
+        Temp[0] = (Major << 0x05) | 0x19;
+        Bytes = 0x02;
+    }
+    else if(Value <= 0xFFFFFFFF)
+    {
+        Temp[0] = (Major << 0x05) | 0x1A;
+        Bytes = 0x04;
+    }
+    else
+    {
+        Temp[0] = (Major << 0x05) | 0x1B;
+        Bytes = 0x08;
+    }
+
+    for(uint8_t i = 0x00; i < Bytes; i++)
+    {
+        Temp[0x01 + i] = Value >> ((Bytes - i - 0x01) << 0x03);
+    }
+
+    this->_writeData(Temp, Bytes + 0x01);
+}
+
+void MQTTCBORWriter::_writeData(const uint8_t* Data, uint16_t Length)
+{
+    if(this->_mOverflow || ((Length > 0x00) && (Data == NULL)) || ((uint32_t)(this->_mOffset + Length) > this->_mSize))
+    {
+        this->_mOverflow = true;
+
+        return;
+    }
+
+    memcpy(this->_mBuffer + this->_mOffset, Data, Length);
+    this->_mOffset += Length;
+}
+
+MQTTCBORReader::MQTTCBORReader(const uint8_t* Buffer, uint16_t Length) : _mBuffer(Buffer), _mOffset(0x00), _mLength(Length), _mValid(Buffer != NULL)
+{
+}
+
+bool MQTTCBORReader::Next(MQTT_CBOR_Item* Item)
+{
+    uint16_t Available = this->_mLength - this->_mOffset;
+    const uint8_t* Data = this->_mBuffer + this->_mOffset;
+    uint8_t Additional;
+    uint8_t Bytes;
+
+    if(!this->_mValid || (Available == 0x00))
+    {
+        return false;
+    }
+
+    Item->Type = (MQTT_CBOR_Type)(Data[0] >> 0x05);
+    Item->Value = 0x00;
+    Item->Float = 0.0;
+    Item->Data = NULL;
+    Item->Length = 0x00;
+
+    // Get the length of the argument. Indefinite lengths aren't supported
+    Additional = Data[0] & 0x1F;
+    if(Additional < 0x18)
+    {
+        Bytes = 0x00;
+        Item->Value = Additional;
+    }
+    else if(Additional <= 0x1B)
+    {
+        Bytes = 0x01 << (Additional - 0x18);
+    }
+    else
+    {
+        this->_mValid = false;
+
+        return false;
+    }
+
+    if(Available < (0x01 + Bytes))
+    {
+        this->_mValid = false;
+
+        return false;
+    }
+
+    for(uint8_t i = 0x00; i < Bytes; i++)
+    {
+        Item->Value = (Item->Value << 0x08) | Data[0x01 + i];
+    }
+
+    this->_mOffset += 0x01 + Bytes;
+
+    switch(Item->Type)
+    {
+        case(MQTT_CBOR_BYTES):
+        case(MQTT_CBOR_TEXT):
+        {
+            if(Item->Value > (uint64_t)(this->_mLength - this->_mOffset))
+            {
+                this->_mValid = false;
+
+                return false;
+            }
+
+            Item->Data = this->_mBuffer + this->_mOffset;
+            Item->Length = Item->Value;
+            this->_mOffset += Item->Length;
+
+            break;
+        }
+        case(MQTT_CBOR_SIMPLE):
+        {
+            // Half, single and double precision floating point numbers
+            if(Additional == 0x19)
+            {
+                uint16_t Half = Item->Value;
+                int16_t Exponent = (Half >> 0x0A) & 0x1F;
+                double Mantissa = Half & 0x3FF;
+
+                if(Exponent == 0x00)
+                {
+                    Item->Float = ldexp(Mantissa, -24);
+                }
+                else if(Exponent == 0x1F)
+                {
+                    Item->Float = (Mantissa == 0.0) ? INFINITY : NAN;
+                }
+                else
+                {
+                    Item->Float = ldexp(Mantissa + 1024.0, Exponent - 25);
+                }
+
+                if(Half & 0x8000)
+                {
+                    Item->Float = -Item->Float;
+                }
+
+                Item->Type = MQTT_CBOR_FLOAT;
+            }
+            else if(Additional == 0x1A)
+            {
+                uint32_t Bits = Item->Value;
+                float Temp;
+
+                memcpy(&Temp, &Bits, sizeof(Temp));
+                Item->Float = Temp;
+                Item->Type = MQTT_CBOR_FLOAT;
+            }
+            else if(Additional == 0x1B)
+            {
+                memcpy(&Item->Float, &Item->Value, sizeof(Item->Float));
+                Item->Type = MQTT_CBOR_FLOAT;
+            }
+
+            break;
+        }
+        default:
+        {
+            break;
+        }
+    }
+
+    return true;
+}
+
+bool MQTTCBORReader::Skip(const MQTT_CBOR_Item* Item)
+{
+    MQTT_CBOR_Item Temp;
+    uint64_t Pending;
+
+    switch(Item->Type)
+    {
+        case(MQTT_CBOR_ARRAY):
+        {
+            Pending = Item->Value;
+
+            break;
+        }
+        case(MQTT_CBOR_MAP):
+        {
+            Pending = Item->Value << 0x01;
+
+            break;
+        }
+        case(MQTT_CBOR_TAG):
+        {
+            Pending = 0x01;
+
+            break;
+        }
+        default:
+        {
+            return true;
+        }
+    }
+
+    // Nested containers add their items to the pending items
+    while(Pending > 0x00)
+    {
+        // Each item needs at least one byte
+        if((Pending > (uint64_t)(this->_mLength - this->_mOffset)) || !this->Next(&Temp))
+        {
+            this->_mValid = false;
+
+            return false;
+        }
+
+        Pending--;
+        if(Temp.Type == MQTT_CBOR_ARRAY)
+        {
+            Pending += Temp.Value;
+        }
+        else if(Temp.Type == MQTT_CBOR_MAP)
+        {
+            Pending += Temp.Value << 0x01;
+        }
+        else if(Temp.Type == MQTT_CBOR_TAG)
+        {
+            Pending += 0x01;
+        }
+    }
+
+    return true;
+}
+
+bool MQTTCBORReader::isValid(void) const
+{
+    return this->_mValid;
+}
+
+bool MQTTCBORReader::isFinished(void) const
+{
+    return this->_mValid && (this->_mOffset == this->_mLength);
+}
\ No newline at end of file
@@ -0,0 +1,205 @@
+/*
+ * MQTT_CBOR.h
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: CBOR payload encoder and decoder.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTT_CBOR.h
+ *  @brief CBOR payload encoder and decoder.
+ *		   Please read
+ *			- https://www.rfc-editor.org/rfc/rfc8949.html
+ *		   when you need more information.
+ *
+ *  @author Daniel Kampert
+ */
+
+#ifndef MQTT_CBOR_H_
+#define MQTT_CBOR_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** @brief CBOR item types.
+ */
+typedef enum
+{
+    MQTT_CBOR_UNSIGNED = 0x00,                              /**< Unsigned integer. */
+    MQTT_CBOR_NEGATIVE = 0x01,                              /**< Negative integer. */
+    MQTT_CBOR_BYTES = 0x02,                                 /**< Byte string. */
+    MQTT_CBOR_TEXT = 0x03,                                  /**< UTF-8 text string. */
+    MQTT_CBOR_ARRAY = 0x04,                                 /**< Array. The items follow the array. */
+    MQTT_CBOR_MAP = 0x05,                                   /**< Map. The key / value pairs follow the map. */
+    MQTT_CBOR_TAG = 0x06,                                   /**< Tag. The tagged item follows the tag. */
+    MQTT_CBOR_SIMPLE = 0x07,                                /**< Simple value (false, true, null, undefined). */
+    MQTT_CBOR_FLOAT = 0x08,                                 /**< Floating point number. */
+} MQTT_CBOR_Type;
+
+/** @brief CBOR simple values.
+ */
+typedef enum
+{
+    MQTT_CBOR_FALSE = 0x14,                                 /**< false. */
+    MQTT_CBOR_TRUE = 0x15,                                  /**< true. */
+    MQTT_CBOR_NULL = 0x16,                                  /**< null. */
+    MQTT_CBOR_UNDEFINED = 0x17,                             /**< undefined. */
+} MQTT_CBOR_Simple;
+
+/** @brief Decoded CBOR item.
+ */
+typedef struct
+{
+    MQTT_CBOR_Type Type;                                    /**< Item type. */
+    uint64_t Value;                                         /**< Integer value (-1 - Value for negative integers), number of array items / map pairs, tag or simple value. */
+    double Float;                                           /**< Value of floating point numbers. */
+    const uint8_t* Data;                                    /**< Pointer to the data of byte and text strings. */
+    uint16_t Length;                                        /**< Length of byte and text strings. */
+} MQTT_CBOR_Item;
+
+/** @brief Writer for CBOR encoded payloads. The items are encoded directly into the given buffer,
+ *         i. e. the payload area of a #MQTT::Writer.
+ */
+class MQTTCBORWriter
+{
+    public:
+        /** @brief          Constructor.
+         *  @param Buffer   Output buffer
+         *  @param Size     Available bytes
+         */
+        MQTTCBORWriter(uint8_t* Buffer, uint16_t Size);
+
+        /** @brief          Start a map. Add #Count key / value pairs afterwards.
+         *  @param Count    Number of pairs
+         */
+        void BeginMap(uint16_t Count);
+
+        /** @brief          Start an array. Add #Count items afterwards.
+         *  @param Count    Number of items
+         */
+        void BeginArray(uint16_t Count);
+
+        /** @brief          Add an unsigned integer.
+         *  @param Value    Value
+         */
+        void AddUnsigned(uint64_t Value);
+
+        /** @brief          Add a signed integer.
+         *  @param Value    Value
+         */
+        void AddInteger(int64_t Value);
+
+        /** @brief          Add a single precision floating point number.
+         *  @param Value    Value
+         */
+        void AddFloat(float Value);
+
+        /** @brief          Add a double precision floating point number.
+         *  @param Value    Value
+         */
+        void AddDouble(double Value);
+
+        /** @brief          Add a boolean.
+         *  @param Value    Value
+         */
+        void AddBool(bool Value);
+
+        /** @brief Add null.
+         */
+        void AddNull(void);
+
+        /** @brief          Add a text string.
+         *  @param Text     UTF-8 string
+         */
+        void AddText(const char* Text);
+
+        /** @brief          Add a text string.
+         *  @param Text     UTF-8 string
+         *  @param Length   Length of the string
+         */
+        void AddText(const char* Text, uint16_t Length);
+
+        /** @brief          Add a byte string.
+         *  @param Data     Data
+         *  @param Length   Length of the data
+         */
+        void AddBytes(const uint8_t* Data, uint16_t Length);
+
+        /** @brief	Check if all items fit into the buffer.
+         *  @return	#true when valid
+         */
+        bool isValid(void) const;
+
+        /** @brief	Get the length of the encoded data.
+         *  @return	Length in bytes or 0 when the buffer is too small
+         */
+        uint16_t Length(void) const;
+
+    private:
+        uint8_t* _mBuffer;
+        uint16_t _mSize;
+        uint16_t _mOffset;
+        bool _mOverflow;
+
+        void _writeHead(uint8_t Major, uint64_t Value);
+        void _writeData(const uint8_t* Data, uint16_t Length);
+};
+
+/** @brief Cursor-style reader for CBOR encoded payloads. The reader doesn't copy any data,
+ *         strings point into the payload.
+ */
+class MQTTCBORReader
+{
+    public:
+        /** @brief          Constructor.
+         *  @param Buffer   CBOR encoded data
+         *  @param Length   Length of the data
+         */
+        MQTTCBORReader(const uint8_t* Buffer, uint16_t Length);
+
+        /** @brief          Get the next item.
+         *  @param Item     Pointer to the item object
+         *  @return         #true when an item was read
+         */
+        bool Next(MQTT_CBOR_Item* Item);
+
+        /** @brief          Skip the content of an array, map or tag, which was returned by #Next.
+         *  @param Item     Array, map or tag item
+         *  @return         #true when successful
+         */
+        bool Skip(const MQTT_CBOR_Item* Item);
+
+        /** @brief	Check if the data is well-formed (so far).
+         *  @return	#true when valid
+         */
+        bool isValid(void) const;
+
+        /** @brief	Check if all data has been read.
+         *  @return	#true when finished
+         */
+        bool isFinished(void) const;
+
+    private:
+        const uint8_t* _mBuffer;
+        uint16_t _mOffset;
+        uint16_t _mLength;
+        bool _mValid;
+};
+
+#endif
\ No newline at end of file
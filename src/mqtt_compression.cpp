@@ -0,0 +1,225 @@
+/*
+ * MQTT_Compression.cpp
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: LZSS payload compression for the MQTT client.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTT_Compression.cpp
+ *  @brief LZSS payload compression for the MQTT client.
+ *
+ *  @author Daniel Kampert
+ */
+
+#include <string.h>
+
+#include "mqtt_compression.h"
+
+/** @brief Largest offset of a match.
+ */
+#define MQTT_LZSS_WINDOW                            4096
+
+/** @brief Shortest match.
+ */
+#define MQTT_LZSS_MIN_MATCH                         3
+
+/** @brief Longest match.
+ */
+#define MQTT_LZSS_MAX_MATCH                         18
+
+uint16_t MQTT_Compress(const uint8_t* Input, uint16_t Length, uint8_t* Output, uint16_t Size)
+{
+    uint16_t In = 0x00;
+    uint16_t Out = MQTT_COMPRESSION_HEADER_SIZE;
+    uint16_t FlagOffset = 0x00;
+    uint8_t Bit = 0x08;
+
+    // The compressed payload must be smaller than the original payload
+    if(Size >= Length)
+    {
+        Size = Length - 0x01;
+    }
+
+    if((Input == NULL) || (Output == NULL) || (Length == 0x00) || (Size <= MQTT_COMPRESSION_HEADER_SIZE))
+    {
+        return 0x00;
+    }
+
+    memcpy(Output, MQTT_COMPRESSION_MAGIC, 0x03);
+    Output[3] = Length >> 0x08;
+    Output[4] = Length & 0xFF;
+
+    while(In < Length)
+    {
+        uint16_t BestLength = 0x00;
+        uint16_t BestOffset = 0x00;
+
+        // Start a new group
+        if(Bit == 0x08)
+        {
+            if(Out >= Size)
+            {
+                return 0x00;
+            }
+
+            FlagOffset = Out++;
+            Output[FlagOffset] = 0x00;
+            Bit = 0x00;
+        }
+
+        // Search the longest match in the previous bytes
+        for(uint16_t Start = (In > MQTT_LZSS_WINDOW) ? (In - MQTT_LZSS_WINDOW) : 0x00; Start < In; Start++)
+        {
+            uint16_t Match = 0x00;
+
+            while((Match < MQTT_LZSS_MAX_MATCH) && ((In + Match) < Length) && (Input[Start + Match] == Input[In + Match]))
+            {
+                Match++;
+            }
+
+            if(Match > BestLength)
+            {
+                BestLength = Match;
+                BestOffset = In - Start;
+
+                if(Match == MQTT_LZSS_MAX_MATCH)
+                {
+                    break;
+                }
+            }
+        }
+
+        if(BestLength >= MQTT_LZSS_MIN_MATCH)
+        {
+            uint16_t Token = ((BestOffset - 0x01) << 0x04) | (BestLength - MQTT_LZSS_MIN_MATCH);
+
+            if((Out + 0x02) > Size)
+            {
+                return 0x00;
+            }
+
+            Output[FlagOffset] |= (0x01 << Bit);
+            Output[Out++] = Token >> 0x08;
+            Output[Out++] = Token & 0xFF;
+            In += BestLength;
+        }
+        else
+        {
+            if(Out >= Size)
+            {
+                return 0x00;
+            }
+
+            Output[Out++] = Input[In++];
+        }
+
+        Bit++;
+    }
+
+    return Out;
+}
+
+bool MQTT_Decompress(const uint8_t* Input, uint16_t Length, uint8_t* Output, uint16_t Size, uint16_t* Bytes)
+{
+    uint16_t In = MQTT_COMPRESSION_HEADER_SIZE;
+    uint16_t Out = 0x00;
+    uint16_t Original;
+
+    if(!MQTT_IsCompressed(Input, Length) || (Output == NULL) || (Bytes == NULL))
+    {
+        return false;
+    }
+
+    Original = (Input[3] << 0x08) | Input[4];
+    if(Original > Size)
+    {
+        return false;
+    }
+
+    while(Out < Original)
+    {
+        uint8_t Flags;
+
+        if(In >= Length)
+        {
+            return false;
+        }
+
+        Flags = Input[In++];
+        for(uint8_t Bit = 0x00; (Bit < 0x08) && (Out < Original); Bit++)
+        {
+            if(Flags & (0x01 << Bit))
+            {
+                uint16_t Token;
+                uint16_t Offset;
+                uint16_t Match;
+
+                if((In + 0x02) > Length)
+                {
+                    return false;
+                }
+
+                Token = (Input[In] << 0x08) | Input[In + 0x01];
+                In += 0x02;
+                Offset = (Token >> 0x04) + 0x01;
+                Match = (Token & 0x0F) + MQTT_LZSS_MIN_MATCH;
+
+                if((Offset > Out) || ((Out + Match) > Original))
+                {
+                    return false;
+                }
+
+                // Matches can overlap with the output, so the bytes are copied one by one
+                for(uint16_t i = 0x00; i < Match; i++, Out++)
+                {
+                    Output[Out] = Output[Out - Offset];
+                }
+            }
+            else
+            {
+                if(In >= Length)
+                {
+                    return false;
+                }
+
+                Output[Out++] = Input[In++];
+            }
+        }
+    }
+
+    *Bytes = Out;
+
+    return (In == Length);
+}
+
+bool MQTT_IsCompressed(const uint8_t* Input, uint16_t Length)
+{
+    return (Input != NULL) && (Length > MQTT_COMPRESSION_HEADER_SIZE) && (memcmp(Input, MQTT_COMPRESSION_MAGIC, 0x03) == 0x00);
+}
+
+bool MQTT_NeedsEscape(const uint8_t* Input, uint16_t Length)
+{
+    return (Input != NULL) && (Length >= MQTT_COMPRESSION_ESCAPE_SIZE) && ((memcmp(Input, MQTT_COMPRESSION_MAGIC, 0x03) == 0x00) || (memcmp(Input, MQTT_COMPRESSION_ESCAPE, MQTT_COMPRESSION_ESCAPE_SIZE) == 0x00));
+}
+
+bool MQTT_IsEscaped(const uint8_t* Input, uint16_t Length)
+{
+    return (Input != NULL) && (Length >= MQTT_COMPRESSION_ESCAPE_SIZE) && (memcmp(Input, MQTT_COMPRESSION_ESCAPE, MQTT_COMPRESSION_ESCAPE_SIZE) == 0x00);
+}
@@ -0,0 +1,99 @@
+/*
+ * MQTT_Compression.h
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: LZSS payload compression for the MQTT client.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTT_Compression.h
+ *  @brief LZSS payload compression for the MQTT client. The compressor uses the payload itself as dictionary
+ *         and doesn't need any additional memory.
+ *         Compressed payloads start with #MQTT_COMPRESSION_MAGIC followed by the original length (two bytes)
+ *         and the LZSS stream. The stream consists of a flag byte for each group of eight items (LSB first).
+ *         A set flag marks a match (two bytes with a 12 bit offset and a 4 bit length), a cleared flag a literal byte.
+ *         Uncompressed payloads, which start with the marker, are escaped with #MQTT_COMPRESSION_ESCAPE.
+ *
+ *  @author Daniel Kampert
+ */
+
+#ifndef MQTT_COMPRESSION_H_
+#define MQTT_COMPRESSION_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** @brief Marker for compressed payloads.
+ */
+#define MQTT_COMPRESSION_MAGIC                      "\x00LZ"
+
+/** @brief Size of the header of compressed payloads (marker and original length).
+ */
+#define MQTT_COMPRESSION_HEADER_SIZE                0x05
+
+/** @brief Marker in front of uncompressed payloads, which start with #MQTT_COMPRESSION_MAGIC or with the marker itself.
+ *         The receiver removes the marker, so these payloads are never decompressed.
+ */
+#define MQTT_COMPRESSION_ESCAPE                     "\x00LE"
+
+/** @brief Size of #MQTT_COMPRESSION_ESCAPE.
+ */
+#define MQTT_COMPRESSION_ESCAPE_SIZE                0x03
+
+/** @brief          Compress a payload.
+ *  @param Input    Payload
+ *  @param Length   Length of the payload
+ *  @param Output   Output buffer. Must not overlap with the payload
+ *  @param Size     Size of the output buffer
+ *  @return         Length of the compressed payload or 0 when the compressed payload isn't smaller
+ */
+uint16_t MQTT_Compress(const uint8_t* Input, uint16_t Length, uint8_t* Output, uint16_t Size);
+
+/** @brief          Decompress a payload.
+ *  @param Input    Compressed payload
+ *  @param Length   Length of the compressed payload
+ *  @param Output   Output buffer
+ *  @param Size     Size of the output buffer
+ *  @param Bytes    Pointer to the length of the decompressed payload
+ *  @return         #true when successful
+ */
+bool MQTT_Decompress(const uint8_t* Input, uint16_t Length, uint8_t* Output, uint16_t Size, uint16_t* Bytes);
+
+/** @brief          Check if a payload is compressed.
+ *  @param Input    Payload
+ *  @param Length   Length of the payload
+ *  @return         #true when the payload starts with #MQTT_COMPRESSION_MAGIC
+ */
+bool MQTT_IsCompressed(const uint8_t* Input, uint16_t Length);
+
+/** @brief          Check if an uncompressed payload must be escaped with #MQTT_COMPRESSION_ESCAPE.
+ *  @param Input    Payload
+ *  @param Length   Length of the payload
+ *  @return         #true when the payload starts with #MQTT_COMPRESSION_MAGIC or #MQTT_COMPRESSION_ESCAPE
+ */
+bool MQTT_NeedsEscape(const uint8_t* Input, uint16_t Length);
+
+/** @brief          Check if a payload is escaped.
+ *  @param Input    Payload
+ *  @param Length   Length of the payload
+ *  @return         #true when the payload starts with #MQTT_COMPRESSION_ESCAPE
+ */
+bool MQTT_IsEscaped(const uint8_t* Input, uint16_t Length);
+
+#endif
\ No newline at end of file
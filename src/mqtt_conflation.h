@@ -0,0 +1,280 @@
+/*
+ * MQTT_Conflation.h
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Conflation table for latest-value topics.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTT_Conflation.h
+ *  @brief Conflation table for latest-value topics.
+ *
+ *  @author Daniel Kampert
+ */
+
+#ifndef MQTT_CONFLATION_H_
+#define MQTT_CONFLATION_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "mqtt_thread.h"
+#include "mqtt_topic.h"
+
+/** @brief Maximum length of a conflated topic.
+ */
+#ifndef MQTT_CONFLATION_TOPIC_LENGTH
+    #define MQTT_CONFLATION_TOPIC_LENGTH            64
+#endif
+
+/** @brief Hash table with the latest pending message of each registered topic. The topics are registered once
+ *         and are found with a single hash calculation. The entries are protected by a mutex, because an entry
+ *         is written by the publishing threads and read by the transmitting thread.
+ *         Each entry has a second message, which is used by one publishing thread at a time to build a newer
+ *         message. So a pending message is replaced without a free queue entry.
+ *  @tparam T       Message type
+ *  @tparam Size    Number of topics. 0 removes the table
+ */
+template<typename T, uint8_t Size>
+class MQTTConflationTable
+{
+    static_assert(Size > 0, "Conflation table needs at least one entry!");
+
+    public:
+        /** @brief Constructor.
+         */
+        MQTTConflationTable(void) : _mCount(0x00)
+        {
+            for(uint8_t i = 0x00; i < Size; i++)
+            {
+                this->_mEntries[i].Used = false;
+                this->_mEntries[i].Pending = false;
+                this->_mEntries[i].Staged = false;
+            }
+        }
+
+        /** @brief          Register a topic.
+         *                  NOTE: Must not be called while other threads are publishing!
+         *  @param Topic    Topic string
+         *  @param Length   Length of the topic
+         *  @return         #true when the topic is registered
+         */
+        bool Add(const char* Topic, uint16_t Length)
+        {
+            uint32_t Hash;
+
+            if((Topic == NULL) || (Length == 0x00) || (Length > MQTT_CONFLATION_TOPIC_LENGTH))
+            {
+                return false;
+            }
+            else if(this->Find(Topic, Length) >= 0x00)
+            {
+                return true;
+            }
+
+            Hash = MQTT_HashTopic(Topic, Length);
+            for(uint8_t i = 0x00; i < Size; i++)
+            {
+                Entry* Current = &this->_mEntries[(Hash + i) % Size];
+
+                if(!Current->Used)
+                {
+                    Current->Hash = Hash;
+                    Current->Length = Length;
+                    memcpy(Current->Topic, Topic, Length);
+                    Current->Used = true;
+                    this->_mCount++;
+
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        /** @brief          Find the entry of a topic.
+         *  @param Topic    Topic string
+         *  @param Length   Length of the topic
+         *  @return         Index of the entry or -1 when the topic isn't registered
+         */
+        int16_t Find(const char* Topic, uint16_t Length) const
+        {
+            uint32_t Hash;
+
+            if(this->_mCount == 0x00)
+            {
+                return -1;
+            }
+
+            Hash = MQTT_HashTopic(Topic, Length);
+            for(uint8_t i = 0x00; i < Size; i++)
+            {
+                uint8_t Index = (Hash + i) % Size;
+                const Entry* Current = &this->_mEntries[Index];
+
+                if(!Current->Used)
+                {
+                    break;
+                }
+
+                if((Current->Hash == Hash) && (Current->Length == Length) && (memcmp(Current->Topic, Topic, Length) == 0x00))
+                {
+                    return Index;
+                }
+            }
+
+            return -1;
+        }
+
+        /** @brief          Lock an entry and get the message.
+         *  @param Index    Index from #Find
+         *  @param Pending  Pointer to the pending flag of the message
+         *  @return         Pointer to the message
+         */
+        T* Acquire(uint8_t Index, bool* Pending)
+        {
+            Entry* Current = &this->_mEntries[Index];
+
+            this->_mLock.Lock();
+            *Pending = Current->Pending;
+
+            return &Current->Item;
+        }
+
+        /** @brief          Unlock an entry from #Acquire.
+         *  @param Index    Index from #Find
+         *  @param Pending  #true when the message waits for the transmission
+         */
+        void Release(uint8_t Index, bool Pending)
+        {
+            Entry* Current = &this->_mEntries[Index];
+
+            Current->Pending = Pending;
+            this->_mLock.Unlock();
+        }
+
+        /** @brief          Claim the staging message of an entry.
+         *  @param Index    Index from #Find
+         *  @return         Pointer to the staging message or #NULL when another thread uses it
+         */
+        T* Stage(uint8_t Index)
+        {
+            Entry* Current = &this->_mEntries[Index];
+            T* Item = NULL;
+
+            this->_mLock.Lock();
+            if(!Current->Staged)
+            {
+                Current->Staged = true;
+                Item = &Current->Next;
+            }
+            this->_mLock.Unlock();
+
+            return Item;
+        }
+
+        /** @brief          Return the staging message from #Stage.
+         *  @param Index    Index from #Find
+         */
+        void Unstage(uint8_t Index)
+        {
+            this->_mLock.Lock();
+            this->_mEntries[Index].Staged = false;
+            this->_mLock.Unlock();
+        }
+
+        /** @brief          Get the entry of a staging message.
+         *  @param Item     Message
+         *  @return         Index of the entry or -1 when the message isn't a staging message
+         */
+        int16_t IndexOf(const T* Item) const
+        {
+            for(uint8_t i = 0x00; i < Size; i++)
+            {
+                if(Item == &this->_mEntries[i].Next)
+                {
+                    return i;
+                }
+            }
+
+            return -1;
+        }
+
+    private:
+        typedef struct
+        {
+            bool Used;
+            bool Pending;
+            bool Staged;
+            uint32_t Hash;
+            uint16_t Length;
+            char Topic[MQTT_CONFLATION_TOPIC_LENGTH];
+            T Item;
+            T Next;
+        } Entry;
+
+        Entry _mEntries[Size];
+        MQTTMutex _mLock;
+        uint8_t _mCount;
+};
+
+/** @brief Removed conflation table. No topic can be registered, so all messages are queued.
+ */
+template<typename T>
+class MQTTConflationTable<T, 0>
+{
+    public:
+        bool Add(const char*, uint16_t)
+        {
+            return false;
+        }
+
+        int16_t Find(const char*, uint16_t) const
+        {
+            return -1;
+        }
+
+        T* Acquire(uint8_t, bool* Pending)
+        {
+            *Pending = false;
+
+            return NULL;
+        }
+
+        void Release(uint8_t, bool)
+        {
+        }
+
+        T* Stage(uint8_t)
+        {
+            return NULL;
+        }
+
+        void Unstage(uint8_t)
+        {
+        }
+
+        int16_t IndexOf(const T*) const
+        {
+            return -1;
+        }
+};
+
+#endif
\ No newline at end of file
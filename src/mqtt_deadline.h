@@ -0,0 +1,237 @@
+/*
+ * MQTT_Deadline.h
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Earliest-deadline-first outbound queue.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTT_Deadline.h
+ *  @brief Earliest-deadline-first outbound queue.
+ *
+ *  @author Daniel Kampert
+ */
+
+#ifndef MQTT_DEADLINE_H_
+#define MQTT_DEADLINE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "mqtt_queue.h"
+
+/** @brief Outbound queue for multiple producers and one consumer, which hands the elements to the consumer
+ *         in the order of their deadlines. The producers use a #MQTTMPSCQueue and the consumer moves the committed
+ *         elements into a binary heap. Elements with the same deadline keep their order.
+ *         The storage of an element is returned to the producers when all older elements are finished, so a
+ *         single element with a late deadline can block the producers until it is transmitted.
+ *  @tparam T       Element type. Needs a #Deadline member with the deadline in ms
+ *  @tparam Size    Number of elements. Must be a power of two. 0 removes the queue
+ */
+template<typename T, uint16_t Size>
+class MQTTDeadlineQueue
+{
+    public:
+        /** @brief Constructor.
+         */
+        MQTTDeadlineQueue(void) : _mCount(0x00), _mScheduled(0x00), _mSequence(0x00)
+        {
+            for(uint16_t i = 0x00; i < Size; i++)
+            {
+                this->_mDone[i] = false;
+            }
+        }
+
+        /** @brief  Claim a free element. Can be called by any thread.
+         *  @return Pointer to the free element or #NULL when the queue is full
+         */
+        T* Reserve(void)
+        {
+            return this->_mQueue.Reserve();
+        }
+
+        /** @brief      Hand a claimed element over to the consumer. The deadline must be set.
+         *  @param Item Element from #Reserve
+         */
+        void Commit(T* Item)
+        {
+            this->_mQueue.Commit(Item);
+        }
+
+        /** @brief  Get the element with the earliest deadline. Must only be called by the consumer.
+         *  @return Pointer to the element or #NULL when no element is committed
+         */
+        T* Peek(void)
+        {
+            T* Item;
+
+            // Move the new elements into the heap
+            while((Item = this->_mQueue.PeekAt(this->_mScheduled)) != NULL)
+            {
+                this->_push(Item);
+                this->_mScheduled++;
+            }
+
+            return (this->_mCount > 0x00) ? this->_mHeap[0].Item : NULL;
+        }
+
+        /** @brief Remove the element from #Peek.
+         */
+        void Release(void)
+        {
+            T* Item;
+
+            this->_mDone[this->_mQueue.IndexOf(this->_mHeap[0].Item)] = true;
+            this->_pop();
+
+            // Return the finished elements in the order of the producers
+            while(((Item = this->_mQueue.Peek()) != NULL) && this->_mDone[this->_mQueue.IndexOf(Item)])
+            {
+                this->_mDone[this->_mQueue.IndexOf(Item)] = false;
+                this->_mQueue.Release();
+                this->_mScheduled--;
+            }
+        }
+
+        /** @brief  Get the number of claimed elements.
+         *  @return Number of elements
+         */
+        uint16_t Count(void) const
+        {
+            return this->_mQueue.Count();
+        }
+
+    private:
+        typedef struct
+        {
+            uint32_t Deadline;
+            uint32_t Sequence;
+            T* Item;
+        } Node;
+
+        MQTTMPSCQueue<T, Size> _mQueue;
+        Node _mHeap[Size];
+        bool _mDone[Size];
+        uint16_t _mCount;
+        uint16_t _mScheduled;
+        uint32_t _mSequence;
+
+        /** @brief  Compare two nodes. The time values can overflow.
+         *  @return #true when #A must be transmitted before #B
+         */
+        static bool _before(const Node& A, const Node& B)
+        {
+            if(A.Deadline != B.Deadline)
+            {
+                return ((int32_t)(A.Deadline - B.Deadline) < 0x00);
+            }
+
+            return ((int32_t)(A.Sequence - B.Sequence) < 0x00);
+        }
+
+        void _push(T* Item)
+        {
+            uint16_t Index = this->_mCount++;
+
+            this->_mHeap[Index].Deadline = Item->Deadline;
+            this->_mHeap[Index].Sequence = this->_mSequence++;
+            this->_mHeap[Index].Item = Item;
+
+            while(Index > 0x00)
+            {
+                uint16_t Parent = (Index - 0x01) >> 0x01;
+
+                if(!_before(this->_mHeap[Index], this->_mHeap[Parent]))
+                {
+                    break;
+                }
+
+                Node Temp = this->_mHeap[Index];
+                this->_mHeap[Index] = this->_mHeap[Parent];
+                this->_mHeap[Parent] = Temp;
+                Index = Parent;
+            }
+        }
+
+        void _pop(void)
+        {
+            uint16_t Index = 0x00;
+
+            this->_mHeap[0] = this->_mHeap[--this->_mCount];
+
+            while(true)
+            {
+                uint16_t Smallest = Index;
+                uint16_t Left = (Index << 0x01) + 0x01;
+                uint16_t Right = Left + 0x01;
+
+                if((Left < this->_mCount) && _before(this->_mHeap[Left], this->_mHeap[Smallest]))
+                {
+                    Smallest = Left;
+                }
+
+                if((Right < this->_mCount) && _before(this->_mHeap[Right], this->_mHeap[Smallest]))
+                {
+                    Smallest = Right;
+                }
+
+                if(Smallest == Index)
+                {
+                    break;
+                }
+
+                Node Temp = this->_mHeap[Index];
+                this->_mHeap[Index] = this->_mHeap[Smallest];
+                this->_mHeap[Smallest] = Temp;
+                Index = Smallest;
+            }
+        }
+};
+
+/** @brief Removed queue. #Reserve always fails, so no element is queued.
+ */
+template<typename T>
+class MQTTDeadlineQueue<T, 0>
+{
+    public:
+        T* Reserve(void)
+        {
+            return NULL;
+        }
+
+        void Commit(T*)
+        {
+        }
+
+        T* Peek(void)
+        {
+            return NULL;
+        }
+
+        void Release(void)
+        {
+        }
+
+        uint16_t Count(void) const
+        {
+            return 0x00;
+        }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,219 @@
+/*
+ * MQTT_Delegate.h
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Allocation-free callback delegates for the MQTT client.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTT_Delegate.h
+ *  @brief Allocation-free callback delegates for the MQTT client.
+ *
+ *  @author Daniel Kampert
+ */
+
+#ifndef MQTT_DELEGATE_H_
+#define MQTT_DELEGATE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <type_traits>
+
+/** @brief Size of the inline storage of a delegate.
+ */
+#ifndef MQTT_DELEGATE_SIZE
+    #define MQTT_DELEGATE_SIZE                      (2 * sizeof(void*))
+#endif
+
+template<typename Signature>
+class MQTTDelegate;
+
+/** @brief Callback delegate, which stores the callable inline without using the heap.
+ *         Supported callables are plain functions, functions with a context pointer, member functions
+ *         and small, trivially copyable functors (i. e. a lambda capturing #this).
+ *         The delegate calls a stub function, which is generated for the stored callable. The callables
+ *         passed as template parameters to #Bind are called directly from the stub, so the invocation
+ *         costs a single indirect call.
+ */
+template<typename R, typename... Args>
+class MQTTDelegate<R(Args...)>
+{
+    public:
+        /** @brief Plain function prototype.
+         */
+        typedef R(*Function)(Args...);
+
+        /** @brief Function prototype with context pointer.
+         */
+        typedef R(*Context_Function)(void* Context, Args...);
+
+        /** @brief Constructor. Creates an empty delegate.
+         */
+        MQTTDelegate(void) : _mStub(NULL)
+        {
+        }
+
+        /** @brief          Constructor.
+         *  @param Callback Plain function
+         */
+        MQTTDelegate(Function Callback) : _mStub(NULL)
+        {
+            if(Callback != NULL)
+            {
+                this->_store(Callback);
+                this->_mStub = &MQTTDelegate::_functionStub;
+            }
+        }
+
+        /** @brief          Constructor.
+         *  @param Callback Function with context pointer
+         *  @param Context  Context pointer passed to the function
+         */
+        MQTTDelegate(Context_Function Callback, void* Context) : _mStub(NULL)
+        {
+            if(Callback != NULL)
+            {
+                _Context Temp = {Callback, Context};
+
+                this->_store(Temp);
+                this->_mStub = &MQTTDelegate::_contextStub;
+            }
+        }
+
+        /** @brief          Constructor.
+         *  @param Functor  Trivially copyable functor, which fits into #MQTT_DELEGATE_SIZE
+         */
+        template<typename F, typename = typename std::enable_if<!std::is_convertible<F, Function>::value && !std::is_same<typename std::decay<F>::type, MQTTDelegate>::value>::type>
+        MQTTDelegate(const F& Functor) : _mStub(&MQTTDelegate::_functorStub<F>)
+        {
+            static_assert(sizeof(F) <= MQTT_DELEGATE_SIZE, "Functor is too large for the delegate!");
+            static_assert(std::is_trivially_copyable<F>::value, "Functor must be trivially copyable!");
+
+            this->_store(Functor);
+        }
+
+        /** @brief          Bind a function with a context pointer at compile time.
+         *  @tparam Callback Function with context pointer
+         *  @param Context  Context pointer passed to the function
+         *  @return         Delegate
+         */
+        template<Context_Function Callback>
+        static MQTTDelegate Bind(void* Context)
+        {
+            MQTTDelegate Delegate;
+
+            Delegate._store(Context);
+            Delegate._mStub = &MQTTDelegate::_boundStub<Callback>;
+
+            return Delegate;
+        }
+
+        /** @brief          Bind a member function at compile time.
+         *  @tparam T       Class type
+         *  @tparam Method  Member function
+         *  @param Object   Object for the member function
+         *  @return         Delegate
+         */
+        template<class T, R(T::*Method)(Args...)>
+        static MQTTDelegate Bind(T* Object)
+        {
+            MQTTDelegate Delegate;
+
+            Delegate._store(Object);
+            Delegate._mStub = &MQTTDelegate::_methodStub<T, Method>;
+
+            return Delegate;
+        }
+
+        /** @brief  Check if the delegate holds a callable.
+         *  @return #true when valid
+         */
+        bool isValid(void) const
+        {
+            return (this->_mStub != NULL);
+        }
+
+        /** @brief      Call the stored callable.
+         *  @param A    Arguments for the callable
+         *  @return     Return value of the callable
+         */
+        R operator()(Args... A) const
+        {
+            return this->_mStub(&this->_mStorage, A...);
+        }
+
+    private:
+        typedef R(*Stub)(const void* Storage, Args...);
+
+        typedef struct
+        {
+            Context_Function Callback;
+            void* Context;
+        } _Context;
+
+        Stub _mStub;
+        typename std::aligned_storage<MQTT_DELEGATE_SIZE, alignof(void*)>::type _mStorage;
+
+        template<typename T>
+        void _store(const T& Value)
+        {
+            static_assert(sizeof(T) <= MQTT_DELEGATE_SIZE, "Callable is too large for the delegate!");
+
+            memcpy(&this->_mStorage, &Value, sizeof(T));
+        }
+
+        template<typename T>
+        static const T& _load(const void* Storage)
+        {
+            return *static_cast<const T*>(Storage);
+        }
+
+        static R _functionStub(const void* Storage, Args... A)
+        {
+            return _load<Function>(Storage)(A...);
+        }
+
+        static R _contextStub(const void* Storage, Args... A)
+        {
+            const _Context& Temp = _load<_Context>(Storage);
+
+            return Temp.Callback(Temp.Context, A...);
+        }
+
+        template<Context_Function Callback>
+        static R _boundStub(const void* Storage, Args... A)
+        {
+            return Callback(_load<void*>(Storage), A...);
+        }
+
+        template<class T, R(T::*Method)(Args...)>
+        static R _methodStub(const void* Storage, Args... A)
+        {
+            return (_load<T*>(Storage)->*Method)(A...);
+        }
+
+        template<typename F>
+        static R _functorStub(const void* Storage, Args... A)
+        {
+            return _load<F>(Storage)(A...);
+        }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,106 @@
+/*
+ * MQTT_Features.h
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Compile-time feature selection for the MQTT client.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTT_Features.h
+ *  @brief Compile-time feature selection for the MQTT client.
+ *         Set a feature to 0 to remove its code paths from the binary. The features are constant expressions,
+ *         so the compiler folds the checks and discards the unused branches and handlers.
+ *
+ *  @author Daniel Kampert
+ */
+
+#ifndef MQTT_FEATURES_H_
+#define MQTT_FEATURES_H_
+
+#include <stdint.h>
+
+/** @brief Set to 0 to remove the quality of service 1 (PUBACK flow).
+ */
+#ifndef MQTT_FEATURE_QOS1
+    #define MQTT_FEATURE_QOS1                       1
+#endif
+
+/** @brief Set to 0 to remove the quality of service 2 (PUBREC, PUBREL and PUBCOMP flow).
+ */
+#ifndef MQTT_FEATURE_QOS2
+    #define MQTT_FEATURE_QOS2                       1
+#endif
+
+/** @brief Set to 0 to remove the last will from the connect message.
+ */
+#ifndef MQTT_FEATURE_WILL
+    #define MQTT_FEATURE_WILL                       1
+#endif
+
+/** @brief Set to 0 to remove the user name and the password from the connect message.
+ */
+#ifndef MQTT_FEATURE_AUTH
+    #define MQTT_FEATURE_AUTH                       1
+#endif
+
+/** @brief Set to 0 to remove subscriptions and the processing of received messages.
+ *         The inbound queue, the receive buffer pool and the inbound topic aliases are removed too.
+ */
+#ifndef MQTT_FEATURE_INBOUND
+    #define MQTT_FEATURE_INBOUND                    1
+#endif
+
+/** @brief Enabled features of the client.
+ */
+struct MQTTFeatures
+{
+    static constexpr bool QoS1 = (MQTT_FEATURE_QOS1 != 0);
+    static constexpr bool QoS2 = (MQTT_FEATURE_QOS2 != 0);
+    static constexpr bool Will = (MQTT_FEATURE_WILL != 0);
+    static constexpr bool Authentication = (MQTT_FEATURE_AUTH != 0);
+    static constexpr bool Inbound = (MQTT_FEATURE_INBOUND != 0);
+
+    /** @brief      Check if a quality of service is enabled.
+     *  @param QoS  Quality of service
+     *  @return     #true when enabled
+     */
+    static constexpr bool Supports(uint8_t QoS)
+    {
+        return (QoS == 0x00) || ((QoS == 0x01) && QoS1) || ((QoS == 0x02) && QoS2);
+    }
+
+    /** @brief      Check if messages with a quality of service use a packet identifier.
+     *  @param QoS  Quality of service
+     *  @return     #true when a packet identifier is used
+     */
+    static constexpr bool HasID(uint8_t QoS)
+    {
+        return ((QoS == 0x01) && QoS1) || ((QoS == 0x02) && QoS2);
+    }
+
+    /** @brief  Get the highest enabled quality of service.
+     *  @return Quality of service
+     */
+    static constexpr uint8_t MaximumQoS(void)
+    {
+        return QoS2 ? 0x02 : (QoS1 ? 0x01 : 0x00);
+    }
+};
+
+#endif
\ No newline at end of file
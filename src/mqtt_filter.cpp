@@ -0,0 +1,213 @@
+/*
+ * MQTT_Filter.cpp
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Report-by-exception publish filter.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTT_Filter.cpp
+ *  @brief Report-by-exception publish filter.
+ *
+ *  @author Daniel Kampert
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mqtt_filter.h"
+#include "mqtt_topic.h"
+
+/** @brief          Parse a numeric payload.
+ *  @param Payload  Payload
+ *  @param Length   Length of the payload
+ *  @param Value    Pointer to the value
+ *  @return         #true when the payload is a number
+ */
+static bool MQTT_ParseNumber(const uint8_t* Payload, uint16_t Length, float* Value)
+{
+    char Temp[24];
+    char* End;
+
+    // The payload isn't null-terminated
+    if((Length == 0x00) || (Length >= sizeof(Temp)))
+    {
+        return false;
+    }
+
+    memcpy(Temp, Payload, Length);
+    Temp[Length] = 0x00;
+    *Value = strtof(Temp, &End);
+
+    return (End != Temp) && (*End == 0x00);
+}
+
+MQTTFilter::MQTTFilter(void) : _mCount(0x00)
+{
+    memset(this->_mEntries, 0x00, sizeof(this->_mEntries));
+}
+
+bool MQTTFilter::Add(const char* Topic, uint16_t Length, bool Numeric, float Deadband, uint32_t Heartbeat)
+{
+    Entry* Current;
+
+    if((Topic == NULL) || (Length == 0x00) || (Length > MQTT_FILTER_TOPIC_LENGTH))
+    {
+        return false;
+    }
+
+    // Update a registered topic or use a free entry
+    Current = this->_find(Topic, Length);
+    if(Current == NULL)
+    {
+        uint32_t Hash = MQTT_HashTopic(Topic, Length);
+
+        for(uint8_t i = 0x00; i < MQTT_FILTER_SIZE; i++)
+        {
+            if(!this->_mEntries[(Hash + i) % MQTT_FILTER_SIZE].Used)
+            {
+                Current = &this->_mEntries[(Hash + i) % MQTT_FILTER_SIZE];
+                Current->TopicHash = Hash;
+                Current->TopicLength = Length;
+                memcpy(Current->Topic, Topic, Length);
+                this->_mCount++;
+
+                break;
+            }
+        }
+
+        if(Current == NULL)
+        {
+            return false;
+        }
+    }
+
+    Current->Numeric = Numeric;
+    Current->Deadband = Deadband;
+    Current->Heartbeat = Heartbeat;
+    Current->Valid = false;
+    Current->Used = true;
+
+    return true;
+}
+
+bool MQTTFilter::Check(const char* Topic, uint16_t Length, const uint8_t* Payload, uint16_t PayloadLength, uint32_t Now, MQTT_Filter_Sample* Sample)
+{
+    bool Send = true;
+    Entry* Current;
+
+    Sample->Index = -1;
+
+    if(this->_mCount == 0x00)
+    {
+        return true;
+    }
+
+    Current = this->_find(Topic, Length);
+    if(Current == NULL)
+    {
+        return true;
+    }
+
+    // Payloads, which are no numbers, are compared by their hash
+    Sample->Index = Current - this->_mEntries;
+    Sample->Value = 0.0f;
+    Sample->Hash = 0x00;
+    Sample->Numeric = Current->Numeric && MQTT_ParseNumber(Payload, PayloadLength, &Sample->Value);
+    if(!Sample->Numeric)
+    {
+        Sample->Hash = MQTT_HashTopic((const char*)Payload, PayloadLength);
+    }
+
+    this->_mLock.Lock();
+
+    // A changed payload type is always sent
+    if(Current->Valid && (Sample->Numeric == Current->LastNumeric) && ((Current->Heartbeat == 0x00) || ((Now - Current->LastSent) < Current->Heartbeat)))
+    {
+        if(Sample->Numeric)
+        {
+            Send = (fabsf(Sample->Value - Current->Last.Value) > Current->Deadband);
+        }
+        else
+        {
+            Send = (Sample->Hash != Current->Last.Hash);
+        }
+    }
+
+    this->_mLock.Unlock();
+
+    return Send;
+}
+
+void MQTTFilter::Commit(const MQTT_Filter_Sample* Sample, uint32_t Now)
+{
+    Entry* Current;
+
+    if((Sample->Index < 0x00) || (Sample->Index >= MQTT_FILTER_SIZE))
+    {
+        return;
+    }
+
+    Current = &this->_mEntries[Sample->Index];
+
+    this->_mLock.Lock();
+
+    if(Sample->Numeric)
+    {
+        Current->Last.Value = Sample->Value;
+    }
+    else
+    {
+        Current->Last.Hash = Sample->Hash;
+    }
+
+    Current->LastNumeric = Sample->Numeric;
+    Current->Valid = true;
+    Current->LastSent = Now;
+
+    this->_mLock.Unlock();
+}
+
+bool MQTTFilter::isActive(void) const
+{
+    return (this->_mCount > 0x00);
+}
+
+MQTTFilter::Entry* MQTTFilter::_find(const char* Topic, uint16_t Length)
+{
+    uint32_t Hash = MQTT_HashTopic(Topic, Length);
+
+    for(uint8_t i = 0x00; i < MQTT_FILTER_SIZE; i++)
+    {
+        Entry* Current = &this->_mEntries[(Hash + i) % MQTT_FILTER_SIZE];
+
+        if(!Current->Used)
+        {
+            break;
+        }
+
+        if((Current->TopicHash == Hash) && (Current->TopicLength == Length) && (memcmp(Current->Topic, Topic, Length) == 0x00))
+        {
+            return Current;
+        }
+    }
+
+    return NULL;
+}
\ No newline at end of file
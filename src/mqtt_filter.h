@@ -0,0 +1,133 @@
+/*
+ * MQTT_Filter.h
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Report-by-exception publish filter.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTT_Filter.h
+ *  @brief Report-by-exception publish filter.
+ *
+ *  @author Daniel Kampert
+ */
+
+#ifndef MQTT_FILTER_H_
+#define MQTT_FILTER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "mqtt_thread.h"
+
+/** @brief Number of filtered topics.
+ */
+#ifndef MQTT_FILTER_SIZE
+    #define MQTT_FILTER_SIZE                        8
+#endif
+
+/** @brief Maximum length of a filtered topic.
+ */
+#ifndef MQTT_FILTER_TOPIC_LENGTH
+    #define MQTT_FILTER_TOPIC_LENGTH                64
+#endif
+
+/** @brief Checked payload of a message. Passed to #MQTTFilter::Commit when the message was transmitted.
+ */
+typedef struct
+{
+    int8_t Index;                                           /**< Entry of the topic. -1 when the topic isn't filtered. */
+    bool Numeric;                                           /**< #true when the payload is a number. */
+    float Value;                                            /**< Numeric value of the payload. */
+    uint32_t Hash;                                          /**< Hash of the payload, which is no number. */
+} MQTT_Filter_Sample;
+
+/** @brief Publish filter, which skips messages without a relevant change. Each topic stores the topic and the hash of
+ *         the last payload or the last numeric value. Numeric payloads are decimal text (i. e. "21.5").
+ *         A message is always sent when the heartbeat time has passed since the last message.
+ *         The last payload is only updated by #Commit, so a message, which wasn't transmitted, doesn't suppress the next message.
+ */
+class MQTTFilter
+{
+    public:
+        /** @brief Constructor.
+         */
+        MQTTFilter(void);
+
+        /** @brief              Register a topic.
+         *                      NOTE: Must not be called while other threads are publishing!
+         *  @param Topic        Topic string
+         *  @param Length       Length of the topic
+         *  @param Numeric      #true to compare numeric values with the deadband, #false to compare the payloads
+         *  @param Deadband     Smallest change of a numeric value, which is sent
+         *  @param Heartbeat    Maximum time without a message in ms. 0 to disable the heartbeat
+         *  @return             #true when the topic is registered
+         */
+        bool Add(const char* Topic, uint16_t Length, bool Numeric, float Deadband, uint32_t Heartbeat);
+
+        /** @brief              Check if a message should be sent. The state of the topic isn't changed.
+         *  @param Topic        Topic string
+         *  @param Length       Length of the topic
+         *  @param Payload      Payload
+         *  @param PayloadLength Length of the payload
+         *  @param Now          Current time in ms
+         *  @param Sample       Pointer to the checked payload for #Commit
+         *  @return             #true when the message should be sent
+         */
+        bool Check(const char* Topic, uint16_t Length, const uint8_t* Payload, uint16_t PayloadLength, uint32_t Now, MQTT_Filter_Sample* Sample);
+
+        /** @brief          Store the payload of a transmitted message as last payload of the topic.
+         *  @param Sample   Checked payload from #Check
+         *  @param Now      Current time in ms
+         */
+        void Commit(const MQTT_Filter_Sample* Sample, uint32_t Now);
+
+        /** @brief	Check if topics are registered.
+         *  @return	#true when the filter is used
+         */
+        bool isActive(void) const;
+
+    private:
+        typedef struct
+        {
+            bool Used;
+            bool Numeric;
+            bool Valid;
+            bool LastNumeric;
+            uint16_t TopicLength;
+            uint32_t TopicHash;
+            char Topic[MQTT_FILTER_TOPIC_LENGTH];
+            uint32_t Heartbeat;
+            uint32_t LastSent;
+            float Deadband;
+            union
+            {
+                float Value;
+                uint32_t Hash;
+            } Last;
+        } Entry;
+
+        Entry _mEntries[MQTT_FILTER_SIZE];
+        MQTTMutex _mLock;
+        uint8_t _mCount;
+
+        Entry* _find(const char* Topic, uint16_t Length);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,111 @@
+/*
+ * MQTT_Footprint.cpp
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: RAM footprint accounting for the MQTT client.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTT_Footprint.cpp
+ *  @brief RAM footprint accounting for the MQTT client.
+ *
+ *  @author Daniel Kampert
+ */
+
+#include <string.h>
+
+#include "mqtt_footprint.h"
+
+#if !defined(PARTICLE) && MQTT_HEAP_TRACKING
+
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+/** @brief Size of the header in front of each allocation. Keeps the alignment of the allocation.
+ */
+#define MQTT_HEAP_HEADER                            alignof(max_align_t)
+
+static std::atomic<uint32_t> HeapAllocations(0x00);
+static std::atomic<uint32_t> HeapFrees(0x00);
+static std::atomic<uint32_t> HeapBytes(0x00);
+static std::atomic<uint32_t> HeapPeakBytes(0x00);
+
+void* operator new(size_t Size)
+{
+    uint8_t* Block = (uint8_t*)malloc(Size + MQTT_HEAP_HEADER);
+    if(Block == NULL)
+    {
+        throw std::bad_alloc();
+    }
+
+    // Remember the size for the release
+    *(size_t*)Block = Size;
+
+    uint32_t Bytes = HeapBytes.fetch_add(Size) + Size;
+    uint32_t Peak = HeapPeakBytes;
+    while((Bytes > Peak) && !HeapPeakBytes.compare_exchange_weak(Peak, Bytes));
+    HeapAllocations++;
+
+    return Block + MQTT_HEAP_HEADER;
+}
+
+void operator delete(void* Pointer) noexcept
+{
+    if(Pointer == NULL)
+    {
+        return;
+    }
+
+    uint8_t* Block = (uint8_t*)Pointer - MQTT_HEAP_HEADER;
+
+    HeapBytes -= *(size_t*)Block;
+    HeapFrees++;
+    free(Block);
+}
+
+void operator delete(void* Pointer, size_t) noexcept
+{
+    operator delete(Pointer);
+}
+
+void MQTT_HeapUsage(MQTT_Heap* Heap)
+{
+    if(Heap == NULL)
+    {
+        return;
+    }
+
+    Heap->Allocations = HeapAllocations;
+    Heap->Frees = HeapFrees;
+    Heap->Bytes = HeapBytes;
+    Heap->PeakBytes = HeapPeakBytes;
+}
+
+#else
+
+void MQTT_HeapUsage(MQTT_Heap* Heap)
+{
+    if(Heap != NULL)
+    {
+        memset(Heap, 0x00, sizeof(MQTT_Heap));
+    }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,89 @@
+/*
+ * MQTT_Footprint.h
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: RAM footprint accounting for the MQTT client.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTT_Footprint.h
+ *  @brief RAM footprint accounting for the MQTT client.
+ *
+ *  @author Daniel Kampert
+ */
+
+#ifndef MQTT_FOOTPRINT_H_
+#define MQTT_FOOTPRINT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** @brief RAM budget of a client object, its ping timer and the stack of the I/O thread in bytes. The build fails when
+ *         a client is larger. The stack of the calls into the client must fit into the rest of the budget (see #MQTT_Footprint).
+ *         The default configuration needs about 8.7 KB (5.5 KB client, ping timer and 3 KB stack of the I/O thread) and
+ *         less than 1 KB for the heap and the stack of the calls. The default of 12 KB leaves room for the metrics (about 1 KB
+ *         with #MQTT_METRICS) and the stack of the application callbacks. Raise the budget when larger queues or the capture ring
+ *         are enabled or use 0 to disable the check.
+ */
+#ifndef MQTT_RAM_BUDGET
+    #define MQTT_RAM_BUDGET                         12288
+#endif
+
+/** @brief Set to 1 to count the heap allocations of the host build. The global operators new and delete are replaced then.
+ */
+#ifndef MQTT_HEAP_TRACKING
+    #define MQTT_HEAP_TRACKING                      0
+#endif
+
+#if defined(PARTICLE) && MQTT_HEAP_TRACKING
+    #error "MQTT_HEAP_TRACKING is only supported by the host build!"
+#endif
+
+/** @brief RAM footprint of a client object.
+ */
+typedef struct
+{
+    uint32_t Total;                                         /**< Size of the client object. */
+    uint32_t Buffers;                                       /**< Transmit buffer and buffer for the unsent bytes. */
+    uint32_t Pool;                                          /**< Receive buffer pool. */
+    uint32_t Inbound;                                       /**< Receive queue. */
+    uint32_t Outbound;                                      /**< Outbound, bulk and control queues. */
+    uint32_t Conflation;                                    /**< Conflation table. */
+    uint32_t Diagnostics;                                   /**< Metrics, latency histograms, call profile and capture ring. */
+    uint32_t Heap;                                          /**< Bytes, which were allocated by the client on the heap (i. e. the ping timer). */
+    uint32_t Stack;                                         /**< Deepest measured stack usage of a call into the client. 0 when the profile is disabled. */
+    uint32_t Thread;                                        /**< Stack of the I/O thread (see #MQTT_THREAD_STACK_SIZE). 0 when the thread isn't running. */
+} MQTT_Footprint;
+
+/** @brief Heap usage of the application. Only counted on the host build with #MQTT_HEAP_TRACKING.
+ */
+typedef struct
+{
+    uint32_t Allocations;                                   /**< Number of allocations. */
+    uint32_t Frees;                                         /**< Number of released allocations. */
+    uint32_t Bytes;                                         /**< Allocated bytes. */
+    uint32_t PeakBytes;                                     /**< Largest number of allocated bytes. */
+} MQTT_Heap;
+
+/** @brief      Get the heap usage of the application.
+ *  @param Heap Pointer to the heap usage. All values are 0 without #MQTT_HEAP_TRACKING
+ */
+void MQTT_HeapUsage(MQTT_Heap* Heap);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,314 @@
+/*
+ * MQTT_Latency.h
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Latency histograms for the MQTT client.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTT_Latency.h
+ *  @brief Latency histograms for the MQTT client.
+ *
+ *  @author Daniel Kampert
+ */
+
+#ifndef MQTT_LATENCY_H_
+#define MQTT_LATENCY_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "mqtt_metrics.h"
+#include "mqtt_thread.h"
+
+/** @brief Number of buckets of a latency histogram. Bucket n counts the values from 2^(n - 1) to 2^n - 1 ms
+ *         and the last bucket counts all larger values.
+ */
+#define MQTT_LATENCY_BUCKETS                        16
+
+/** @brief Number of packets, which can wait for an acknowledgement at the same time.
+ *         The oldest timestamp is replaced when all slots are in use.
+ */
+#ifndef MQTT_LATENCY_PENDING
+    #define MQTT_LATENCY_PENDING                    8
+#endif
+
+/** @brief Measured round-trips.
+ */
+typedef enum
+{
+    MQTT_LATENCY_PUBLISH = 0x00,                            /**< QoS 1 PUBLISH to PUBACK and QoS 2 PUBLISH to PUBCOMP. */
+    MQTT_LATENCY_SUBSCRIBE = 0x01,                          /**< SUBSCRIBE to SUBACK. */
+    MQTT_LATENCY_PING = 0x02,                               /**< PINGREQ to PINGRESP. */
+} MQTT_Latency_Type;
+
+/** @brief Number of measured round-trips.
+ */
+#define MQTT_LATENCY_TYPES                          3
+
+/** @brief Summary of a latency histogram. The percentiles are the upper bounds of the buckets.
+ *         The values use the unit of the histogram (ms for the round-trips).
+ */
+typedef struct
+{
+    uint32_t Count;                                         /**< Number of samples. */
+    uint32_t P50;                                           /**< Median. */
+    uint32_t P99;                                           /**< 99th percentile. */
+    uint32_t Max;                                           /**< Largest sample. */
+} MQTT_Latency;
+
+/** @brief Histogram with logarithmic buckets and a fixed size.
+ *  @tparam Buckets Number of buckets. Bucket n counts the values from 2^(n - 1) to 2^n - 1 and the last bucket counts all larger values
+ */
+template<uint8_t Buckets>
+class MQTTHistogram
+{
+    public:
+        /** @brief Constructor.
+         */
+        MQTTHistogram(void)
+        {
+            this->Reset();
+        }
+
+        /** @brief Clear all samples.
+         */
+        void Reset(void)
+        {
+            memset(this->_mBuckets, 0x00, sizeof(this->_mBuckets));
+            this->_mCount = 0x00;
+            this->_mMax = 0x00;
+        }
+
+        /** @brief          Add a sample.
+         *  @param Value    Value
+         */
+        void Record(uint32_t Value)
+        {
+            uint8_t Bucket = 0x00;
+
+            while((Value >> Bucket) && (Bucket < (Buckets - 0x01)))
+            {
+                Bucket++;
+            }
+
+            this->_mBuckets[Bucket]++;
+            this->_mCount++;
+            if(Value > this->_mMax)
+            {
+                this->_mMax = Value;
+            }
+        }
+
+        /** @brief          Get a percentile.
+         *  @param Percent  Percentile from 1 to 100
+         *  @return         Upper bound of the bucket with the percentile. Never larger than the largest sample
+         */
+        uint32_t Percentile(uint8_t Percent) const
+        {
+            uint32_t Rank = ((uint64_t)this->_mCount * Percent + 99) / 100;
+            uint32_t Sum = 0x00;
+
+            for(uint8_t i = 0x00; i < Buckets; i++)
+            {
+                Sum += this->_mBuckets[i];
+                if((Sum > 0x00) && (Sum >= Rank))
+                {
+                    uint32_t Bound = (0x01UL << i) - 0x01;
+
+                    return ((i == (Buckets - 0x01)) || (Bound > this->_mMax)) ? this->_mMax : Bound;
+                }
+            }
+
+            return 0x00;
+        }
+
+        /** @brief          Get the summary.
+         *  @param Summary  Pointer to the summary
+         */
+        void Summary(MQTT_Latency* Summary) const
+        {
+            Summary->Count = this->_mCount;
+            Summary->P50 = this->Percentile(50);
+            Summary->P99 = this->Percentile(99);
+            Summary->Max = this->_mMax;
+        }
+
+    private:
+        uint32_t _mBuckets[Buckets];
+        uint32_t _mCount;
+        uint32_t _mMax;
+};
+
+/** @brief Round-trip measurement. The transmission of a packet stores a timestamp with the packet identifier
+ *         and the acknowledgement adds the delay to the histogram of the round-trip.
+ *  @tparam Enabled #false to remove the measurement. All functions are empty then
+ */
+template<bool Enabled>
+class MQTTLatency
+{
+    public:
+        /** @brief Constructor.
+         */
+        MQTTLatency(void)
+        {
+            this->Reset();
+        }
+
+        /** @brief Clear the histograms and the pending timestamps.
+         */
+        void Reset(void)
+        {
+            this->_mLock.Lock();
+
+            for(uint8_t i = 0x00; i < MQTT_LATENCY_TYPES; i++)
+            {
+                this->_mHistograms[i].Reset();
+            }
+
+            memset(this->_mPending, 0x00, sizeof(this->_mPending));
+            this->_mLock.Unlock();
+        }
+
+        /** @brief Remove the pending timestamps. The histograms are kept.
+         */
+        void Cancel(void)
+        {
+            this->_mLock.Lock();
+            memset(this->_mPending, 0x00, sizeof(this->_mPending));
+            this->_mLock.Unlock();
+        }
+
+        /** @brief      Store the timestamp of a transmitted packet. Can be called by any thread.
+         *  @param Type Round-trip
+         *  @param ID   Packet identifier (0 for PINGREQ)
+         *  @param Now  Current time in ms
+         */
+        void Start(MQTT_Latency_Type Type, uint16_t ID, uint32_t Now)
+        {
+            Pending* Slot = this->_mPending;
+
+            this->_mLock.Lock();
+
+            // Use the slot of a retransmission, a free slot or the oldest slot
+            for(uint8_t i = 0x00; i < MQTT_LATENCY_PENDING; i++)
+            {
+                Pending* Entry = &this->_mPending[i];
+
+                if(Entry->Active && (Entry->Type == Type) && (Entry->ID == ID))
+                {
+                    Slot = Entry;
+
+                    break;
+                }
+
+                if(Slot->Active && (!Entry->Active || ((int32_t)(Entry->Time - Slot->Time) < 0x00)))
+                {
+                    Slot = Entry;
+                }
+            }
+
+            Slot->Active = true;
+            Slot->Type = Type;
+            Slot->ID = ID;
+            Slot->Time = Now;
+
+            this->_mLock.Unlock();
+        }
+
+        /** @brief      Add the delay of an acknowledged packet to the histogram. Acknowledgements without a timestamp are ignored.
+         *  @param Type Round-trip
+         *  @param ID   Packet identifier (0 for PINGRESP)
+         *  @param Now  Current time in ms
+         */
+        void Stop(MQTT_Latency_Type Type, uint16_t ID, uint32_t Now)
+        {
+            this->_mLock.Lock();
+
+            for(uint8_t i = 0x00; i < MQTT_LATENCY_PENDING; i++)
+            {
+                Pending* Entry = &this->_mPending[i];
+
+                if(Entry->Active && (Entry->Type == Type) && (Entry->ID == ID))
+                {
+                    Entry->Active = false;
+                    this->_mHistograms[Type].Record(Now - Entry->Time);
+
+                    break;
+                }
+            }
+
+            this->_mLock.Unlock();
+        }
+
+        /** @brief          Get the summary of a round-trip.
+         *  @param Type     Round-trip
+         *  @param Summary  Pointer to the summary
+         */
+        void Summary(MQTT_Latency_Type Type, MQTT_Latency* Summary)
+        {
+            this->_mLock.Lock();
+            this->_mHistograms[Type].Summary(Summary);
+            this->_mLock.Unlock();
+        }
+
+    private:
+        typedef struct
+        {
+            uint32_t Time;
+            uint16_t ID;
+            uint8_t Type;
+            bool Active;
+        } Pending;
+
+        MQTTHistogram<MQTT_LATENCY_BUCKETS> _mHistograms[MQTT_LATENCY_TYPES];
+        Pending _mPending[MQTT_LATENCY_PENDING];
+        MQTTMutex _mLock;
+};
+
+/** @brief Disabled measurement. The calls are removed by the compiler.
+ */
+template<>
+class MQTTLatency<false>
+{
+    public:
+        void Reset(void)
+        {
+        }
+
+        void Cancel(void)
+        {
+        }
+
+        void Start(MQTT_Latency_Type, uint16_t, uint32_t)
+        {
+        }
+
+        void Stop(MQTT_Latency_Type, uint16_t, uint32_t)
+        {
+        }
+
+        void Summary(MQTT_Latency_Type, MQTT_Latency* Summary)
+        {
+            memset(Summary, 0x00, sizeof(MQTT_Latency));
+        }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,193 @@
+/*
+ * MQTT_Metrics.h
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Packet, byte and error counters for the MQTT client.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTT_Metrics.h
+ *  @brief Packet, byte and error counters for the MQTT client.
+ *
+ *  @author Daniel Kampert
+ */
+
+#ifndef MQTT_METRICS_H_
+#define MQTT_METRICS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "mqtt_thread.h"
+
+/** @brief Set to 1 to add the metrics, the latency histograms and the call profile to the client.
+ *         Disabled by default, because the counters and histograms need about 1 kB RAM in each client.
+ */
+#ifndef MQTT_METRICS
+    #define MQTT_METRICS                            0
+#endif
+
+/** @brief Number of counted error codes.
+ */
+#define MQTT_METRICS_ERRORS                         16
+
+/** @brief Snapshot of the client metrics. The counters overflow.
+ */
+typedef struct
+{
+    uint32_t PacketsOut[16];                                /**< Transmitted packets. Indexed by the control packet type (i. e. PacketsOut[PINGREQ] are the sent pings). */
+    uint32_t BytesOut[16];                                  /**< Transmitted bytes. Indexed by the control packet type. */
+    uint32_t PacketsIn[16];                                 /**< Received packets. Indexed by the control packet type (i. e. PacketsIn[PINGRESP] are the received ping responses). */
+    uint32_t BytesIn[16];                                   /**< Received bytes. Indexed by the control packet type. */
+    uint32_t Errors[MQTT_METRICS_ERRORS];                   /**< Failed transmissions and receptions. Indexed by the error code. */
+    uint32_t Connects;                                      /**< Accepted connections. */
+    uint32_t Reconnects;                                    /**< Accepted connections after the first connection. */
+    uint16_t OutboundDepth;                                 /**< Messages in the outbound queue at the time of the snapshot. */
+    uint16_t BulkDepth;                                     /**< Messages in the bulk queue at the time of the snapshot. */
+    uint16_t ControlDepth;                                  /**< Control packets in the control queue at the time of the snapshot. */
+    uint16_t InboundDepth;                                  /**< Messages in the receive queue at the time of the snapshot. */
+} MQTT_Metrics;
+
+/** @brief Number of counters in front of the queue depths of #MQTT_Metrics.
+ */
+#define MQTT_METRICS_COUNTERS                       (offsetof(MQTT_Metrics, OutboundDepth) / sizeof(uint32_t))
+
+/** @brief Metrics counters. The counters are updated with relaxed atomic operations by the transmitting and receiving thread.
+ *         A snapshot from another thread can be slightly out of date, but each counter is consistent.
+ *  @tparam Enabled #false to remove the counters. All functions are empty then
+ */
+template<bool Enabled>
+class MQTTMetrics
+{
+    public:
+        /** @brief Constructor.
+         */
+        MQTTMetrics(void)
+        {
+            this->Reset();
+        }
+
+        /** @brief Clear all counters.
+         */
+        void Reset(void)
+        {
+            uint32_t* Counters = (uint32_t*)&this->_mData;
+
+            for(uint8_t i = 0x00; i < MQTT_METRICS_COUNTERS; i++)
+            {
+                MQTTThread::Store(&Counters[i], 0x00);
+            }
+
+            memset(&this->_mData.OutboundDepth, 0x00, sizeof(MQTT_Metrics) - offsetof(MQTT_Metrics, OutboundDepth));
+        }
+
+        /** @brief          Count a transmitted packet.
+         *  @param Header   First byte of the fixed header
+         *  @param Bytes    Size of the packet
+         */
+        void Transmit(uint8_t Header, uint16_t Bytes)
+        {
+            MQTTThread::Add(&this->_mData.PacketsOut[Header >> 0x04], 0x01);
+            MQTTThread::Add(&this->_mData.BytesOut[Header >> 0x04], Bytes);
+        }
+
+        /** @brief          Count a received packet.
+         *  @param Header   First byte of the fixed header
+         *  @param Bytes    Size of the packet
+         */
+        void Receive(uint8_t Header, uint16_t Bytes)
+        {
+            MQTTThread::Add(&this->_mData.PacketsIn[Header >> 0x04], 0x01);
+            MQTTThread::Add(&this->_mData.BytesIn[Header >> 0x04], Bytes);
+        }
+
+        /** @brief      Count an error. #NO_ERROR isn't counted. Can be called by any thread.
+         *  @param Code Error code
+         */
+        void Error(uint8_t Code)
+        {
+            if((Code > 0x00) && (Code < MQTT_METRICS_ERRORS))
+            {
+                MQTTThread::Add(&this->_mData.Errors[Code], 0x01);
+            }
+        }
+
+        /** @brief Count an accepted connection.
+         */
+        void Connect(void)
+        {
+            if(__atomic_fetch_add(&this->_mData.Connects, 0x01, __ATOMIC_RELAXED) > 0x00)
+            {
+                MQTTThread::Add(&this->_mData.Reconnects, 0x01);
+            }
+        }
+
+        /** @brief          Copy the counters.
+         *  @param Metrics  Pointer to the snapshot
+         */
+        void Snapshot(MQTT_Metrics* Metrics) const
+        {
+            const uint32_t* Counters = (const uint32_t*)&this->_mData;
+
+            for(uint8_t i = 0x00; i < MQTT_METRICS_COUNTERS; i++)
+            {
+                ((uint32_t*)Metrics)[i] = MQTTThread::Load(&Counters[i]);
+            }
+
+            memset(&Metrics->OutboundDepth, 0x00, sizeof(MQTT_Metrics) - offsetof(MQTT_Metrics, OutboundDepth));
+        }
+
+    private:
+        MQTT_Metrics _mData;
+};
+
+/** @brief Disabled metrics. The calls are removed by the compiler.
+ */
+template<>
+class MQTTMetrics<false>
+{
+    public:
+        void Reset(void)
+        {
+        }
+
+        void Transmit(uint8_t, uint16_t)
+        {
+        }
+
+        void Receive(uint8_t, uint16_t)
+        {
+        }
+
+        void Error(uint8_t)
+        {
+        }
+
+        void Connect(void)
+        {
+        }
+
+        void Snapshot(MQTT_Metrics* Metrics) const
+        {
+            memset(Metrics, 0x00, sizeof(MQTT_Metrics));
+        }
+};
+
+#endif
\ No newline at end of file
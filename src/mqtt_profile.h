@@ -0,0 +1,283 @@
+/*
+ * MQTT_Profile.h
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Call duration profile and stall detection for the MQTT client.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTT_Profile.h
+ *  @brief Call duration profile and stall detection for the MQTT client.
+ *
+ *  @author Daniel Kampert
+ */
+
+#ifndef MQTT_PROFILE_H_
+#define MQTT_PROFILE_H_
+
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "mqtt_latency.h"
+#include "mqtt_thread.h"
+
+/** @brief Set to 1 to add the call profile and the stall detection to the client. Enabled together with the metrics.
+ */
+#ifndef MQTT_PROFILE
+    #define MQTT_PROFILE                            MQTT_METRICS
+#endif
+
+/** @brief Number of buckets of a call duration histogram. The last bucket counts the calls longer than 4 s.
+ */
+#define MQTT_PROFILE_BUCKETS                        24
+
+/** @brief Profiled calls.
+ */
+typedef enum
+{
+    MQTT_PROFILE_POLL = 0x00,                               /**< #Poll. */
+    MQTT_PROFILE_PUBLISH = 0x01,                            /**< #Publish, #Publishf and #EndPublish. */
+    MQTT_PROFILE_SUBSCRIBE = 0x02,                          /**< #Subscribe. */
+    MQTT_PROFILE_CONNECT = 0x03,                            /**< #Connect. */
+} MQTT_Profile_Call;
+
+/** @brief Number of profiled calls.
+ */
+#define MQTT_PROFILE_CALLS                          4
+
+/** @brief Phases of a call.
+ */
+typedef enum
+{
+    MQTT_PHASE_PROCESSING = 0x00,                           /**< Time outside of the other phases (i. e. encoding or waiting for a lock). */
+    MQTT_PHASE_SOCKET_CONNECT = 0x01,                       /**< Opening the TCP connection. */
+    MQTT_PHASE_CONNACK_WAIT = 0x02,                         /**< Waiting for the CONNACK from the broker. */
+    MQTT_PHASE_READ = 0x03,                                 /**< Reading a packet from the socket. */
+    MQTT_PHASE_WRITE = 0x04,                                /**< Writing to the socket. */
+    MQTT_PHASE_DISPATCH = 0x05,                             /**< Application callbacks. */
+    MQTT_PHASE_COMPRESSION = 0x06,                          /**< Payload compression. */
+} MQTT_Profile_Phase;
+
+/** @brief Number of phases.
+ */
+#define MQTT_PROFILE_PHASES                         7
+
+/** @brief Largest accepted stack depth in bytes. Larger values come from another thread and are ignored.
+ */
+#define MQTT_PROFILE_STACK_LIMIT                    0x10000
+
+/** @brief Duration profile of the calls into the client. Only the outermost call is measured and the calls
+ *         of the application callbacks are part of the dispatch phase. The thread of the outermost call owns the
+ *         profile until the call has finished, so calls and phases of other threads (i. e. the I/O thread or a
+ *         publishing thread) during this time aren't measured.
+ *  @tparam Enabled #false to remove the profile. All functions are empty then
+ */
+template<bool Enabled>
+class MQTTProfile
+{
+    public:
+        /** @brief Constructor.
+         */
+        MQTTProfile(void) : _mBase(0x00), _mOwner(0x00), _mDepth(0x00)
+        {
+            this->Reset();
+        }
+
+        /** @brief Clear the histograms and the stack depth.
+         */
+        void Reset(void)
+        {
+            for(uint8_t i = 0x00; i < MQTT_PROFILE_CALLS; i++)
+            {
+                this->_mHistograms[i].Reset();
+            }
+
+            this->_mStack = 0x00;
+        }
+
+        /** @brief          Start a call.
+         *  @param Now      Current time in us
+         *  @param Stack    Address on the stack of the caller
+         */
+        void Begin(uint32_t Now, const void* Stack)
+        {
+            uintptr_t Thread = MQTTThread::Current();
+            uintptr_t Free = 0x00;
+
+            if((this->_mOwner.load() != Thread) && !this->_mOwner.compare_exchange_strong(Free, Thread))
+            {
+                return;
+            }
+
+            if(this->_mDepth++ == 0x00)
+            {
+                this->_mStart = Now;
+                this->_mBase = (uintptr_t)Stack;
+                memset(this->_mPhases, 0x00, sizeof(this->_mPhases));
+            }
+        }
+
+        /** @brief          Measure the stack depth of the current call. The stack grows downwards.
+         *  @param Stack    Address on the stack
+         */
+        void Probe(const void* Stack)
+        {
+            if(!this->_isOwner())
+            {
+                return;
+            }
+
+            uintptr_t Depth = this->_mBase - (uintptr_t)Stack;
+
+            if(((uintptr_t)Stack < this->_mBase) && (Depth < MQTT_PROFILE_STACK_LIMIT) && (Depth > this->_mStack))
+            {
+                this->_mStack = Depth;
+            }
+        }
+
+        /** @brief  Get the deepest measured stack usage of a call.
+         *  @return Stack depth in bytes
+         */
+        uint32_t Stack(void) const
+        {
+            return this->_mStack;
+        }
+
+        /** @brief          Add the duration of a phase to the current call. Phases outside of a call or from another thread are ignored.
+         *  @param Phase    Phase
+         *  @param Duration Duration in us
+         */
+        void Phase(MQTT_Profile_Phase Phase, uint32_t Duration)
+        {
+            if(this->_isOwner())
+            {
+                this->_mPhases[Phase] += Duration;
+            }
+        }
+
+        /** @brief          Finish a call and add the duration to the histogram of the call.
+         *  @param Call     Call
+         *  @param Now      Current time in us
+         *  @param Duration Pointer to the duration of the call in us
+         *  @param Phase    Pointer to the longest phase of the call
+         *  @return         #true when the outermost call was finished
+         */
+        bool End(MQTT_Profile_Call Call, uint32_t Now, uint32_t* Duration, MQTT_Profile_Phase* Phase)
+        {
+            uint32_t Other;
+
+            if(!this->_isOwner() || (--this->_mDepth != 0x00))
+            {
+                return false;
+            }
+
+            *Duration = Now - this->_mStart;
+            this->_mHistograms[Call].Record(*Duration);
+
+            // The time outside of the measured phases belongs to the processing phase
+            Other = *Duration;
+            for(uint8_t i = 0x01; i < MQTT_PROFILE_PHASES; i++)
+            {
+                Other -= (this->_mPhases[i] < Other) ? this->_mPhases[i] : Other;
+            }
+            this->_mPhases[MQTT_PHASE_PROCESSING] = Other;
+
+            *Phase = MQTT_PHASE_PROCESSING;
+            for(uint8_t i = 0x01; i < MQTT_PROFILE_PHASES; i++)
+            {
+                if(this->_mPhases[i] > this->_mPhases[*Phase])
+                {
+                    *Phase = (MQTT_Profile_Phase)i;
+                }
+            }
+
+            // Other threads can start a call now
+            this->_mOwner.store(0x00);
+
+            return true;
+        }
+
+        /** @brief          Get the summary of a call histogram.
+         *  @param Call     Call
+         *  @param Summary  Pointer to the summary
+         */
+        void Summary(MQTT_Profile_Call Call, MQTT_Latency* Summary) const
+        {
+            this->_mHistograms[Call].Summary(Summary);
+        }
+
+    private:
+        MQTTHistogram<MQTT_PROFILE_BUCKETS> _mHistograms[MQTT_PROFILE_CALLS];
+        uint32_t _mPhases[MQTT_PROFILE_PHASES];
+        uint32_t _mStart;
+        uint32_t _mStack;
+        uintptr_t _mBase;
+        std::atomic<uintptr_t> _mOwner;
+        uint8_t _mDepth;
+
+        /** @brief  Check if the calling thread is inside of a measured call.
+         *  @return #true when the thread owns the profile
+         */
+        bool _isOwner(void) const
+        {
+            return (this->_mOwner.load() == MQTTThread::Current());
+        }
+};
+
+/** @brief Disabled profile. The calls are removed by the compiler.
+ */
+template<>
+class MQTTProfile<false>
+{
+    public:
+        void Reset(void)
+        {
+        }
+
+        void Begin(uint32_t, const void*)
+        {
+        }
+
+        void Probe(const void*)
+        {
+        }
+
+        uint32_t Stack(void) const
+        {
+            return 0x00;
+        }
+
+        void Phase(MQTT_Profile_Phase, uint32_t)
+        {
+        }
+
+        bool End(MQTT_Profile_Call, uint32_t, uint32_t*, MQTT_Profile_Phase*)
+        {
+            return false;
+        }
+
+        void Summary(MQTT_Profile_Call, MQTT_Latency* Summary) const
+        {
+            memset(Summary, 0x00, sizeof(MQTT_Latency));
+        }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,388 @@
+/*
+ * MQTT_Properties.cpp
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: MQTT 5.0 properties encoder and decoder.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTT_Properties.cpp
+ *  @brief MQTT 5.0 properties encoder and decoder.
+ *
+ *  @author Daniel Kampert
+ */
+
+#include <string.h>
+
+#include "mqtt_properties.h"
+
+/** @brief Data types of the properties.
+ */
+typedef enum
+{
+    TYPE_INVALID,
+    TYPE_BYTE,
+    TYPE_SHORT,
+    TYPE_INTEGER,
+    TYPE_VARINT,
+    TYPE_DATA,
+    TYPE_PAIR,
+} Property_Type;
+
+/** @brief          Get the data type of a property.
+ *  @param ID       Property identifier
+ *  @return         Data type
+ */
+static Property_Type MQTT_PropertyType(uint8_t ID)
+{
+    switch(ID)
+    {
+        case(MQTT_PROPERTY_PAYLOAD_FORMAT):
+        case(MQTT_PROPERTY_REQUEST_PROBLEM_INFO):
+        case(MQTT_PROPERTY_REQUEST_RESPONSE_INFO):
+        case(MQTT_PROPERTY_MAXIMUM_QOS):
+        case(MQTT_PROPERTY_RETAIN_AVAILABLE):
+        case(MQTT_PROPERTY_WILDCARD_AVAILABLE):
+        case(MQTT_PROPERTY_SUBSCRIPTION_ID_AVAILABLE):
+        case(MQTT_PROPERTY_SHARED_SUBSCRIPTION_AVAILABLE):
+        {
+            return TYPE_BYTE;
+        }
+        case(MQTT_PROPERTY_SERVER_KEEP_ALIVE):
+        case(MQTT_PROPERTY_RECEIVE_MAXIMUM):
+        case(MQTT_PROPERTY_TOPIC_ALIAS_MAXIMUM):
+        case(MQTT_PROPERTY_TOPIC_ALIAS):
+        {
+            return TYPE_SHORT;
+        }
+        case(MQTT_PROPERTY_MESSAGE_EXPIRY):
+        case(MQTT_PROPERTY_SESSION_EXPIRY):
+        case(MQTT_PROPERTY_WILL_DELAY):
+        case(MQTT_PROPERTY_MAXIMUM_PACKET_SIZE):
+        {
+            return TYPE_INTEGER;
+        }
+        case(MQTT_PROPERTY_SUBSCRIPTION_ID):
+        {
+            return TYPE_VARINT;
+        }
+        case(MQTT_PROPERTY_CONTENT_TYPE):
+        case(MQTT_PROPERTY_RESPONSE_TOPIC):
+        case(MQTT_PROPERTY_CORRELATION_DATA):
+        case(MQTT_PROPERTY_ASSIGNED_CLIENT_ID):
+        case(MQTT_PROPERTY_AUTHENTICATION_METHOD):
+        case(MQTT_PROPERTY_AUTHENTICATION_DATA):
+        case(MQTT_PROPERTY_RESPONSE_INFO):
+        case(MQTT_PROPERTY_SERVER_REFERENCE):
+        case(MQTT_PROPERTY_REASON_STRING):
+        {
+            return TYPE_DATA;
+        }
+        case(MQTT_PROPERTY_USER_PROPERTY):
+        {
+            return TYPE_PAIR;
+        }
+    }
+
+    return TYPE_INVALID;
+}
+
+uint8_t MQTT_EncodeVarInt(uint8_t* Buffer, uint32_t Value)
+{
+    uint8_t Bytes = 0x00;
+
+    do
+    {
+        uint8_t EncodedByte = Value % 0x80;
+        Value = Value >> 0x07;
+        if(Value > 0x00)
+        {
+            EncodedByte |= 0x80;
+        }
+
+        Buffer[Bytes++] = EncodedByte;
+    } while((Value > 0x00) && (Bytes < 0x04));
+
+    return Bytes;
+}
+
+uint8_t MQTT_DecodeVarInt(const uint8_t* Buffer, uint16_t Length, uint32_t* Value)
+{
+    uint8_t Bytes = 0x00;
+    uint32_t Multiplier = 0x01;
+
+    *Value = 0x00;
+
+    do
+    {
+        if((Bytes >= Length) || (Bytes >= 0x04))
+        {
+            return 0x00;
+        }
+
+        *Value += (Buffer[Bytes] & 0x7F) * Multiplier;
+        Multiplier <<= 0x07;
+    } while(Buffer[Bytes++] & 0x80);
+
+    return Bytes;
+}
+
+uint8_t MQTT_VarIntSize(uint32_t Value)
+{
+    if(Value < 0x80)
+    {
+        return 0x01;
+    }
+    else if(Value < 0x4000)
+    {
+        return 0x02;
+    }
+    else if(Value < 0x200000)
+    {
+        return 0x03;
+    }
+
+    return 0x04;
+}
+
+MQTTPropertyWriter::MQTTPropertyWriter(uint8_t* Buffer, uint16_t Size) : _mBuffer(Buffer), _mSize(Size), _mOffset(0x01), _mOverflow(Size == 0x00)
+{
+}
+
+void MQTTPropertyWriter::AddByte(uint8_t ID, uint8_t Value)
+{
+    if(this->_reserve(0x02))
+    {
+        this->_mBuffer[this->_mOffset++] = ID;
+        this->_mBuffer[this->_mOffset++] = Value;
+    }
+}
+
+void MQTTPropertyWriter::AddShort(uint8_t ID, uint16_t Value)
+{
+    if(this->_reserve(0x03))
+    {
+        this->_mBuffer[this->_mOffset++] = ID;
+        this->_mBuffer[this->_mOffset++] = (Value >> 0x08);
+        this->_mBuffer[this->_mOffset++] = (Value & 0xFF);
+    }
+}
+
+void MQTTPropertyWriter::AddInteger(uint8_t ID, uint32_t Value)
+{
+    if(this->_reserve(0x05))
+    {
+        this->_mBuffer[this->_mOffset++] = ID;
+        this->_mBuffer[this->_mOffset++] = (Value >> 0x18);
+        this->_mBuffer[this->_mOffset++] = (Value >> 0x10);
+        this->_mBuffer[this->_mOffset++] = (Value >> 0x08);
+        this->_mBuffer[this->_mOffset++] = (Value & 0xFF);
+    }
+}
+
+void MQTTPropertyWriter::AddVarInt(uint8_t ID, uint32_t Value)
+{
+    if(this->_reserve(0x01 + MQTT_VarIntSize(Value)))
+    {
+        this->_mBuffer[this->_mOffset++] = ID;
+        this->_mOffset += MQTT_EncodeVarInt(this->_mBuffer + this->_mOffset, Value);
+    }
+}
+
+void MQTTPropertyWriter::AddData(uint8_t ID, const uint8_t* Data, uint16_t Length)
+{
+    if(this->_reserve(0x03 + Length))
+    {
+        this->_mBuffer[this->_mOffset++] = ID;
+        this->_mBuffer[this->_mOffset++] = (Length >> 0x08);
+        this->_mBuffer[this->_mOffset++] = (Length & 0xFF);
+        memcpy(this->_mBuffer + this->_mOffset, Data, Length);
+        this->_mOffset += Length;
+    }
+}
+
+void MQTTPropertyWriter::AddUserProperty(const char* Name, uint16_t NameLength, const char* Value, uint16_t ValueLength)
+{
+    if(this->_reserve(0x05 + NameLength + ValueLength))
+    {
+        this->_mBuffer[this->_mOffset++] = MQTT_PROPERTY_USER_PROPERTY;
+        this->_mBuffer[this->_mOffset++] = (NameLength >> 0x08);
+        this->_mBuffer[this->_mOffset++] = (NameLength & 0xFF);
+        memcpy(this->_mBuffer + this->_mOffset, Name, NameLength);
+        this->_mOffset += NameLength;
+        this->_mBuffer[this->_mOffset++] = (ValueLength >> 0x08);
+        this->_mBuffer[this->_mOffset++] = (ValueLength & 0xFF);
+        memcpy(this->_mBuffer + this->_mOffset, Value, ValueLength);
+        this->_mOffset += ValueLength;
+    }
+}
+
+uint16_t MQTTPropertyWriter::Finish(void)
+{
+    uint16_t Length = this->_mOffset - 0x01;
+    uint8_t LengthBytes = MQTT_VarIntSize(Length);
+
+    if(this->_mOverflow || ((this->_mOffset + LengthBytes - 0x01) > this->_mSize))
+    {
+        return 0x00;
+    }
+
+    // Only one byte was reserved for the length. Move the properties when the length needs more bytes
+    if(LengthBytes > 0x01)
+    {
+        memmove(this->_mBuffer + LengthBytes, this->_mBuffer + 0x01, Length);
+    }
+
+    MQTT_EncodeVarInt(this->_mBuffer, Length);
+
+    return Length + LengthBytes;
+}
+
+bool MQTTPropertyWriter::_reserve(uint16_t Bytes)
+{
+    if(this->_mOverflow || ((uint32_t)(this->_mOffset + Bytes) > this->_mSize))
+    {
+        this->_mOverflow = true;
+
+        return false;
+    }
+
+    return true;
+}
+
+MQTTPropertyReader::MQTTPropertyReader(const uint8_t* Buffer, uint16_t Length) : _mBuffer(Buffer), _mOffset(0x00), _mEnd(0x00), _mValid(false)
+{
+    uint32_t PropertyLength;
+    uint8_t LengthBytes = MQTT_DecodeVarInt(Buffer, Length, &PropertyLength);
+
+    if((LengthBytes > 0x00) && ((LengthBytes + PropertyLength) <= Length))
+    {
+        this->_mOffset = LengthBytes;
+        this->_mEnd = LengthBytes + PropertyLength;
+        this->_mValid = true;
+    }
+}
+
+bool MQTTPropertyReader::Next(MQTT_Property* Property)
+{
+    const uint8_t* Data = this->_mBuffer + this->_mOffset;
+    uint16_t Available = this->_mEnd - this->_mOffset;
+    uint16_t Bytes;
+
+    if(!this->_mValid || (Available == 0x00))
+    {
+        return false;
+    }
+
+    Property->ID = Data[0];
+    Property->Value = 0x00;
+    Property->Data = NULL;
+    Property->Length = 0x00;
+    Property->Data2 = NULL;
+    Property->Length2 = 0x00;
+
+    switch(MQTT_PropertyType(Property->ID))
+    {
+        case(TYPE_BYTE):
+        {
+            Bytes = 0x02;
+            if(Available >= Bytes)
+            {
+                Property->Value = Data[1];
+            }
+
+            break;
+        }
+        case(TYPE_SHORT):
+        {
+            Bytes = 0x03;
+            if(Available >= Bytes)
+            {
+                Property->Value = (Data[1] << 0x08) | Data[2];
+            }
+
+            break;
+        }
+        case(TYPE_INTEGER):
+        {
+            Bytes = 0x05;
+            if(Available >= Bytes)
+            {
+                Property->Value = ((uint32_t)Data[1] << 0x18) | ((uint32_t)Data[2] << 0x10) | (Data[3] << 0x08) | Data[4];
+            }
+
+            break;
+        }
+        case(TYPE_VARINT):
+        {
+            uint8_t ValueBytes = MQTT_DecodeVarInt(Data + 0x01, Available - 0x01, &Property->Value);
+
+            Bytes = (ValueBytes > 0x00) ? (0x01 + ValueBytes) : 0xFFFF;
+
+            break;
+        }
+        case(TYPE_DATA):
+        case(TYPE_PAIR):
+        {
+            Bytes = 0x03;
+            if(Available >= Bytes)
+            {
+                Property->Length = (Data[1] << 0x08) | Data[2];
+                Property->Data = Data + 0x03;
+                Bytes += Property->Length;
+            }
+
+            if((Property->ID == MQTT_PROPERTY_USER_PROPERTY) && ((uint32_t)(Bytes + 0x02) <= Available))
+            {
+                Property->Length2 = (Data[Bytes] << 0x08) | Data[Bytes + 0x01];
+                Property->Data2 = Data + Bytes + 0x02;
+                Bytes += 0x02 + Property->Length2;
+            }
+
+            break;
+        }
+        default:
+        {
+            Bytes = 0xFFFF;
+
+            break;
+        }
+    }
+
+    if(Bytes > Available)
+    {
+        this->_mValid = false;
+
+        return false;
+    }
+
+    this->_mOffset += Bytes;
+
+    return true;
+}
+
+bool MQTTPropertyReader::isValid(void) const
+{
+    return this->_mValid;
+}
+
+uint16_t MQTTPropertyReader::Size(void) const
+{
+    return this->_mEnd;
+}
\ No newline at end of file
@@ -0,0 +1,205 @@
+/*
+ * MQTT_Properties.h
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: MQTT 5.0 properties encoder and decoder.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTT_Properties.h
+ *  @brief MQTT 5.0 properties encoder and decoder.
+ *		   Please read
+ *			- https://docs.oasis-open.org/mqtt/mqtt/v5.0/os/mqtt-v5.0-os.html#_Toc3901027
+ *		   when you need more information.
+ *
+ *  @author Daniel Kampert
+ */
+
+#ifndef MQTT_PROPERTIES_H_
+#define MQTT_PROPERTIES_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** @brief MQTT 5.0 property identifiers.
+ */
+typedef enum
+{
+    MQTT_PROPERTY_PAYLOAD_FORMAT = 0x01,                    /**< Payload format indicator (Byte). */
+    MQTT_PROPERTY_MESSAGE_EXPIRY = 0x02,                    /**< Message expiry interval (Four Byte Integer). */
+    MQTT_PROPERTY_CONTENT_TYPE = 0x03,                      /**< Content type (UTF-8 string). */
+    MQTT_PROPERTY_RESPONSE_TOPIC = 0x08,                    /**< Response topic (UTF-8 string). */
+    MQTT_PROPERTY_CORRELATION_DATA = 0x09,                  /**< Correlation data (Binary data). */
+    MQTT_PROPERTY_SUBSCRIPTION_ID = 0x0B,                   /**< Subscription identifier (Variable Byte Integer). */
+    MQTT_PROPERTY_SESSION_EXPIRY = 0x11,                    /**< Session expiry interval (Four Byte Integer). */
+    MQTT_PROPERTY_ASSIGNED_CLIENT_ID = 0x12,                /**< Assigned client identifier (UTF-8 string). */
+    MQTT_PROPERTY_SERVER_KEEP_ALIVE = 0x13,                 /**< Server keep alive (Two Byte Integer). */
+    MQTT_PROPERTY_AUTHENTICATION_METHOD = 0x15,             /**< Authentication method (UTF-8 string). */
+    MQTT_PROPERTY_AUTHENTICATION_DATA = 0x16,               /**< Authentication data (Binary data). */
+    MQTT_PROPERTY_REQUEST_PROBLEM_INFO = 0x17,              /**< Request problem information (Byte). */
+    MQTT_PROPERTY_WILL_DELAY = 0x18,                        /**< Will delay interval (Four Byte Integer). */
+    MQTT_PROPERTY_REQUEST_RESPONSE_INFO = 0x19,             /**< Request response information (Byte). */
+    MQTT_PROPERTY_RESPONSE_INFO = 0x1A,                     /**< Response information (UTF-8 string). */
+    MQTT_PROPERTY_SERVER_REFERENCE = 0x1C,                  /**< Server reference (UTF-8 string). */
+    MQTT_PROPERTY_REASON_STRING = 0x1F,                     /**< Reason string (UTF-8 string). */
+    MQTT_PROPERTY_RECEIVE_MAXIMUM = 0x21,                   /**< Receive maximum (Two Byte Integer). */
+    MQTT_PROPERTY_TOPIC_ALIAS_MAXIMUM = 0x22,               /**< Topic alias maximum (Two Byte Integer). */
+    MQTT_PROPERTY_TOPIC_ALIAS = 0x23,                       /**< Topic alias (Two Byte Integer). */
+    MQTT_PROPERTY_MAXIMUM_QOS = 0x24,                       /**< Maximum QoS (Byte). */
+    MQTT_PROPERTY_RETAIN_AVAILABLE = 0x25,                  /**< Retain available (Byte). */
+    MQTT_PROPERTY_USER_PROPERTY = 0x26,                     /**< User property (UTF-8 string pair). */
+    MQTT_PROPERTY_MAXIMUM_PACKET_SIZE = 0x27,               /**< Maximum packet size (Four Byte Integer). */
+    MQTT_PROPERTY_WILDCARD_AVAILABLE = 0x28,                /**< Wildcard subscription available (Byte). */
+    MQTT_PROPERTY_SUBSCRIPTION_ID_AVAILABLE = 0x29,         /**< Subscription identifier available (Byte). */
+    MQTT_PROPERTY_SHARED_SUBSCRIPTION_AVAILABLE = 0x2A,     /**< Shared subscription available (Byte). */
+} MQTT_Property_ID;
+
+/** @brief Decoded MQTT 5.0 property.
+ */
+typedef struct
+{
+    uint8_t ID;                                             /**< Property identifier. */
+    uint32_t Value;                                         /**< Value of integer properties. */
+    const uint8_t* Data;                                    /**< Pointer to the data of string and binary properties. */
+    uint16_t Length;                                        /**< Length of string and binary properties. */
+    const uint8_t* Data2;                                   /**< Pointer to the value string of a user property. */
+    uint16_t Length2;                                       /**< Length of the value string of a user property. */
+} MQTT_Property;
+
+/** @brief          Encode a Variable Byte Integer.
+ *  @param Buffer   Output buffer with at least 4 bytes
+ *  @param Value    Value (maximum 268435455)
+ *  @return         Number of encoded bytes
+ */
+uint8_t MQTT_EncodeVarInt(uint8_t* Buffer, uint32_t Value);
+
+/** @brief          Decode a Variable Byte Integer.
+ *  @param Buffer   Input buffer
+ *  @param Length   Length of the input buffer
+ *  @param Value    Pointer to the decoded value
+ *  @return         Number of decoded bytes or 0 for a malformed integer
+ */
+uint8_t MQTT_DecodeVarInt(const uint8_t* Buffer, uint16_t Length, uint32_t* Value);
+
+/** @brief          Get the size of a Variable Byte Integer.
+ *  @param Value    Value
+ *  @return         Number of bytes
+ */
+uint8_t MQTT_VarIntSize(uint32_t Value);
+
+/** @brief Writer for a property section. The writer reserves one byte for the property length
+ *         and moves the properties when a longer length is needed.
+ */
+class MQTTPropertyWriter
+{
+    public:
+        /** @brief          Constructor.
+         *  @param Buffer   Start of the property section
+         *  @param Size     Available bytes
+         */
+        MQTTPropertyWriter(uint8_t* Buffer, uint16_t Size);
+
+        /** @brief          Add a Byte property.
+         *  @param ID       Property identifier
+         *  @param Value    Value
+         */
+        void AddByte(uint8_t ID, uint8_t Value);
+
+        /** @brief          Add a Two Byte Integer property.
+         *  @param ID       Property identifier
+         *  @param Value    Value
+         */
+        void AddShort(uint8_t ID, uint16_t Value);
+
+        /** @brief          Add a Four Byte Integer property.
+         *  @param ID       Property identifier
+         *  @param Value    Value
+         */
+        void AddInteger(uint8_t ID, uint32_t Value);
+
+        /** @brief          Add a Variable Byte Integer property.
+         *  @param ID       Property identifier
+         *  @param Value    Value
+         */
+        void AddVarInt(uint8_t ID, uint32_t Value);
+
+        /** @brief          Add a UTF-8 string or Binary data property.
+         *  @param ID       Property identifier
+         *  @param Data     String or data
+         *  @param Length   Length of the string or data
+         */
+        void AddData(uint8_t ID, const uint8_t* Data, uint16_t Length);
+
+        /** @brief              Add a user property.
+         *  @param Name         Name string
+         *  @param NameLength   Length of the name
+         *  @param Value        Value string
+         *  @param ValueLength  Length of the value
+         */
+        void AddUserProperty(const char* Name, uint16_t NameLength, const char* Value, uint16_t ValueLength);
+
+        /** @brief  Write the property length.
+         *  @return Size of the property section with the length or 0 when the buffer is too small
+         */
+        uint16_t Finish(void);
+
+    private:
+        uint8_t* _mBuffer;
+        uint16_t _mSize;
+        uint16_t _mOffset;
+        bool _mOverflow;
+
+        bool _reserve(uint16_t Bytes);
+};
+
+/** @brief Cursor-style reader for a property section.
+ */
+class MQTTPropertyReader
+{
+    public:
+        /** @brief          Constructor. Reads the property length.
+         *  @param Buffer   Start of the property section
+         *  @param Length   Available bytes
+         */
+        MQTTPropertyReader(const uint8_t* Buffer, uint16_t Length);
+
+        /** @brief          Get the next property.
+         *  @param Property Pointer to the property object
+         *  @return         #true when a property was read
+         */
+        bool Next(MQTT_Property* Property);
+
+        /** @brief  Check if the property section is well-formed (so far).
+         *  @return #true when valid
+         */
+        bool isValid(void) const;
+
+        /** @brief  Get the size of the property section including the property length.
+         *  @return Size in bytes
+         */
+        uint16_t Size(void) const;
+
+    private:
+        const uint8_t* _mBuffer;
+        uint16_t _mOffset;
+        uint16_t _mEnd;
+        bool _mValid;
+};
+
+#endif
\ No newline at end of file
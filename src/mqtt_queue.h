@@ -0,0 +1,274 @@
+/*
+ * MQTT_Queue.h
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Lock-free queues for the MQTT client.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTT_Queue.h
+ *  @brief Lock-free queues for the MQTT client.
+ *
+ *  @author Daniel Kampert
+ */
+
+#ifndef MQTT_QUEUE_H_
+#define MQTT_QUEUE_H_
+
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+
+/** @brief Bounded lock-free queue for exactly one producer and one consumer.
+ *         The elements are written and read in place, so the producer reserves an element,
+ *         fills it and commits it. The consumer peeks the oldest element and releases it when done.
+ *  @tparam T       Element type
+ *  @tparam Size    Number of elements. Must be a power of two.
+ */
+template<typename T, uint16_t Size>
+class MQTTQueue
+{
+    static_assert((Size > 0) && ((Size & (Size - 1)) == 0), "Queue size must be a power of two!");
+
+    public:
+        /** @brief Constructor.
+         */
+        MQTTQueue(void) : _mHead(0), _mTail(0)
+        {
+        }
+
+        /** @brief  Get the next free element. Must only be called by the producer.
+         *  @return Pointer to the free element or #NULL when the queue is full
+         */
+        T* Reserve(void)
+        {
+            uint16_t Head = this->_mHead.load(std::memory_order_relaxed);
+
+            if((uint16_t)(Head - this->_mTail.load(std::memory_order_acquire)) == Size)
+            {
+                return NULL;
+            }
+
+            return &this->_mItems[Head & (Size - 1)];
+        }
+
+        /** @brief Hand the element from #Reserve over to the consumer.
+         */
+        void Commit(void)
+        {
+            this->_mHead.store(this->_mHead.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        /** @brief  Get the oldest element. Must only be called by the consumer.
+         *  @return Pointer to the element or #NULL when the queue is empty
+         */
+        T* Peek(void)
+        {
+            uint16_t Tail = this->_mTail.load(std::memory_order_relaxed);
+
+            if(Tail == this->_mHead.load(std::memory_order_acquire))
+            {
+                return NULL;
+            }
+
+            return &this->_mItems[Tail & (Size - 1)];
+        }
+
+        /** @brief Return the element from #Peek back to the producer.
+         */
+        void Release(void)
+        {
+            this->_mTail.store(this->_mTail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        /** @brief  Get the number of queued elements.
+         *  @return Number of elements
+         */
+        uint16_t Count(void) const
+        {
+            return (uint16_t)(this->_mHead.load(std::memory_order_acquire) - this->_mTail.load(std::memory_order_acquire));
+        }
+
+    private:
+        T _mItems[Size];
+
+        std::atomic<uint16_t> _mHead;
+        std::atomic<uint16_t> _mTail;
+};
+
+/** @brief Removed queue. The queue is always full and empty.
+ */
+template<typename T>
+class MQTTQueue<T, 0>
+{
+    public:
+        T* Reserve(void)
+        {
+            return NULL;
+        }
+
+        void Commit(void)
+        {
+        }
+
+        T* Peek(void)
+        {
+            return NULL;
+        }
+
+        void Release(void)
+        {
+        }
+
+        uint16_t Count(void) const
+        {
+            return 0x00;
+        }
+};
+
+/** @brief Bounded lock-free queue for multiple producers and one consumer.
+ *         Each element carries a sequence number, which tells the producers and the consumer
+ *         who owns the element. The producers claim an element with a single compare-and-swap,
+ *         fill it in place and commit it. The consumer works like in #MQTTQueue.
+ *  @tparam T       Element type
+ *  @tparam Size    Number of elements. Must be a power of two.
+ */
+template<typename T, uint16_t Size>
+class MQTTMPSCQueue
+{
+    static_assert((Size > 0) && ((Size & (Size - 1)) == 0), "Queue size must be a power of two!");
+
+    public:
+        /** @brief Constructor.
+         */
+        MQTTMPSCQueue(void) : _mHead(0), _mTail(0)
+        {
+            for(uint16_t i = 0x00; i < Size; i++)
+            {
+                this->_mSequence[i].store(i, std::memory_order_relaxed);
+            }
+        }
+
+        /** @brief  Claim a free element. Can be called by any thread.
+         *  @return Pointer to the free element or #NULL when the queue is full
+         */
+        T* Reserve(void)
+        {
+            uint32_t Head = this->_mHead.load(std::memory_order_relaxed);
+
+            while(true)
+            {
+                uint32_t Sequence = this->_mSequence[Head & (Size - 1)].load(std::memory_order_acquire);
+                int32_t Difference = (int32_t)(Sequence - Head);
+
+                if(Difference == 0)
+                {
+                    if(this->_mHead.compare_exchange_weak(Head, Head + 1, std::memory_order_relaxed))
+                    {
+                        return &this->_mItems[Head & (Size - 1)];
+                    }
+                }
+                else if(Difference < 0)
+                {
+                    return NULL;
+                }
+                else
+                {
+                    Head = this->_mHead.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        /** @brief      Hand a claimed element over to the consumer.
+         *  @param Item Element from #Reserve
+         */
+        void Commit(T* Item)
+        {
+            uint16_t Index = Item - this->_mItems;
+
+            this->_mSequence[Index].store(this->_mSequence[Index].load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        /** @brief  Get the oldest element. Must only be called by the consumer.
+         *  @return Pointer to the element or #NULL when the queue is empty or the oldest element isn't committed yet
+         */
+        T* Peek(void)
+        {
+            uint32_t Tail = this->_mTail.load(std::memory_order_relaxed);
+
+            if(this->_mSequence[Tail & (Size - 1)].load(std::memory_order_acquire) != (Tail + 1))
+            {
+                return NULL;
+            }
+
+            return &this->_mItems[Tail & (Size - 1)];
+        }
+
+        /** @brief          Get a committed element behind the oldest element. Must only be called by the consumer.
+         *  @param Offset   Position from the oldest element
+         *  @return         Pointer to the element or #NULL when the element isn't committed
+         */
+        T* PeekAt(uint16_t Offset)
+        {
+            uint32_t Position = this->_mTail.load(std::memory_order_relaxed) + Offset;
+
+            if((Offset >= Size) || (this->_mSequence[Position & (Size - 1)].load(std::memory_order_acquire) != (Position + 1)))
+            {
+                return NULL;
+            }
+
+            return &this->_mItems[Position & (Size - 1)];
+        }
+
+        /** @brief          Get the position of an element in the queue storage.
+         *  @param Item     Element of the queue
+         *  @return         Index of the element
+         */
+        uint16_t IndexOf(const T* Item) const
+        {
+            return (uint16_t)(Item - this->_mItems);
+        }
+
+        /** @brief Return the element from #Peek back to the producers.
+         */
+        void Release(void)
+        {
+            uint32_t Tail = this->_mTail.load(std::memory_order_relaxed);
+
+            this->_mSequence[Tail & (Size - 1)].store(Tail + Size, std::memory_order_release);
+            this->_mTail.store(Tail + 1, std::memory_order_relaxed);
+        }
+
+        /** @brief  Get the number of claimed elements.
+         *  @return Number of elements
+         */
+        uint16_t Count(void) const
+        {
+            return (uint16_t)(this->_mHead.load(std::memory_order_relaxed) - this->_mTail.load(std::memory_order_relaxed));
+        }
+
+    private:
+        T _mItems[Size];
+
+        std::atomic<uint32_t> _mSequence[Size];
+        std::atomic<uint32_t> _mHead;
+        std::atomic<uint32_t> _mTail;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,280 @@
+/*
+ * MQTT_RateLimit.h
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Token-bucket rate limiter and topic priorities for the outbound path.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTT_RateLimit.h
+ *  @brief Token-bucket rate limiter and topic priorities for the outbound path.
+ *
+ *  @author Daniel Kampert
+ */
+
+#ifndef MQTT_RATELIMIT_H_
+#define MQTT_RATELIMIT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "mqtt_topic.h"
+
+/** @brief Number of topics with a custom priority.
+ */
+#ifndef MQTT_PRIORITY_SIZE
+    #define MQTT_PRIORITY_SIZE                      8
+#endif
+
+/** @brief Maximum length of a topic with a custom priority.
+ */
+#ifndef MQTT_PRIORITY_TOPIC_LENGTH
+    #define MQTT_PRIORITY_TOPIC_LENGTH              64
+#endif
+
+/** @brief Token bucket. The bucket is filled with #Rate tokens per second up to the burst size.
+ */
+class MQTTTokenBucket
+{
+    public:
+        /** @brief Constructor. Creates an unlimited bucket.
+         */
+        MQTTTokenBucket(void) : _mRate(0x00), _mBurst(0x00), _mTokens(0x00), _mLast(0x00)
+        {
+        }
+
+        /** @brief          Set the rate of the bucket. The bucket starts full.
+         *  @param Rate     Tokens per second. 0 for an unlimited bucket
+         *  @param Burst    Maximum number of tokens
+         *  @param Now      Current time in ms
+         */
+        void Configure(uint32_t Rate, uint32_t Burst, uint32_t Now)
+        {
+            this->_mRate = Rate;
+            this->_mBurst = (uint64_t)Burst * 1000;
+            this->_mTokens = this->_mBurst;
+            this->_mLast = Now;
+        }
+
+        /** @brief          Check if the bucket has enough tokens.
+         *  @param Tokens   Number of tokens
+         *  @param Now      Current time in ms
+         *  @return         #true when the tokens are available
+         */
+        bool isAvailable(uint32_t Tokens, uint32_t Now)
+        {
+            if(this->_mRate == 0x00)
+            {
+                return true;
+            }
+
+            // The tokens are stored in 1/1000 to refill the bucket every millisecond
+            this->_mTokens += (uint64_t)(Now - this->_mLast) * this->_mRate;
+            if(this->_mTokens > this->_mBurst)
+            {
+                this->_mTokens = this->_mBurst;
+            }
+            this->_mLast = Now;
+
+            return (this->_mTokens >= ((uint64_t)Tokens * 1000));
+        }
+
+        /** @brief          Remove tokens from the bucket. Call #isAvailable first.
+         *  @param Tokens   Number of tokens
+         */
+        void Consume(uint32_t Tokens)
+        {
+            if(this->_mRate > 0x00)
+            {
+                this->_mTokens -= (uint64_t)Tokens * 1000;
+            }
+        }
+
+        /** @brief  Check if the bucket limits the rate.
+         *  @return #true when limited
+         */
+        bool isLimited(void) const
+        {
+            return (this->_mRate > 0x00);
+        }
+
+    private:
+        uint32_t _mRate;
+        uint64_t _mBurst;
+        uint64_t _mTokens;
+        uint32_t _mLast;
+};
+
+/** @brief Rate limiter for a traffic class with a bucket for the bytes and a bucket for the messages.
+ *         NOTE: Must only be used by one thread!
+ */
+class MQTTRateLimiter
+{
+    public:
+        /** @brief                      Set the rate of the class. Each bucket allows a burst of one second.
+         *  @param BytesPerSecond       Transmitted bytes per second. 0 for no limit
+         *  @param MessagesPerSecond    Transmitted messages per second. 0 for no limit
+         *  @param MaximumMessage       Size of the largest message. The byte bucket holds at least one message
+         *  @param Now                  Current time in ms
+         */
+        void Configure(uint32_t BytesPerSecond, uint32_t MessagesPerSecond, uint16_t MaximumMessage, uint32_t Now)
+        {
+            this->_mBytes.Configure(BytesPerSecond, (BytesPerSecond > MaximumMessage) ? BytesPerSecond : MaximumMessage, Now);
+            this->_mMessages.Configure(MessagesPerSecond, MessagesPerSecond, Now);
+        }
+
+        /** @brief          Take the tokens for a message from both buckets.
+         *  @param Bytes    Size of the message
+         *  @param Now      Current time in ms
+         *  @return         #true when the message can be transmitted
+         */
+        bool Acquire(uint16_t Bytes, uint32_t Now)
+        {
+            if(!this->_mBytes.isAvailable(Bytes, Now) || !this->_mMessages.isAvailable(0x01, Now))
+            {
+                return false;
+            }
+
+            this->_mBytes.Consume(Bytes);
+            this->_mMessages.Consume(0x01);
+
+            return true;
+        }
+
+        /** @brief  Check if the class is rate limited.
+         *  @return #true when limited
+         */
+        bool isLimited(void) const
+        {
+            return this->_mBytes.isLimited() || this->_mMessages.isLimited();
+        }
+
+    private:
+        MQTTTokenBucket _mBytes;
+        MQTTTokenBucket _mMessages;
+};
+
+/** @brief Table with the priorities of the topics. Topics without an entry use the default priority.
+ */
+class MQTTPriorityTable
+{
+    public:
+        /** @brief Constructor.
+         */
+        MQTTPriorityTable(void) : _mCount(0x00)
+        {
+        }
+
+        /** @brief          Set the priority of a topic.
+         *                  NOTE: Must not be called while other threads are publishing!
+         *  @param Topic    Topic string
+         *  @param Length   Length of the topic
+         *  @param Priority Priority
+         *  @return         #true when the priority is stored
+         */
+        bool Set(const char* Topic, uint16_t Length, uint8_t Priority)
+        {
+            Entry* Current;
+
+            if((Topic == NULL) || (Length == 0x00) || (Length > MQTT_PRIORITY_TOPIC_LENGTH))
+            {
+                return false;
+            }
+
+            Current = this->_find(Topic, Length, MQTT_HashTopic(Topic, Length));
+            if(Current != NULL)
+            {
+                Current->Priority = Priority;
+
+                return true;
+            }
+
+            if(this->_mCount >= MQTT_PRIORITY_SIZE)
+            {
+                return false;
+            }
+
+            Current = &this->_mEntries[this->_mCount];
+            Current->Hash = MQTT_HashTopic(Topic, Length);
+            Current->Length = Length;
+            Current->Priority = Priority;
+            memcpy(Current->Topic, Topic, Length);
+            this->_mCount++;
+
+            return true;
+        }
+
+        /** @brief          Get the priority of a topic.
+         *  @param Topic    Topic string
+         *  @param Length   Length of the topic
+         *  @param Default  Priority for topics without an entry
+         *  @return         Priority
+         */
+        uint8_t Get(const char* Topic, uint16_t Length, uint8_t Default) const
+        {
+            const Entry* Current;
+
+            if(this->_mCount == 0x00)
+            {
+                return Default;
+            }
+
+            Current = this->_find(Topic, Length, MQTT_HashTopic(Topic, Length));
+            if(Current == NULL)
+            {
+                return Default;
+            }
+
+            return Current->Priority;
+        }
+
+    private:
+        typedef struct
+        {
+            uint32_t Hash;
+            uint16_t Length;
+            uint8_t Priority;
+            char Topic[MQTT_PRIORITY_TOPIC_LENGTH];
+        } Entry;
+
+        Entry _mEntries[MQTT_PRIORITY_SIZE];
+        uint8_t _mCount;
+
+        /** @brief          Find the entry of a topic. The hash is only used to skip entries, so colliding topics get different entries.
+         *  @param Topic    Topic string
+         *  @param Length   Length of the topic
+         *  @param Hash     Hash of the topic
+         *  @return         Pointer to the entry or #NULL when the topic has no entry
+         */
+        Entry* _find(const char* Topic, uint16_t Length, uint32_t Hash) const
+        {
+            for(uint8_t i = 0x00; i < this->_mCount; i++)
+            {
+                if((this->_mEntries[i].Hash == Hash) && (this->_mEntries[i].Length == Length) && (memcmp(this->_mEntries[i].Topic, Topic, Length) == 0x00))
+                {
+                    return (Entry*)&this->_mEntries[i];
+                }
+            }
+
+            return NULL;
+        }
+};
+
+#endif
\ No newline at end of file
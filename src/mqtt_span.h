@@ -0,0 +1,88 @@
+/*
+ * MQTT_Span.h
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Non-owning byte ranges for the MQTT client.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTT_Span.h
+ *  @brief Non-owning byte ranges for the MQTT client.
+ *
+ *  @author Daniel Kampert
+ */
+
+#ifndef MQTT_SPAN_H_
+#define MQTT_SPAN_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** @brief Pointer and length of a payload, which is owned by the application.
+ */
+class MQTTSpan
+{
+    public:
+        /** @brief          Constructor.
+         *  @param Data     Pointer to the data
+         *  @param Length   Length of the data
+         */
+        MQTTSpan(const uint8_t* Data, uint16_t Length) : _mData(Data), _mLength(Length)
+        {
+        }
+
+        /** @brief          Constructor.
+         *  @param Data     Pointer to the characters
+         *  @param Length   Number of characters
+         */
+        MQTTSpan(const char* Data, uint16_t Length) : _mData((const uint8_t*)Data), _mLength(Length)
+        {
+        }
+
+        /** @brief          Constructor.
+         *  @param Data     Byte array
+         */
+        template<size_t N>
+        MQTTSpan(const uint8_t (&Data)[N]) : _mData(Data), _mLength(N)
+        {
+            static_assert(N <= 0xFFFF, "Array is too large for a span!");
+        }
+
+        /** @brief	Get the data.
+         *  @return	Pointer to the data
+         */
+        const uint8_t* Data(void) const
+        {
+            return this->_mData;
+        }
+
+        /** @brief	Get the length of the data.
+         *  @return	Length in bytes
+         */
+        uint16_t Length(void) const
+        {
+            return this->_mLength;
+        }
+
+    private:
+        const uint8_t* _mData;
+        uint16_t _mLength;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,215 @@
+/*
+ * MQTT_Thread.h
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Thread backends for the MQTT client.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTT_Thread.h
+ *  @brief Thread backends for the MQTT client. Particle devices use the Device OS threads and mutexes,
+ *         all other platforms (i. e. Linux) use std::thread and std::mutex.
+ *
+ *  @author Daniel Kampert
+ */
+
+#ifndef MQTT_THREAD_H_
+#define MQTT_THREAD_H_
+
+#include "application.h"
+
+#if !defined(PARTICLE)
+    #include <chrono>
+    #include <mutex>
+    #include <thread>
+#endif
+
+/** @brief Stack size of the I/O thread.
+ */
+#ifndef MQTT_THREAD_STACK_SIZE
+    #define MQTT_THREAD_STACK_SIZE                  3072
+#endif
+
+class MQTTThread
+{
+    public:
+        /** @brief              Thread function prototype.
+         *  @param Parameter    User parameter
+         */
+        typedef void(*Thread_Function)(void* Parameter);
+
+        /** @brief Constructor.
+         */
+        MQTTThread(void) : _mThread(NULL)
+        {
+        }
+
+        /** @brief Deconstructor. Waits for the thread.
+         */
+        ~MQTTThread()
+        {
+            this->Join();
+        }
+
+        /** @brief              Start the thread.
+         *  @param Function     Thread function
+         *  @param Parameter    Parameter for the thread function
+         *  @return             #true when successful
+         */
+        bool Start(Thread_Function Function, void* Parameter)
+        {
+            if(this->_mThread != NULL)
+            {
+                return false;
+            }
+
+            #if defined(PARTICLE)
+                this->_mThread = new Thread("mqtt", Function, Parameter, OS_THREAD_PRIORITY_DEFAULT, MQTT_THREAD_STACK_SIZE);
+            #else
+                this->_mThread = new std::thread(Function, Parameter);
+            #endif
+
+            return (this->_mThread != NULL);
+        }
+
+        /** @brief Wait until the thread function has returned and release the thread.
+         */
+        void Join(void)
+        {
+            if(this->_mThread == NULL)
+            {
+                return;
+            }
+
+            this->_mThread->join();
+            delete this->_mThread;
+            this->_mThread = NULL;
+        }
+
+        /** @brief Give other threads a chance to run without suspending the calling thread.
+         */
+        static void Yield(void)
+        {
+            #if defined(PARTICLE)
+                os_thread_yield();
+            #else
+                std::this_thread::yield();
+            #endif
+        }
+
+        /** @brief Suspend the calling thread for one millisecond to give other threads a chance to run.
+         */
+        static void Sleep(void)
+        {
+            #if defined(PARTICLE)
+                delay(1);
+            #else
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            #endif
+        }
+
+        /** @brief  Get the identifier of the calling thread.
+         *  @return Thread identifier. Never 0
+         */
+        static uintptr_t Current(void)
+        {
+            #if defined(PARTICLE)
+                return (uintptr_t)os_thread_current(NULL);
+            #else
+                static thread_local uint8_t Marker;
+
+                return (uintptr_t)&Marker;
+            #endif
+        }
+
+        /** @brief          Add a value to a counter, which is written by more than one thread.
+         *  @param Counter  Pointer to the counter
+         *  @param Value    Value
+         */
+        static void Add(uint32_t* Counter, uint32_t Value)
+        {
+            __atomic_fetch_add(Counter, Value, __ATOMIC_RELAXED);
+        }
+
+        /** @brief          Add a signed value to a counter, which is written by more than one thread.
+         *  @param Counter  Pointer to the counter
+         *  @param Value    Value
+         */
+        static void Add(int32_t* Counter, int32_t Value)
+        {
+            __atomic_fetch_add(Counter, Value, __ATOMIC_RELAXED);
+        }
+
+        /** @brief          Read a counter, which is written by another thread.
+         *  @param Counter  Pointer to the counter
+         *  @return         Value of the counter
+         */
+        static uint32_t Load(const uint32_t* Counter)
+        {
+            return __atomic_load_n(Counter, __ATOMIC_RELAXED);
+        }
+
+        /** @brief          Set a counter, which is written by another thread.
+         *  @param Counter  Pointer to the counter
+         *  @param Value    Value
+         */
+        static void Store(uint32_t* Counter, uint32_t Value)
+        {
+            __atomic_store_n(Counter, Value, __ATOMIC_RELAXED);
+        }
+
+    private:
+        #if defined(PARTICLE)
+            Thread* _mThread;
+        #else
+            std::thread* _mThread;
+        #endif
+};
+
+/** @brief Mutex for the state, which is shared by the publishing threads, the I/O thread and timer callbacks.
+ *         A waiting thread is suspended instead of spinning, so a low priority owner can't be starved
+ *         by a high priority thread. The Device OS mutex raises the priority of the owner while a thread waits.
+ *         NOTE: Must not be used from an interrupt!
+ */
+class MQTTMutex
+{
+    public:
+        /** @brief Wait until the mutex is free and take it.
+         */
+        void Lock(void)
+        {
+            this->_mMutex.lock();
+        }
+
+        /** @brief Give the mutex from #Lock back.
+         */
+        void Unlock(void)
+        {
+            this->_mMutex.unlock();
+        }
+
+    private:
+        #if defined(PARTICLE)
+            Mutex _mMutex;
+        #else
+            std::mutex _mMutex;
+        #endif
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,234 @@
+/*
+ * MQTT_Topic.h
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Prepared topics for the MQTT client.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTT_Topic.h
+ *  @brief Prepared topics for the MQTT client.
+ *
+ *  @author Daniel Kampert
+ */
+
+#ifndef MQTT_TOPIC_H_
+#define MQTT_TOPIC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** @brief          Calculate the FNV-1a hash of a topic.
+ *  @param Topic    Topic string
+ *  @param Length   Length of the topic
+ *  @return         Hash
+ */
+inline uint32_t MQTT_HashTopic(const char* Topic, uint16_t Length)
+{
+    uint32_t Hash = 0x811C9DC5;
+
+    for(uint16_t i = 0x00; i < Length; i++)
+    {
+        Hash ^= (uint8_t)Topic[i];
+        Hash *= 0x01000193;
+    }
+
+    return Hash;
+}
+
+/** @brief  Marks an invalid topic. This function isn't constexpr, so an invalid string literal
+ *          stops the compilation when the topic is prepared at compile time.
+ *  @return Size of an invalid topic
+ */
+inline uint16_t MQTT_InvalidTopic(void)
+{
+    return 0x00;
+}
+
+/** @brief Encoded topic, which can be copied into a publish message without any further processing.
+ *         Use #MQTTPreparedTopic to create the encoding.
+ */
+class MQTTTopic
+{
+    public:
+        /** @brief          Constructor.
+         *  @param Data     Topic with the length prefix
+         *  @param Size     Size of the encoded topic (length prefix included)
+         */
+        MQTTTopic(const uint8_t* Data, uint16_t Size) : _mData(Data), _mSize(Size)
+        {
+        }
+
+        /** @brief	Check if the topic is valid.
+         *  @return	#true when valid
+         */
+        bool isValid(void) const
+        {
+            return (this->_mSize > 0x02);
+        }
+
+        /** @brief	Get the encoded topic.
+         *  @return	Pointer to the topic with the length prefix
+         */
+        const uint8_t* Data(void) const
+        {
+            return this->_mData;
+        }
+
+        /** @brief	Get the size of the encoded topic.
+         *  @return	Size in bytes (length prefix included)
+         */
+        uint16_t Size(void) const
+        {
+            return this->_mSize;
+        }
+
+    private:
+        const uint8_t* _mData;
+        uint16_t _mSize;
+};
+
+/** @brief Topic storage with the length-prefixed and validated encoding of a publish topic.
+ *         The topic is checked for wildcards once when it is prepared.
+ *         String literals can be prepared at compile time with #MQTT_Topic:
+ *              constexpr auto Temperature = MQTT_Topic("sensor/temperature");
+ *  @tparam Capacity    Maximum length of the topic
+ */
+template<uint16_t Capacity>
+class MQTTPreparedTopic
+{
+    public:
+        /** @brief Constructor. Creates an invalid topic.
+         */
+        constexpr MQTTPreparedTopic(void) : _mData{}, _mSize(0x00)
+        {
+        }
+
+        /** @brief          Constructor.
+         *  @param Topic    Topic string
+         */
+        template<size_t N>
+        constexpr MQTTPreparedTopic(const char (&Topic)[N]) : _mData{}, _mSize(0x00)
+        {
+            uint16_t Length = 0x00;
+
+            while((Length < (N - 0x01)) && (Topic[Length] != 0x00))
+            {
+                // Wildcards aren't allowed for publish topics
+                if((Length >= Capacity) || (Topic[Length] == '+') || (Topic[Length] == '#'))
+                {
+                    this->_mSize = MQTT_InvalidTopic();
+
+                    return;
+                }
+
+                this->_mData[0x02 + Length] = Topic[Length];
+                Length++;
+            }
+
+            if(Length == 0x00)
+            {
+                this->_mSize = MQTT_InvalidTopic();
+
+                return;
+            }
+
+            this->_mData[0] = Length >> 0x08;
+            this->_mData[1] = Length & 0xFF;
+            this->_mSize = Length + 0x02;
+        }
+
+        /** @brief          Prepare a topic at runtime.
+         *  @param Topic    Topic string
+         *  @return         #true when the topic is valid
+         */
+        bool Prepare(const char* Topic)
+        {
+            uint16_t Length = 0x00;
+
+            this->_mSize = 0x00;
+
+            if(Topic == NULL)
+            {
+                return false;
+            }
+
+            while(Topic[Length] != 0x00)
+            {
+                if((Length >= Capacity) || (Topic[Length] == '+') || (Topic[Length] == '#'))
+                {
+                    return false;
+                }
+
+                this->_mData[0x02 + Length] = Topic[Length];
+                Length++;
+            }
+
+            if(Length == 0x00)
+            {
+                return false;
+            }
+
+            this->_mData[0] = Length >> 0x08;
+            this->_mData[1] = Length & 0xFF;
+            this->_mSize = Length + 0x02;
+
+            return true;
+        }
+
+        /** @brief	Check if the topic is valid.
+         *  @return	#true when valid
+         */
+        constexpr bool isValid(void) const
+        {
+            return (this->_mSize > 0x02);
+        }
+
+        /** @brief	Get the length of the topic.
+         *  @return	Length without the length prefix
+         */
+        constexpr uint16_t Length(void) const
+        {
+            return this->isValid() ? (this->_mSize - 0x02) : 0x00;
+        }
+
+        /** @brief	Get the encoded topic.
+         *  @return	Encoded topic
+         */
+        operator MQTTTopic(void) const
+        {
+            return MQTTTopic(this->_mData, this->_mSize);
+        }
+
+    private:
+        uint8_t _mData[Capacity + 0x02];
+        uint16_t _mSize;
+};
+
+/** @brief          Prepare a string literal as topic at compile time.
+ *  @param Topic    Topic string
+ *  @return         Prepared topic
+ */
+template<size_t N>
+constexpr MQTTPreparedTopic<N - 0x01> MQTT_Topic(const char (&Topic)[N])
+{
+    return MQTTPreparedTopic<N - 0x01>(Topic);
+}
+
+#endif
\ No newline at end of file
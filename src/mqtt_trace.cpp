@@ -0,0 +1,194 @@
+/*
+ * MQTT_Trace.cpp
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Trace sink for the host build.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTT_Trace.cpp
+ *  @brief Trace sink for the host build.
+ *
+ *  @author Daniel Kampert
+ */
+
+#include "mqtt_trace.h"
+
+#if !defined(PARTICLE)
+
+#include <stdio.h>
+#include <string.h>
+
+/** @brief Magic of a binary trace.
+ */
+static const char MQTT_TRACE_MAGIC[4] = {'M', 'Q', 'T', 'R'};
+
+/** @brief Names of the control packets.
+ */
+static const char* const MQTT_TRACE_PACKETS[16] = {"RESERVED", "CONNECT", "CONNACK", "PUBLISH", "PUBACK", "PUBREC", "PUBREL", "PUBCOMP",
+                                                   "SUBSCRIBE", "SUBACK", "UNSUBSCRIBE", "UNSUBACK", "PINGREQ", "PINGRESP", "DISCONNECT", "AUTH"};
+
+/** @brief Names of the queues.
+ */
+static const char* const MQTT_TRACE_QUEUES[4] = {"control", "outbound", "bulk", "inbound"};
+
+MQTTTraceRing::MQTTTraceRing(void) : _mHead(0x00)
+{
+}
+
+void MQTTTraceRing::Record(const MQTT_Trace_Record& Record)
+{
+    this->_mRecords[this->_mHead.fetch_add(0x01, std::memory_order_relaxed) % MQTT_TRACE_RING_SIZE] = Record;
+}
+
+uint32_t MQTTTraceRing::Count(void) const
+{
+    uint32_t Head = this->_mHead.load(std::memory_order_relaxed);
+
+    return (Head < MQTT_TRACE_RING_SIZE) ? Head : MQTT_TRACE_RING_SIZE;
+}
+
+bool MQTTTraceRing::Save(const char* Path) const
+{
+    uint32_t Head = this->_mHead.load(std::memory_order_acquire);
+    uint32_t Count = this->Count();
+    bool Success = true;
+
+    FILE* File = fopen(Path, "wb");
+    if(File == NULL)
+    {
+        return false;
+    }
+
+    Success = Success && (fwrite(MQTT_TRACE_MAGIC, sizeof(MQTT_TRACE_MAGIC), 0x01, File) == 0x01);
+    Success = Success && (fwrite(&Count, sizeof(Count), 0x01, File) == 0x01);
+
+    // Start with the oldest record
+    for(uint32_t i = Head - Count; Success && (i != Head); i++)
+    {
+        Success = (fwrite(&this->_mRecords[i % MQTT_TRACE_RING_SIZE], sizeof(MQTT_Trace_Record), 0x01, File) == 0x01);
+    }
+
+    return (fclose(File) == 0x00) && Success;
+}
+
+bool MQTTTraceRing::Convert(const char* Input, const char* Output)
+{
+    char Magic[sizeof(MQTT_TRACE_MAGIC)];
+    uint32_t Count;
+    uint32_t Last = 0x00;
+    uint64_t Time = 0x00;
+    int32_t Depth[4] = {0x00};
+    MQTT_Trace_Record Record;
+    bool Success = true;
+
+    FILE* In = fopen(Input, "rb");
+    if(In == NULL)
+    {
+        return false;
+    }
+
+    if((fread(Magic, sizeof(Magic), 0x01, In) != 0x01) || memcmp(Magic, MQTT_TRACE_MAGIC, sizeof(Magic)) || (fread(&Count, sizeof(Count), 0x01, In) != 0x01))
+    {
+        fclose(In);
+
+        return false;
+    }
+
+    FILE* Out = fopen(Output, "w");
+    if(Out == NULL)
+    {
+        fclose(In);
+
+        return false;
+    }
+
+    // The socket, the connection and each queue get a separate track
+    fprintf(Out, "{\"traceEvents\":[\n");
+    fprintf(Out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"socket\"}},\n");
+    fprintf(Out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"connection\"}}");
+    for(uint8_t i = 0x00; i < 0x04; i++)
+    {
+        fprintf(Out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s queue\"}}", 3 + i, MQTT_TRACE_QUEUES[i]);
+    }
+
+    for(uint32_t i = 0x00; i < Count; i++)
+    {
+        if(fread(&Record, sizeof(Record), 0x01, In) != 0x01)
+        {
+            Success = false;
+
+            break;
+        }
+
+        // The timestamps overflow after 71 minutes. Only the difference to the last record is used
+        if(i > 0x00)
+        {
+            Time += (uint32_t)(Record.Time - Last);
+        }
+        Last = Record.Time;
+
+        switch(Record.Event)
+        {
+            case(MQTT_TRACE_ENCODE):
+            case(MQTT_TRACE_DECODE):
+            {
+                fprintf(Out, ",\n{\"name\":\"%s %s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%llu,\"pid\":1,\"tid\":1,\"args\":{\"bytes\":%u}}",
+                        (Record.Event == MQTT_TRACE_ENCODE) ? "encode" : "decode", MQTT_TRACE_PACKETS[Record.Argument >> 0x04], (unsigned long long)Time, Record.Value);
+
+                break;
+            }
+            case(MQTT_TRACE_CONNECT):
+            case(MQTT_TRACE_DISCONNECT):
+            case(MQTT_TRACE_KEEPALIVE_TIMEOUT):
+            {
+                const char* Name = (Record.Event == MQTT_TRACE_CONNECT) ? "connect" : ((Record.Event == MQTT_TRACE_DISCONNECT) ? "disconnect" : "keepalive timeout");
+
+                fprintf(Out, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"p\",\"ts\":%llu,\"pid\":1,\"tid\":2,\"args\":{\"code\":%u}}", Name, (unsigned long long)Time, Record.Argument);
+
+                break;
+            }
+            case(MQTT_TRACE_ENQUEUE):
+            case(MQTT_TRACE_DEQUEUE):
+            {
+                uint8_t Queue = Record.Argument & 0x03;
+
+                // The ring can start in the middle of a queue operation
+                Depth[Queue] += (Record.Event == MQTT_TRACE_ENQUEUE) ? 0x01 : -0x01;
+                if(Depth[Queue] < 0x00)
+                {
+                    Depth[Queue] = 0x00;
+                }
+
+                fprintf(Out, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%llu,\"pid\":1,\"tid\":%u,\"args\":{\"bytes\":%u}}",
+                        (Record.Event == MQTT_TRACE_ENQUEUE) ? "enqueue" : "dequeue", (unsigned long long)Time, 3 + Queue, Record.Value);
+                fprintf(Out, ",\n{\"name\":\"%s depth\",\"ph\":\"C\",\"ts\":%llu,\"pid\":1,\"args\":{\"packets\":%d}}", MQTT_TRACE_QUEUES[Queue], (unsigned long long)Time, (int)Depth[Queue]);
+
+                break;
+            }
+        }
+    }
+
+    fprintf(Out, "\n]}\n");
+    fclose(In);
+
+    return (fclose(Out) == 0x00) && Success;
+}
+
+#endif
\ No newline at end of file
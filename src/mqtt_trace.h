@@ -0,0 +1,202 @@
+/*
+ * MQTT_Trace.h
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Compile-time trace hooks for the MQTT client.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTT_Trace.h
+ *  @brief Compile-time trace hooks for the MQTT client.
+ *
+ *  @author Daniel Kampert
+ */
+
+#ifndef MQTT_TRACE_H_
+#define MQTT_TRACE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "application.h"
+#include "mqtt_delegate.h"
+
+#if !defined(PARTICLE)
+    #include <atomic>
+#endif
+
+/** @brief Set to 1 to pass the trace events to the trace sink. The trace points are removed from the client otherwise.
+ */
+#ifndef MQTT_TRACE
+    #define MQTT_TRACE                              0
+#endif
+
+/** @brief Number of records in the trace ring of the host build.
+ */
+#ifndef MQTT_TRACE_RING_SIZE
+    #define MQTT_TRACE_RING_SIZE                    4096
+#endif
+
+/** @brief Trace events.
+ */
+typedef enum
+{
+    MQTT_TRACE_ENCODE = 0x00,                               /**< Encoded packet written to the socket. Argument: First byte of the fixed header. Value: Size of the packet. */
+    MQTT_TRACE_DECODE = 0x01,                               /**< Packet read from the socket. Argument: First byte of the fixed header. Value: Size of the packet. */
+    MQTT_TRACE_CONNECT = 0x02,                              /**< Connection acknowledged by the broker. Argument: Connection state. */
+    MQTT_TRACE_DISCONNECT = 0x03,                           /**< Connection closed. Argument: Reason code (0 when closed by the client). */
+    MQTT_TRACE_KEEPALIVE_TIMEOUT = 0x04,                    /**< The broker didn't answer the last ping. */
+    MQTT_TRACE_ENQUEUE = 0x05,                              /**< Packet added to a queue. Argument: Queue. Value: Size of the packet. */
+    MQTT_TRACE_DEQUEUE = 0x06,                              /**< Packet removed from a queue. Argument: Queue. Value: Size of the packet. */
+} MQTT_Trace_Event;
+
+/** @brief Queues of the queue events. The outbound queues use the number of the priority class.
+ */
+typedef enum
+{
+    MQTT_TRACE_QUEUE_CONTROL = 0x00,                        /**< Control packets. */
+    MQTT_TRACE_QUEUE_HIGH = 0x01,                           /**< Outbound queue. */
+    MQTT_TRACE_QUEUE_BULK = 0x02,                           /**< Bulk queue. */
+    MQTT_TRACE_QUEUE_INBOUND = 0x03,                        /**< Received messages. */
+} MQTT_Trace_Queue;
+
+/** @brief Trace record.
+ */
+typedef struct
+{
+    uint32_t Time;                                          /**< Timestamp in us. */
+    uint8_t Event;                                          /**< Trace event (see #MQTT_Trace_Event). */
+    uint8_t Argument;                                       /**< Argument of the event. */
+    uint16_t Value;                                         /**< Value of the event. */
+} MQTT_Trace_Record;
+
+/** @brief Trace sink. The sink is called by the thread, which hits the trace point, and must not block.
+ */
+typedef MQTTDelegate<void(const MQTT_Trace_Record& Record)> MQTT_Trace_Sink;
+
+/** @brief Trace points of the client.
+ *  @tparam Enabled #false to remove the trace points. All functions are empty then
+ */
+template<bool Enabled>
+class MQTTTraceHooks
+{
+    public:
+        /** @brief      Set the trace sink for all clients.
+         *              NOTE: Must not be called while a client is running!
+         *  @param Sink Trace sink
+         */
+        static void SetSink(const MQTT_Trace_Sink& Sink)
+        {
+            _mSink = Sink;
+        }
+
+        /** @brief          Pass an event to the trace sink.
+         *  @param Event    Trace event
+         *  @param Argument Argument of the event
+         *  @param Value    Value of the event
+         */
+        static void Emit(MQTT_Trace_Event Event, uint8_t Argument, uint16_t Value)
+        {
+            if(_mSink.isValid())
+            {
+                MQTT_Trace_Record Record = {(uint32_t)micros(), (uint8_t)Event, Argument, Value};
+
+                _mSink(Record);
+            }
+        }
+
+    private:
+        static MQTT_Trace_Sink _mSink;
+};
+
+template<bool Enabled>
+MQTT_Trace_Sink MQTTTraceHooks<Enabled>::_mSink;
+
+/** @brief Disabled trace points. The calls are removed by the compiler.
+ */
+template<>
+class MQTTTraceHooks<false>
+{
+    public:
+        static void SetSink(const MQTT_Trace_Sink&)
+        {
+        }
+
+        static void Emit(MQTT_Trace_Event, uint8_t, uint16_t)
+        {
+        }
+};
+
+/** @brief Trace points of the client, which are enabled with #MQTT_TRACE.
+ */
+typedef MQTTTraceHooks<(MQTT_TRACE != 0)> MQTTTrace;
+
+#if !defined(PARTICLE)
+/** @brief Trace sink for the host build. The sink keeps the last #MQTT_TRACE_RING_SIZE records in a ring,
+ *         which can be saved as binary trace and converted into the Chrome trace event format
+ *         (i. e. for chrome://tracing or https://ui.perfetto.dev).
+ *         Example: MQTTTrace::SetSink(Ring.Sink());
+ */
+class MQTTTraceRing
+{
+    public:
+        /** @brief Constructor.
+         */
+        MQTTTraceRing(void);
+
+        /** @brief          Add a record to the ring. Can be called by any thread.
+         *  @param Record   Trace record
+         */
+        void Record(const MQTT_Trace_Record& Record);
+
+        /** @brief  Get a trace sink for the ring.
+         *  @return Trace sink
+         */
+        MQTT_Trace_Sink Sink(void)
+        {
+            return MQTT_Trace_Sink::Bind<MQTTTraceRing, &MQTTTraceRing::Record>(this);
+        }
+
+        /** @brief  Get the number of records in the ring.
+         *  @return Number of records
+         */
+        uint32_t Count(void) const;
+
+        /** @brief      Save the ring as binary trace, starting with the oldest record.
+         *              The file contains the magic "MQTR", the number of records (uint32_t) and the records.
+         *              NOTE: Must not be called while records are added!
+         *  @param Path Path of the binary trace
+         *  @return     #true when successful
+         */
+        bool Save(const char* Path) const;
+
+        /** @brief          Convert a binary trace into the Chrome trace event format.
+         *  @param Input    Path of the binary trace
+         *  @param Output   Path of the JSON file
+         *  @return         #true when successful
+         */
+        static bool Convert(const char* Input, const char* Output);
+
+    private:
+        MQTT_Trace_Record _mRecords[MQTT_TRACE_RING_SIZE];
+        std::atomic<uint32_t> _mHead;
+};
+#endif
+
+#endif
\ No newline at end of file
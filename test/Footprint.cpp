@@ -0,0 +1,174 @@
+/*
+ * Footprint.cpp
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Check the RAM footprint of a connected client against the RAM budget.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/*
+ * Host test: Connects a client to a local broker, which only acknowledges the connection, publishes with and
+ * without the I/O thread and checks the footprint against MQTT_RAM_BUDGET.
+ * The test uses the library with MQTT_HEAP_TRACKING and MQTT_PROFILE, so the heap and the stack are measured.
+ */
+
+#include <MQTT.h>
+
+#if !MQTT_HEAP_TRACKING || !MQTT_PROFILE
+    #error "The footprint test needs MQTT_HEAP_TRACKING and MQTT_PROFILE!"
+#endif
+
+#include <stdio.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+/** @brief Number of published messages in each mode.
+ */
+#define MESSAGES                    100
+
+/** @brief Listening socket of the broker.
+ */
+int Server;
+
+void Broker(void)
+{
+    uint8_t Buffer[256];
+    const uint8_t ConnAck[] = {0x20, 0x02, 0x00, 0x00};
+
+    int Connection = accept(Server, NULL, NULL);
+    if(Connection < 0)
+    {
+        return;
+    }
+
+    // Acknowledge the connection and drop everything else until the client closes the connection
+    if(recv(Connection, Buffer, sizeof(Buffer), 0) > 0)
+    {
+        send(Connection, ConnAck, sizeof(ConnAck), MSG_NOSIGNAL);
+        while(recv(Connection, Buffer, sizeof(Buffer), 0) > 0);
+    }
+
+    close(Connection);
+}
+
+bool Publish(MQTT& Client)
+{
+    uint16_t ID;
+
+    for(uint16_t i = 0x00; i < MESSAGES; i++)
+    {
+        // Wait for the queue and the socket when the client is busy
+        while(true)
+        {
+            MQTT::Error Error;
+
+            // Every second message is formatted into the transmit buffer and compressed, so the stack probe of the compression phase is taken
+            if(i & 0x01)
+            {
+                Error = Client.Publishf("footprint/test", "%064u", i);
+            }
+            else
+            {
+                Error = Client.Publish("footprint/test", (const uint8_t*)"Footprint", 9, &ID, MQTT::QOS_0);
+            }
+
+            if(Error == MQTT::NO_ERROR)
+            {
+                break;
+            }
+            else if((Error != MQTT::BUFFER_OVERFLOW) && (Error != MQTT::FLOW_CONTROL) && (Error != MQTT::WOULD_BLOCK))
+            {
+                fprintf(stderr, "[ERROR] Publish failed with %u!\n", Error);
+
+                return false;
+            }
+
+            Client.Poll();
+            delay(1);
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    MQTT_Footprint Footprint;
+    MQTT_Heap Heap;
+    struct sockaddr_in Address;
+    socklen_t Length = sizeof(Address);
+
+    Server = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&Address, 0x00, sizeof(Address));
+    Address.sin_family = AF_INET;
+    Address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if((Server < 0) || (bind(Server, (struct sockaddr*)&Address, sizeof(Address)) < 0) || (listen(Server, 1) < 0) || (getsockname(Server, (struct sockaddr*)&Address, &Length) < 0))
+    {
+        fprintf(stderr, "[ERROR] Can not start the broker!\n");
+
+        return 1;
+    }
+
+    std::thread Thread(Broker);
+    MQTT Client(IPAddress(127, 0, 0, 1), ntohs(Address.sin_port));
+    Client.SetCompression(true);
+
+    bool Passed = (Client.Connect("footprint") == MQTT::NO_ERROR) && Publish(Client) && (Client.StartThread() == MQTT::NO_ERROR) && Publish(Client);
+    Client.footprint(&Footprint);
+
+    Client.StopThread();
+    Client.Disonnect();
+    Thread.join();
+    close(Server);
+
+    if(!Passed)
+    {
+        fprintf(stderr, "[ERROR] Can not use the client!\n");
+
+        return 1;
+    }
+
+    MQTT_HeapUsage(&Heap);
+    uint32_t Used = Footprint.Total + Footprint.Heap + Footprint.Stack + Footprint.Thread;
+
+    printf("--- MQTT footprint ---\n");
+    printf("        Client: %u bytes\n", Footprint.Total);
+    printf("        Heap: %u bytes\n", Footprint.Heap);
+    printf("        Stack: %u bytes\n", Footprint.Stack);
+    printf("        I/O thread: %u bytes\n", Footprint.Thread);
+    printf("        Used: %u of %u bytes\n", Used, MQTT_RAM_BUDGET);
+
+    // The heap contains at least the ping timer and the profile measures the stack of each call
+    if((Footprint.Thread == 0x00) || (Footprint.Heap == 0x00) || (Heap.Allocations == 0x00) || (Footprint.Stack == 0x00))
+    {
+        fprintf(stderr, "[ERROR] The footprint is incomplete!\n");
+
+        return 1;
+    }
+
+    if((MQTT_RAM_BUDGET != 0) && (Used > MQTT_RAM_BUDGET))
+    {
+        fprintf(stderr, "[ERROR] The client exceeds MQTT_RAM_BUDGET!\n");
+
+        return 1;
+    }
+
+    return 0;
+}
\ No newline at end of file